@@ -0,0 +1,598 @@
+#include "mesh.h"
+#include "simplification.h"
+#include "stream.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+// Batch simplifier: many meshes at once, one per thread, without starting a process for each. Does not use OpenGL.
+//
+// usage: MeshBatch (-f faces | -r ratio | -e error) [-o directory] [-ply] [-t threads] [-m megabytes] [-large faces]
+//                  [-weld epsilon] [-cluster faces] [-report file.csv] (directory | manifest)
+//   -f, -r, -e  the target, as in MeshSimplifyCLI
+//   -o dir      where the outputs go, with the name of their input and the extension .off (or .ply with -ply).
+//               needed unless the manifest names every output
+//   -t n        worker threads. default: all
+//   -m MB       the meshes being simplified at the same time take at most about this much memory together.
+//               a mesh waits until enough of it is released. an OFF file that does not fit even alone is
+//               simplified out of core in windows of this size (see stream.h)
+//   -large n    meshes of at least n faces (default 2000000) are simplified one at a time, before the others,
+//               each with all the threads: the file is parsed in parallel and the edges are collapsed in
+//               parallel batches (ParallelEdgeCollapse), so the result differs slightly from MeshSimplifyCLI
+//   -weld eps   weld each mesh as it is read, as in MeshSimplifyCLI. not done for the meshes simplified out
+//               of core
+//   -cluster n  bring each mesh of more than n faces down to about n by vertex clustering as it is read, as in
+//               MeshSimplifyCLI. not done for the meshes simplified out of core
+//   -report     write one line per mesh as CSV: faces, times, faces per second, memory, worker
+//
+// The input is a directory, whose *.off, *.ply, *.obj and *.stl files are all simplified, or a text file with one
+// "input [output]" per line ('#' starts a comment).
+//
+// The meshes are dealt to the workers largest first. Each worker takes from the front of its own queue, and when
+// that is empty takes from the back of another's, so that a worker given a few large meshes does not hold the
+// others up. The memory of a mesh is estimated before it is read from the number of faces in its header
+// (or, for OBJ, from its size).
+
+// memory of one face while it is simplified: the Mesh, the quadrics, costs and heap, without a history
+#define BATCH_BYTES_PER_FACE 560
+
+#define BATCH_DEFAULT_LARGE_FACES 2000000
+
+struct BatchJob {
+    string input, output;
+    int    n_estimatedFaces;
+    double estimatedBytes;
+    bool   isLarge, isStreamed;
+};
+
+struct BatchResult {
+    bool   isDone;
+    int    n_inputFaces, n_outputFaces;
+    int    n_weldRemovedVertices, n_weldRemovedFaces;
+    int    n_clusterRemovedFaces;
+    double waitTime, readTime, simplifyTime, writeTime;
+    double memory;         // bytes of the Mesh and the Simplification after simplifying
+    int    worker;
+};
+
+struct BatchTarget {
+    int    n_target_faces;
+    double ratio, maxError;
+    double weldEpsilon;
+    int    clusterFaces;
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// work-stealing queues and the memory budget
+/////////////////////////////////////////////////////////////////////////////
+
+// one queue of job indices per worker. no job is added once the workers start, so a worker that finds every
+// queue empty is done
+class WorkStealingQueues {
+    struct Queue {
+        omp_lock_t  lock;
+        vector<int> job;
+        int head, tail;    // [head, tail) is left
+    };
+
+    vector<Queue> queue;
+
+public:
+    WorkStealingQueues(int n_workers, const vector<int> &order){
+        queue.resize(n_workers);
+
+        for(unsigned int i = 0; i < order.size(); i++) queue[i % n_workers].job.push_back(order[i]);
+
+        for(int w = 0; w < n_workers; w++){
+            omp_init_lock(&queue[w].lock);
+            queue[w].head = 0;
+            queue[w].tail = (int)queue[w].job.size();
+        }
+    }
+
+    ~WorkStealingQueues(){
+        for(unsigned int w = 0; w < queue.size(); w++) omp_destroy_lock(&queue[w].lock);
+    }
+
+    // the next job of "worker", its own from the front or another's from the back. false when none is left
+    bool Pop(int worker, int &job){
+        int n_workers = (int)queue.size();
+
+        for(int k = 0; k < n_workers; k++){
+            Queue &q = queue[(worker + k) % n_workers];
+            bool isTaken = false;
+
+            omp_set_lock(&q.lock);
+            if(q.head < q.tail){
+                job = (k == 0) ? q.job[q.head++] : q.job[--q.tail];
+                isTaken = true;
+            }
+            omp_unset_lock(&q.lock);
+
+            if(isTaken) return true;
+        }
+
+        return false;
+    }
+};
+
+class MemoryBudget {
+    omp_lock_t lock;
+    double budget, reserved, peak;   // bytes. budget is negative if there is none
+    int    n_running;
+
+public:
+    MemoryBudget(double budget_in){
+        omp_init_lock(&lock);
+        budget = budget_in;
+        reserved = peak = 0.0;
+        n_running = 0;
+    }
+
+    ~MemoryBudget(){ omp_destroy_lock(&lock); }
+
+    // waits until "bytes" fit. a job runs anyway when nothing else does, so that every job starts eventually
+    void Reserve(double bytes){
+        for(;;){
+            bool isReserved = false;
+
+            omp_set_lock(&lock);
+            if(budget < 0.0 || n_running == 0 || reserved + bytes <= budget){
+                reserved += bytes;
+                n_running++;
+                if(reserved > peak) peak = reserved;
+                isReserved = true;
+            }
+            omp_unset_lock(&lock);
+
+            if(isReserved) return;
+
+            SleepMilliseconds(2);
+        }
+    }
+
+    void Release(double bytes){
+        omp_set_lock(&lock);
+        reserved -= bytes;
+        n_running--;
+        omp_unset_lock(&lock);
+    }
+
+    double Peak(){ return peak; }
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// jobs
+/////////////////////////////////////////////////////////////////////////////
+
+static bool IsMeshFile(const char *filename)
+{
+    const char *extension = strrchr(filename, '.');
+
+    return extension != NULL && (HasExtension(extension, ".off") || HasExtension(extension, ".ply") ||
+                                 HasExtension(extension, ".obj") || HasExtension(extension, ".stl"));
+}
+
+// the mesh files of a directory, not of its subdirectories, sorted by name. false if it is not a directory
+static bool ListDirectory(const string &directory, vector<string> &filenames)
+{
+#ifdef _WIN32
+    WIN32_FIND_DATAA data;
+    HANDLE handle = FindFirstFileA((directory + "\\*").c_str(), &data);
+
+    if(handle == INVALID_HANDLE_VALUE) return false;
+
+    do{
+        if((data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0 && IsMeshFile(data.cFileName)){
+            filenames.push_back(directory + "\\" + data.cFileName);
+        }
+    }while(FindNextFileA(handle, &data));
+
+    FindClose(handle);
+#else
+    DIR *dir = opendir(directory.c_str());
+
+    if(dir == NULL) return false;
+
+    for(struct dirent *entry = readdir(dir); entry != NULL; entry = readdir(dir)){
+        if(entry->d_name[0] != '.' && IsMeshFile(entry->d_name)) filenames.push_back(directory + "/" + entry->d_name);
+    }
+
+    closedir(dir);
+#endif
+
+    sort(filenames.begin(), filenames.end());
+
+    return true;
+}
+
+// "input [output]" per line. the output is empty if not given
+static bool ReadManifest(const char *filename, vector<string> &inputs, vector<string> &outputs)
+{
+    MappedFile file;
+
+    if(file.Open(filename) == false){
+        cerr << filename << " is neither a directory nor a manifest.\n";
+        return false;
+    }
+
+    const char *end = file.data + file.size;
+
+    for(const char *p = file.data; p < end; p = SkipLine(p, end)){
+        if(IsBlankOrComment(p, end)) continue;
+
+        string name[2];
+
+        for(int k = 0; k < 2; k++){
+            p = SkipSpaces(p, end);
+
+            const char *q = p;
+            while(q < end && IsSpace(*q) == false && *q != '\n' && *q != '#') q++;
+
+            name[k].assign(p, q - p);
+            p = q;
+        }
+
+        inputs.push_back(name[0]);
+        outputs.push_back(name[1]);
+    }
+
+    return true;
+}
+
+// the number of faces, from the header of OFF and PLY and the size of STL. OBJ is not read: it takes about
+// 32 bytes per face in its size. 0 if the file cannot be opened
+static int EstimateFaces(const char *filename)
+{
+    MappedFile file;
+
+    if(file.Open(filename) == false) return 0;
+
+    const char *extension = strrchr(filename, '.');
+    const char *p = file.data, *end = file.data + file.size;
+    int n_vertices, n_faces;
+
+    if(HasExtension(extension, ".off")){
+        if(ParseOFFHeader(p, end, n_vertices, n_faces)) return n_faces;
+    }else if(HasExtension(extension, ".stl")){
+        if(file.size > 84) return (int)((file.size - 84) / 50);
+    }else if(HasExtension(extension, ".ply")){
+        const char *headerEnd = (end - p > 65536) ? p + 65536 : end;
+
+        for(; p < headerEnd; p = SkipLine(p, headerEnd)){
+            const char *q = SkipSpaces(p, headerEnd);
+
+            if(headerEnd - q > 13 && strncmp(q, "element face ", 13) == 0){
+                q += 13;
+                if(ParseInt(q, headerEnd, n_faces)) return n_faces;
+            }
+        }
+    }
+
+    double n_estimated = file.size / 32.0;
+
+    return (n_estimated < 2.0e9) ? (int)n_estimated : 2000000000;
+}
+
+static string OutputFilename(const string &input, const char *outputDirectory, bool isPLY)
+{
+    size_t slash = input.find_last_of("/\\");
+    string name  = (slash == string::npos) ? input : input.substr(slash + 1);
+
+    size_t dot = name.rfind('.');
+    if(dot != string::npos) name.erase(dot);
+
+    return string(outputDirectory) + "/" + name + (isPLY ? ".ply" : ".off");
+}
+
+// large jobs run outside of the pool, where the parallel regions of reading and collapsing get all the threads.
+// inside of it they run on the calling thread only
+static bool SimplifyJob(const BatchJob &job, const BatchTarget &target, double memoryBudget, BatchResult &result)
+{
+    double time = GetWallClockTime();
+
+    if(job.isStreamed){
+        StreamSimplification streamSimplification;
+
+        if(streamSimplification.Simplify(job.input.c_str(), job.output.c_str(), target.n_target_faces, target.ratio,
+                                         target.maxError, memoryBudget) == false) return false;
+
+        result.n_inputFaces  = streamSimplification.NumberOfInputFaces();
+        result.n_outputFaces = streamSimplification.NumberOfOutputFaces();
+        result.simplifyTime  = GetWallClockTime() - time;
+        result.memory        = memoryBudget;
+        return true;
+    }
+
+    Mesh mesh;
+    Simplification simplification;
+
+    mesh.isVerbose    = job.isLarge;
+    mesh.weldEpsilon  = target.weldEpsilon;
+    mesh.clusterFaces = target.clusterFaces;
+
+    if(mesh.ConstructMeshDataStructure((char*)job.input.c_str()) == false) return false;
+
+    result.readTime     = GetWallClockTime() - time;
+    result.n_inputFaces = mesh.n_faces + mesh.n_weldRemovedFaces + mesh.n_clusterRemovedFaces;
+    result.n_weldRemovedVertices = mesh.n_weldRemovedVertices;
+    result.n_weldRemovedFaces    = mesh.n_weldRemovedFaces;
+    result.n_clusterRemovedFaces = mesh.n_clusterRemovedFaces;
+    time = GetWallClockTime();
+
+    simplification.SetHistoryLimit(0, false);
+    simplification.DeferNormals(true);
+    simplification.InitSimplification(&mesh);
+
+    // as in MeshSimplifyCLI
+    int n_faces_to_keep = 0, n_unclusteredFaces = mesh.n_faces + mesh.n_clusterRemovedFaces;
+    if(target.n_target_faces >= 0) n_faces_to_keep = target.n_target_faces;
+    if(target.ratio >= 0.0 && target.ratio * n_unclusteredFaces > n_faces_to_keep) n_faces_to_keep = (int)(target.ratio * n_unclusteredFaces);
+
+    double maxCost = (target.maxError >= 0.0) ? target.maxError * mesh.normalizationScale * mesh.normalizationScale : DBL_MAX;
+
+    if(job.isLarge){
+        simplification.ParallelEdgeCollapse(n_faces_to_keep, maxCost, true);
+    }else{
+        while(simplification.NumberOfActiveFaces() > n_faces_to_keep){
+            if(simplification.EdgeCollapse(maxCost) == false) break;
+        }
+    }
+
+    result.simplifyTime  = GetWallClockTime() - time;
+    result.n_outputFaces = simplification.NumberOfActiveFaces();
+    result.memory        = (double)mesh.MemoryUsage() + (double)simplification.MemoryUsage();
+    time = GetWallClockTime();
+
+    if(mesh.WriteMeshFile((char*)job.output.c_str()) == false) return false;
+
+    result.writeTime = GetWallClockTime() - time;
+
+    return true;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// report
+/////////////////////////////////////////////////////////////////////////////
+
+static double TotalTime(const BatchResult &result){ return result.readTime + result.simplifyTime + result.writeTime; }
+
+static void PrintResult(const BatchJob &job, const BatchResult &result, int n_finished, int n_jobs)
+{
+    if(result.isDone == false){
+        fprintf(stderr, "[%5d/%d] %s FAILED\n", n_finished, n_jobs, job.input.c_str());
+        return;
+    }
+
+    double total = TotalTime(result);
+    char   welded[64] = "", clustered[64] = "";
+
+    if(result.n_weldRemovedVertices > 0 || result.n_weldRemovedFaces > 0){
+        sprintf(welded, "  welded: -%d vertices -%d faces", result.n_weldRemovedVertices, result.n_weldRemovedFaces);
+    }
+    if(result.n_clusterRemovedFaces > 0){
+        sprintf(clustered, "  clustered: -%d faces", result.n_clusterRemovedFaces);
+    }
+
+    fprintf(stderr, "[%5d/%d] %s  %d -> %d faces  %.3f sec  %.0f faces/sec  %.1f MB%s%s%s\n", n_finished, n_jobs, job.input.c_str(),
+            result.n_inputFaces, result.n_outputFaces, total, (total > 0.0) ? result.n_inputFaces / total : 0.0,
+            result.memory / 1048576.0, welded, clustered, job.isStreamed ? "  (out of core)" : "");
+}
+
+static bool WriteReport(const char *filename, const vector<BatchJob> &jobs, const vector<BatchResult> &results)
+{
+    FILE *fp = fopen(filename, "w");
+
+    if(fp == NULL){
+        cerr << "cannot open " << filename << endl;
+        return false;
+    }
+
+    fprintf(fp, "input,output,status,input_faces,output_faces,welded_vertices,welded_faces,clustered_faces,wait_sec,read_sec,simplify_sec,write_sec,total_sec,faces_per_sec,memory_mb,worker\n");
+
+    for(unsigned int i = 0; i < jobs.size(); i++){
+        const BatchResult &r = results[i];
+        double total = TotalTime(r);
+
+        fprintf(fp, "\"%s\",\"%s\",%s,%d,%d,%d,%d,%d,%.6f,%.6f,%.6f,%.6f,%.6f,%.0f,%.1f,%d\n", jobs[i].input.c_str(), jobs[i].output.c_str(),
+                r.isDone ? "ok" : "failed", r.n_inputFaces, r.n_outputFaces, r.n_weldRemovedVertices, r.n_weldRemovedFaces, r.n_clusterRemovedFaces, r.waitTime, r.readTime, r.simplifyTime, r.writeTime,
+                total, (r.isDone && total > 0.0) ? r.n_inputFaces / total : 0.0, r.memory / 1048576.0, r.worker);
+    }
+
+    fclose(fp);
+
+    return true;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// main
+/////////////////////////////////////////////////////////////////////////////
+
+// orders job indices by decreasing size, then by name
+struct IsLargerJob {
+    const vector<BatchJob> &jobs;
+
+    IsLargerJob(const vector<BatchJob> &jobs_in) : jobs(jobs_in) {}
+
+    bool operator()(int a, int b) const {
+        int fa = jobs[a].n_estimatedFaces, fb = jobs[b].n_estimatedFaces;
+        return (fa != fb) ? fa > fb : a < b;
+    }
+};
+
+static void PrintUsage()
+{
+    cerr << "usage: MeshBatch (-f faces | -r ratio | -e error) [-o directory] [-ply] [-t threads] [-m megabytes] [-large faces] [-weld epsilon] [-cluster faces] [-report file.csv] (directory | manifest)\n";
+}
+
+int main(int argc, char *argv[])
+{
+    BatchTarget target;
+    target.n_target_faces = -1;
+    target.ratio = target.maxError = target.weldEpsilon = -1.0;
+    target.clusterFaces = -1;
+
+    char  *outputDirectory = NULL, *reportFilename = NULL, *inputName = NULL;
+    double memoryBudget = -1.0;
+    int    n_workers = omp_get_max_threads(), n_largeFaces = BATCH_DEFAULT_LARGE_FACES;
+    bool   isPLY = false;
+
+    for(int i = 1; i < argc; i++){
+        if     (strcmp(argv[i], "-f")      == 0 && i+1 < argc) target.n_target_faces = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-r")      == 0 && i+1 < argc) target.ratio          = atof(argv[++i]);
+        else if(strcmp(argv[i], "-e")      == 0 && i+1 < argc) target.maxError       = atof(argv[++i]);
+        else if(strcmp(argv[i], "-o")      == 0 && i+1 < argc) outputDirectory       = argv[++i];
+        else if(strcmp(argv[i], "-t")      == 0 && i+1 < argc) n_workers             = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-m")      == 0 && i+1 < argc) memoryBudget          = atof(argv[++i]) * 1024.0 * 1024.0;
+        else if(strcmp(argv[i], "-large")  == 0 && i+1 < argc) n_largeFaces          = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-weld")   == 0 && i+1 < argc) target.weldEpsilon    = atof(argv[++i]);
+        else if(strcmp(argv[i], "-cluster") == 0 && i+1 < argc) target.clusterFaces  = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-report") == 0 && i+1 < argc) reportFilename        = argv[++i];
+        else if(strcmp(argv[i], "-ply")    == 0) isPLY = true;
+        else if(inputName == NULL) inputName = argv[i];
+        else{
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if(inputName == NULL || n_workers < 1 || (target.n_target_faces < 0 && target.ratio < 0.0 && target.maxError < 0.0)){
+        PrintUsage();
+        return 1;
+    }
+
+    vector<string> inputs, outputs;
+
+    if(ListDirectory(inputName, inputs)) outputs.resize(inputs.size());
+    else if(ReadManifest(inputName, inputs, outputs) == false) return 1;
+
+    int n_jobs = (int)inputs.size();
+    vector<BatchJob> jobs(n_jobs);
+
+    for(int i = 0; i < n_jobs; i++){
+        BatchJob &job = jobs[i];
+
+        job.input = inputs[i];
+
+        if(outputs[i].empty() == false)  job.output = outputs[i];
+        else if(outputDirectory != NULL) job.output = OutputFilename(inputs[i], outputDirectory, isPLY);
+        else{
+            cerr << "no output for " << inputs[i] << ": give -o\n";
+            return 1;
+        }
+
+        if(job.output == job.input){
+            cerr << job.input << " would be overwritten\n";
+            return 1;
+        }
+
+        const char *extension = strrchr(job.input.c_str(), '.');
+
+        job.n_estimatedFaces = EstimateFaces(job.input.c_str());
+        job.estimatedBytes   = (double)job.n_estimatedFaces * BATCH_BYTES_PER_FACE;
+        job.isStreamed       = memoryBudget >= 0.0 && job.estimatedBytes > memoryBudget && extension != NULL && HasExtension(extension, ".off");
+        job.isLarge          = job.isStreamed || job.n_estimatedFaces >= n_largeFaces;
+
+        if(memoryBudget >= 0.0 && job.estimatedBytes > memoryBudget && job.isStreamed == false){
+            cerr << job.input << " may not fit in " << memoryBudget / 1048576.0 << " MB, and only OFF can be simplified out of core\n";
+        }
+    }
+
+    // largest first, both for the large meshes and for dealing the others to the workers
+    vector<int> large, small;
+
+    for(int i = 0; i < n_jobs; i++){
+        if(jobs[i].isLarge) large.push_back(i);
+        else                small.push_back(i);
+    }
+
+    sort(large.begin(), large.end(), IsLargerJob(jobs));
+    sort(small.begin(), small.end(), IsLargerJob(jobs));
+
+    vector<BatchResult> results(n_jobs);
+
+    for(int i = 0; i < n_jobs; i++){
+        BatchResult &r = results[i];
+
+        r.isDone = false;
+        r.n_inputFaces = r.n_outputFaces = 0;
+        r.n_weldRemovedVertices = r.n_weldRemovedFaces = r.n_clusterRemovedFaces = 0;
+        r.waitTime = r.readTime = r.simplifyTime = r.writeTime = r.memory = 0.0;
+        r.worker = -1;
+    }
+
+    fprintf(stderr, "%d meshes, %d large, on %d workers\n", n_jobs, (int)large.size(), n_workers);
+
+    double startTime = GetWallClockTime();
+    int    n_finished = 0;
+
+    for(unsigned int k = 0; k < large.size(); k++){
+        int i = large[k];
+
+        results[i].isDone = SimplifyJob(jobs[i], target, memoryBudget, results[i]);
+        results[i].worker = 0;
+
+        PrintResult(jobs[i], results[i], ++n_finished, n_jobs);
+    }
+
+    if(small.empty() == false){
+        WorkStealingQueues queues(n_workers, small);
+        MemoryBudget       budget(memoryBudget);
+
+        #pragma omp parallel num_threads(n_workers)
+        {
+            int worker = omp_get_thread_num();
+            int i;
+
+            while(queues.Pop(worker, i)){
+                double time = GetWallClockTime();
+
+                budget.Reserve(jobs[i].estimatedBytes);
+
+                results[i].waitTime = GetWallClockTime() - time;
+                results[i].isDone   = SimplifyJob(jobs[i], target, memoryBudget, results[i]);
+                results[i].worker   = worker;
+
+                budget.Release(jobs[i].estimatedBytes);
+
+                #pragma omp critical(batchOutput)
+                PrintResult(jobs[i], results[i], ++n_finished, n_jobs);
+            }
+        }
+
+        if(memoryBudget >= 0.0) fprintf(stderr, "memory reserved at most %.1f MB\n", budget.Peak() / 1048576.0);
+    }
+
+    double wallTime = GetWallClockTime() - startTime;
+
+    long long n_inputFaces = 0, n_outputFaces = 0;
+    int       n_failed = 0;
+
+    for(int i = 0; i < n_jobs; i++){
+        if(results[i].isDone == false){ n_failed++; continue; }
+
+        n_inputFaces  += results[i].n_inputFaces;
+        n_outputFaces += results[i].n_outputFaces;
+    }
+
+    fprintf(stderr, "%d meshes simplified, %d failed, %lld -> %lld faces in %.3f sec: %.2f meshes/sec, %.0f faces/sec\n",
+            n_jobs - n_failed, n_failed, n_inputFaces, n_outputFaces, wallTime,
+            (wallTime > 0.0) ? (n_jobs - n_failed) / wallTime : 0.0, (wallTime > 0.0) ? n_inputFaces / wallTime : 0.0);
+
+    if(reportFilename != NULL && WriteReport(reportFilename, jobs, results) == false) return 1;
+
+    return (n_failed > 0) ? 1 : 0;
+}
@@ -0,0 +1,343 @@
+#include "mesh.h"
+#include "simplification.h"
+#include "generate.h"
+#include "fileio.h"
+#include "parallel.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+// Benchmark of the simplification on procedural meshes (generate.h). Does not use OpenGL, GLUT or windows.h.
+//
+// usage: MeshBenchmark [-mesh sphere,grid,fan] [-faces 10000,100000,1000000] [-noload] [-checkpoints n] [-repeat n]
+//                      [-o results.json] [-baseline baseline.json [-tolerance 0.1]]
+//   -mesh        the generators to run
+//   -faces       the sizes, in faces. each generator makes the smallest mesh of its kind with at least as many
+//   -noload      skip writing each mesh to a temporary PLY file and reading it back, which needs a second copy
+//                of the mesh in memory
+//   -checkpoints copies of the mesh kept for the LOD sweep, 8 as in the viewer, 0 for none. each takes as much
+//                memory as the mesh
+//   -repeat      run each case n times and keep the best of each measure, for steadier numbers
+//   -o           write the results as JSON
+//   -baseline    compare with the JSON of an earlier run: a time more than "tolerance" (a fraction) longer,
+//                or a rate as much lower, is a regression, and the exit code is 1
+//
+// For each mesh it measures, in this order:
+//   connectivity_sec   ConstructMeshDataStructure from the generated arrays
+//   load_sec           ConstructMeshDataStructure from the PLY file, reading included
+//   init_sec           InitSimplification
+//   collapses_per_sec  EdgeCollapse down to the coarsest level of ControlLevelOfDetail (step 200)
+//   splits_per_sec     VertexSplit back to the input mesh
+//   lod_sweep_sec      ControlLevelOfDetail over steps 1 to 200 and back to 0, jumping through the checkpoints
+// The history and the deferred normals are set up as in the viewer.
+
+enum { METRIC_CONNECTIVITY, METRIC_LOAD, METRIC_INIT, METRIC_COLLAPSES, METRIC_SPLITS, METRIC_LOD_SWEEP, N_METRICS };
+
+struct Metric {
+    const char *key;
+    bool        isRate;   // higher is better
+};
+
+static const Metric metrics[N_METRICS] = {
+    { "connectivity_sec",  false },
+    { "load_sec",          false },
+    { "init_sec",          false },
+    { "collapses_per_sec", true  },
+    { "splits_per_sec",    true  },
+    { "lod_sweep_sec",     false }
+};
+
+struct BenchmarkResult {
+    string name;                 // generator-faces, e.g. "sphere-100000"
+    int    n_vertices, n_faces, n_collapses;
+    double generateTime, memoryMB;
+    double value[N_METRICS];     // negative if not measured
+};
+
+
+static void PrintUsage()
+{
+    cerr << "usage: MeshBenchmark [-mesh sphere,grid,fan] [-faces 10000,100000,1000000] [-noload] [-checkpoints n] [-repeat n] [-o results.json] [-baseline baseline.json [-tolerance 0.1]]\n";
+}
+
+static bool RunBenchmark(const char *generator, int n_target_faces, bool isLoadMeasured, int n_checkpoints, BenchmarkResult &result)
+{
+    char name[64];
+    sprintf(name, "%.40s-%d", generator, n_target_faces);
+
+    result.name = name;
+    for(int k = 0; k < N_METRICS; k++) result.value[k] = -1.0;
+
+    cerr << "== " << name << endl;
+
+    double time = GetWallClockTime();
+
+    GeneratedMesh generated;
+    if(GenerateMesh(generator, n_target_faces, generated) == false){
+        cerr << "unknown mesh generator: " << generator << endl;
+        return false;
+    }
+
+    result.generateTime = GetWallClockTime() - time;
+    result.n_vertices   = generated.NumberOfVertices();
+    result.n_faces      = generated.NumberOfFaces();
+
+    Mesh mesh;
+
+    time = GetWallClockTime();
+    if(mesh.ConstructMeshDataStructure(generated.NumberOfVertices(), &generated.coord[0], generated.NumberOfFaces(), &generated.corner[0]) == false) return false;
+    result.value[METRIC_CONNECTIVITY] = GetWallClockTime() - time;
+
+    // the generated arrays are not needed any more
+    vector<double>().swap(generated.coord);
+    vector<int>().swap(generated.corner);
+
+    if(isLoadMeasured){
+        char filename[80];
+        sprintf(filename, "bench_%s.ply", name);
+
+        if(mesh.WriteMeshFile(filename) == false) return false;
+
+        Mesh loaded;
+
+        time = GetWallClockTime();
+        bool isRead = loaded.ConstructMeshDataStructure(filename);
+        result.value[METRIC_LOAD] = GetWallClockTime() - time;
+
+        remove(filename);
+        if(isRead == false) return false;
+    }
+
+    Simplification simplification;
+
+    time = GetWallClockTime();
+    simplification.SetCheckpointInterval((n_checkpoints > 0) ? mesh.n_vertices / n_checkpoints + 1 : 0);
+    simplification.DeferNormals(true);
+    simplification.InitSimplification(&mesh);
+    result.value[METRIC_INIT] = GetWallClockTime() - time;
+
+    // the coarsest level of the sweep
+    int n_coarsest_faces = mesh.n_faces*pow(0.95, 200);
+
+    time = GetWallClockTime();
+    while(simplification.NumberOfActiveFaces() > n_coarsest_faces) if(simplification.EdgeCollapse() == false) break;
+    simplification.UpdateNormals();
+    double collapseTime = GetWallClockTime() - time;
+
+    result.n_collapses = simplification.NumberOfAppliedCollapses();
+    result.value[METRIC_COLLAPSES] = result.n_collapses / collapseTime;
+    result.memoryMB = (mesh.MemoryUsage() + simplification.MemoryUsage()) / 1048576.0;
+
+    time = GetWallClockTime();
+    while(simplification.NumberOfAppliedCollapses() > 0) simplification.VertexSplit();
+    simplification.UpdateNormals();
+    result.value[METRIC_SPLITS] = result.n_collapses / (GetWallClockTime() - time);
+
+    time = GetWallClockTime();
+    for(int step = 1; step <= 200; step++) simplification.ControlLevelOfDetail(step);
+    for(int step = 199; step >= 0; step--) simplification.ControlLevelOfDetail(step);
+    result.value[METRIC_LOD_SWEEP] = GetWallClockTime() - time;
+
+    return true;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// JSON. one case per line, so that a baseline can be read back line by line
+/////////////////////////////////////////////////////////////////////////////
+
+static bool WriteResults(const char *filename, const vector<BenchmarkResult> &results)
+{
+    FILE *fp = fopen(filename, "w");
+
+    if(fp == NULL){
+        cerr << filename << " cannot be written.\n";
+        return false;
+    }
+
+    fprintf(fp, "{\n  \"threads\": %d,\n  \"coordinate_bytes\": %d,\n  \"cases\": [\n", omp_get_max_threads(), (int)sizeof(Real));
+
+    for(unsigned int i = 0; i < results.size(); i++){
+        const BenchmarkResult &r = results[i];
+
+        fprintf(fp, "    { \"case\": \"%s\", \"vertices\": %d, \"faces\": %d, \"collapses\": %d, \"memory_mb\": %.1f, \"generate_sec\": %.6f",
+                r.name.c_str(), r.n_vertices, r.n_faces, r.n_collapses, r.memoryMB, r.generateTime);
+
+        for(int k = 0; k < N_METRICS; k++){
+            if(r.value[k] >= 0.0) fprintf(fp, ", \"%s\": %.6g", metrics[k].key, r.value[k]);
+        }
+
+        fprintf(fp, " }%s\n", (i + 1 < results.size()) ? "," : "");
+    }
+
+    fprintf(fp, "  ]\n}\n");
+    fclose(fp);
+
+    return true;
+}
+
+// the value of "key" in a line of WriteResults, or -1 if the line has none
+static double FindValue(const char *line, const char *key)
+{
+    char pattern[64];
+    sprintf(pattern, "\"%s\": ", key);
+
+    const char *p = strstr(line, pattern);
+
+    return (p != NULL) ? atof(p + strlen(pattern)) : -1.0;
+}
+
+static bool ReadBaseline(const char *filename, vector<BenchmarkResult> &baseline)
+{
+    FILE *fp = fopen(filename, "r");
+
+    if(fp == NULL){
+        cerr << filename << " cannot be read.\n";
+        return false;
+    }
+
+    char line[4096];
+
+    while(fgets(line, sizeof(line), fp) != NULL){
+        const char *p = strstr(line, "\"case\": \"");
+        if(p == NULL) continue;
+
+        p += strlen("\"case\": \"");
+
+        const char *q = strchr(p, '"');
+        if(q == NULL) continue;
+
+        BenchmarkResult r;
+        r.name.assign(p, q);
+        r.n_faces = (int)FindValue(line, "faces");
+
+        for(int k = 0; k < N_METRICS; k++) r.value[k] = FindValue(line, metrics[k].key);
+
+        baseline.push_back(r);
+    }
+
+    fclose(fp);
+
+    return true;
+}
+
+// returns the number of regressions
+static int CompareWithBaseline(const vector<BenchmarkResult> &results, const vector<BenchmarkResult> &baseline, double tolerance)
+{
+    int n_regressions = 0;
+
+    printf("\n%-20s %-18s %12s %12s %8s\n", "case", "metric", "baseline", "now", "change");
+
+    for(unsigned int i = 0; i < results.size(); i++){
+        const BenchmarkResult *base = NULL;
+
+        for(unsigned int j = 0; j < baseline.size(); j++) if(baseline[j].name == results[i].name) base = &baseline[j];
+
+        if(base == NULL){
+            printf("%-20s not in the baseline\n", results[i].name.c_str());
+            continue;
+        }
+
+        for(int k = 0; k < N_METRICS; k++){
+            double now = results[i].value[k], before = base->value[k];
+
+            if(now <= 0.0 || before <= 0.0) continue;
+
+            // how much slower, as a fraction: of the time, or of the rate the other way round
+            double slowdown = metrics[k].isRate ? before / now - 1.0 : now / before - 1.0;
+
+            bool isRegression = slowdown > tolerance;
+            if(isRegression) n_regressions++;
+
+            printf("%-20s %-18s %12.6g %12.6g %+7.1f%%%s\n", results[i].name.c_str(), metrics[k].key, before, now,
+                   (now / before - 1.0) * 100.0, isRegression ? "  REGRESSION" : "");
+        }
+    }
+
+    return n_regressions;
+}
+
+
+// a comma-separated list
+static void SplitList(char *list, vector<char*> &items)
+{
+    items.clear();
+
+    for(char *item = strtok(list, ","); item != NULL; item = strtok(NULL, ",")) items.push_back(item);
+}
+
+int main(int argc, char *argv[])
+{
+    char  defaultMeshes[] = "sphere,grid,fan", defaultFaces[] = "10000,100000,1000000";
+    char *meshList = defaultMeshes, *faceList = defaultFaces;
+    char *outputFilename = NULL, *baselineFilename = NULL;
+    double tolerance = 0.1;
+    bool   isLoadMeasured = true;
+    int    n_repeats = 1, n_checkpoints = 8;
+
+    for(int i = 1; i < argc; i++){
+        if     (strcmp(argv[i], "-mesh")        == 0 && i+1 < argc) meshList         = argv[++i];
+        else if(strcmp(argv[i], "-faces")       == 0 && i+1 < argc) faceList         = argv[++i];
+        else if(strcmp(argv[i], "-o")           == 0 && i+1 < argc) outputFilename   = argv[++i];
+        else if(strcmp(argv[i], "-baseline")    == 0 && i+1 < argc) baselineFilename = argv[++i];
+        else if(strcmp(argv[i], "-tolerance")   == 0 && i+1 < argc) tolerance        = atof(argv[++i]);
+        else if(strcmp(argv[i], "-checkpoints") == 0 && i+1 < argc) n_checkpoints    = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-repeat")      == 0 && i+1 < argc) n_repeats        = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-noload")      == 0) isLoadMeasured = false;
+        else{
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    vector<char*> meshes, faces;
+    SplitList(meshList, meshes);
+    SplitList(faceList, faces);
+
+    vector<BenchmarkResult> results, baseline;
+
+    if(baselineFilename != NULL && ReadBaseline(baselineFilename, baseline) == false) return 1;
+
+    for(unsigned int i = 0; i < meshes.size(); i++){
+        for(unsigned int j = 0; j < faces.size(); j++){
+            BenchmarkResult result, again;
+
+            if(RunBenchmark(meshes[i], atoi(faces[j]), isLoadMeasured, n_checkpoints, result) == false) return 1;
+
+            for(int r = 1; r < n_repeats; r++){
+                if(RunBenchmark(meshes[i], atoi(faces[j]), isLoadMeasured, n_checkpoints, again) == false) return 1;
+
+                for(int k = 0; k < N_METRICS; k++){
+                    if(metrics[k].isRate ? again.value[k] > result.value[k] : again.value[k] < result.value[k]) result.value[k] = again.value[k];
+                }
+            }
+
+            results.push_back(result);
+        }
+    }
+
+    printf("%-20s %10s %10s %12s %10s %10s %14s %14s %10s %10s\n", "case", "vertices", "faces", "connectivity", "load", "init",
+           "collapses/s", "splits/s", "LOD sweep", "MB");
+
+    for(unsigned int i = 0; i < results.size(); i++){
+        const BenchmarkResult &r = results[i];
+
+        printf("%-20s %10d %10d %12.3f %10.3f %10.3f %14.0f %14.0f %10.3f %10.1f\n", r.name.c_str(), r.n_vertices, r.n_faces,
+               r.value[METRIC_CONNECTIVITY], r.value[METRIC_LOAD], r.value[METRIC_INIT], r.value[METRIC_COLLAPSES],
+               r.value[METRIC_SPLITS], r.value[METRIC_LOD_SWEEP], r.memoryMB);
+    }
+
+    if(outputFilename != NULL && WriteResults(outputFilename, results) == false) return 1;
+
+    if(baselineFilename != NULL){
+        int n_regressions = CompareWithBaseline(results, baseline, tolerance);
+
+        printf("%d regressions beyond %.0f%%\n", n_regressions, tolerance * 100.0);
+
+        if(n_regressions > 0) return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,170 @@
+#include "mesh.h"
+#include "simplification.h"
+#include "stream.h"
+#include "parallel.h"
+#include "stats.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Command line simplifier. Does not use OpenGL, GLUT or windows.h.
+//
+// usage: MeshSimplifyCLI (-f faces | -r ratio | -e error) [-p | -pn | -s megabytes] [-pm file.pm [-h records] [-hq]] [-log file] [-weld epsilon] [-cluster faces] [-stats file] [-trace file] input output
+//   -f faces   stop at this number of faces
+//   -r ratio   stop at this fraction of the input faces
+//   -e error   stop before a collapse whose quadric error exceeds "error"
+//              (sum of squared distances, in squared units of the input)
+//   -p         collapse batches of independent edges in parallel. the result does not depend on the
+//              number of threads, but differs slightly from the one-by-one order
+//   -pn        like -p, with batches as large as the number of threads allows. the result depends on it
+//   -s MB      out-of-core: simplify an OFF file larger than memory in windows of about MB megabytes
+//              (see stream.h). cannot be used with -p, -pm, -log, -weld or -cluster
+//   -pm file   also write the progressive mesh of the result (see progressive.h)
+//   -h n       keep only the latest n collapses in the history, so the progressive mesh starts from the
+//              mesh before them. without -pm or -log no history is kept
+//   -hq        quantize the coordinates in the history to 21 bits (see history.h)
+//   -log file  also write the collapses in order, one "edge v0 v1" per line
+//   -weld eps  merge the vertices closer than eps times the largest side of the bounding box (0: coincident
+//              ones only) and remove the faces that become degenerate or duplicate, before the connectivity
+//              is built. for triangle soups such as STL or exported OFF
+//   -cluster n    first bring a mesh of more than n faces down to about n by vertex clustering on a grid
+//              (see cluster.cpp), before the connectivity is built. much faster than collapsing edges down to
+//              n, but coarser. -r is still a fraction of the faces read
+//   -stats file   write the counters and the time of each phase as JSON (see stats.h)
+//   -trace file   write the phases as a timeline for chrome://tracing or Perfetto
+//              both need a build with MESH_ENABLE_STATS
+//
+// input is *.off, *.ply, *.obj or *.stl. output is *.ply (binary) or otherwise OFF
+
+static void PrintUsage()
+{
+    cerr << "usage: MeshSimplifyCLI (-f faces | -r ratio | -e error) [-p | -pn | -s megabytes] [-pm file.pm [-h records] [-hq]] [-log file] [-weld epsilon] [-cluster faces] [-stats file] [-trace file] input output\n";
+}
+
+static void PrintPhaseTime(const char *phase, double &phaseTime)
+{
+    double now = GetWallClockTime();
+
+    fprintf(stderr, "%-24s %8.3f sec\n", phase, now - phaseTime);
+    phaseTime = now;
+}
+
+int main(int argc, char *argv[])
+{
+    int    n_target_faces = -1, maxHistory = -1, clusterFaces = -1;
+    double ratio = -1.0, maxError = -1.0, memoryBudget = -1.0, weldEpsilon = -1.0;
+    char  *pmFilename = NULL, *logFilename = NULL, *inputFilename = NULL, *outputFilename = NULL;
+    char  *statsFilename = NULL, *traceFilename = NULL;
+    bool   isParallel = false, isDeterministic = true, isHistoryQuantized = false;
+
+    for(int i = 1; i < argc; i++){
+        if     (strcmp(argv[i], "-f")  == 0 && i+1 < argc) n_target_faces = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-r")  == 0 && i+1 < argc) ratio          = atof(argv[++i]);
+        else if(strcmp(argv[i], "-e")  == 0 && i+1 < argc) maxError       = atof(argv[++i]);
+        else if(strcmp(argv[i], "-p")  == 0) isParallel = true;
+        else if(strcmp(argv[i], "-pn") == 0) isParallel = true, isDeterministic = false;
+        else if(strcmp(argv[i], "-pm") == 0 && i+1 < argc) pmFilename     = argv[++i];
+        else if(strcmp(argv[i], "-h")  == 0 && i+1 < argc) maxHistory     = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-hq") == 0) isHistoryQuantized = true;
+        else if(strcmp(argv[i], "-log") == 0 && i+1 < argc) logFilename   = argv[++i];
+        else if(strcmp(argv[i], "-s")  == 0 && i+1 < argc) memoryBudget   = atof(argv[++i]) * 1024.0 * 1024.0;
+        else if(strcmp(argv[i], "-weld") == 0 && i+1 < argc) weldEpsilon  = atof(argv[++i]);
+        else if(strcmp(argv[i], "-cluster") == 0 && i+1 < argc) clusterFaces = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-stats") == 0 && i+1 < argc) statsFilename = argv[++i];
+        else if(strcmp(argv[i], "-trace") == 0 && i+1 < argc) traceFilename = argv[++i];
+        else if(inputFilename  == NULL) inputFilename  = argv[i];
+        else if(outputFilename == NULL) outputFilename = argv[i];
+        else{
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if(inputFilename == NULL || outputFilename == NULL || (n_target_faces < 0 && ratio < 0.0 && maxError < 0.0) ||
+       (memoryBudget >= 0.0 && (isParallel || pmFilename != NULL || logFilename != NULL || weldEpsilon >= 0.0 || clusterFaces >= 0))){
+        PrintUsage();
+        return 1;
+    }
+
+    if((statsFilename != NULL || traceFilename != NULL) && GetStats().isEnabled == false){
+        cerr << "built without MESH_ENABLE_STATS: the stats will be zeros\n";
+    }
+
+    if(memoryBudget >= 0.0){
+        StreamSimplification streamSimplification;
+
+        return streamSimplification.Simplify(inputFilename, outputFilename, n_target_faces, ratio, maxError, memoryBudget) ? 0 : 1;
+    }
+
+    double startTime = GetWallClockTime(), phaseTime = startTime;
+
+    Mesh mesh;
+    Simplification simplification;
+
+    mesh.weldEpsilon  = weldEpsilon;
+    mesh.clusterFaces = clusterFaces;
+
+    if( mesh.ConstructMeshDataStructure(inputFilename) == false ) return 1;
+    PrintPhaseTime("reading", phaseTime);
+
+    // the history is only needed to write it
+    if(pmFilename == NULL && logFilename == NULL) maxHistory = 0;
+
+    simplification.SetHistoryLimit(maxHistory, isHistoryQuantized);
+    simplification.DeferNormals(true);  // nothing reads them until the end
+    simplification.InitSimplification(&mesh);
+    PrintPhaseTime("initializing quadrics", phaseTime);
+
+    fprintf(stderr, "memory: mesh %.1f MB (%d-byte coordinates), simplification %.1f MB\n",
+            mesh.MemoryUsage() / 1048576.0, (int)sizeof(Real), simplification.MemoryUsage() / 1048576.0);
+
+    // the face target is the larger of "-f" and "-r". without either, only the error bounds the collapses.
+    // the ratio is of the faces before clustering
+    int n_faces_to_keep = 0, n_input_faces = mesh.n_faces + mesh.n_clusterRemovedFaces;
+    if(n_target_faces >= 0)          n_faces_to_keep = n_target_faces;
+    if(ratio >= 0.0 && ratio * n_input_faces > n_faces_to_keep) n_faces_to_keep = (int)(ratio * n_input_faces);
+
+    // quadric errors are measured in the normalized coordinates, scaled by "normalizationScale"
+    double maxCost = (maxError >= 0.0) ? maxError * mesh.normalizationScale * mesh.normalizationScale : DBL_MAX;
+
+    long long n_allocations = GetAllocationCount();
+
+    if(isParallel){
+        simplification.ParallelEdgeCollapse(n_faces_to_keep, maxCost, isDeterministic);
+    }else{
+        while(simplification.NumberOfActiveFaces() > n_faces_to_keep){
+            if(simplification.EdgeCollapse(maxCost) == false) break;
+        }
+    }
+
+    PrintPhaseTime("simplifying", phaseTime);
+
+    if(n_allocations >= 0) cerr << "allocations while simplifying: " << GetAllocationCount() - n_allocations << endl;
+
+    cerr << "# of faces " << mesh.n_faces << " -> " << simplification.NumberOfActiveFaces() << endl;
+
+    if(pmFilename != NULL || logFilename != NULL){
+        fprintf(stderr, "history: %d collapses kept, %d dropped, simplification %.1f MB\n", simplification.NumberOfRecordedCollapses(),
+                simplification.NumberOfDroppedCollapses(), simplification.MemoryUsage() / 1048576.0);
+    }
+
+    if( mesh.WriteMeshFile(outputFilename) == false ) return 1;
+    PrintPhaseTime("writing", phaseTime);
+
+    if(pmFilename != NULL){
+        if( simplification.WriteProgressiveMesh(pmFilename) == false ) return 1;
+        PrintPhaseTime("writing progressive mesh", phaseTime);
+    }
+
+    if(logFilename != NULL){
+        if( simplification.WriteCollapseLog(logFilename) == false ) return 1;
+        PrintPhaseTime("writing collapse log", phaseTime);
+    }
+
+    fprintf(stderr, "%-24s %8.3f sec\n", "total", GetWallClockTime() - startTime);
+
+    if(statsFilename != NULL && WriteStatsJSON(statsFilename)  == false) return 1;
+    if(traceFilename != NULL && WriteStatsTrace(traceFilename) == false) return 1;
+
+    return 0;
+}
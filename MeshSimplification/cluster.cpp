@@ -0,0 +1,340 @@
+#include "mesh.h"
+#include "parallel.h"
+#include "quadric.h"
+#include "stats.h"
+#include <cmath>
+#include <cstdio>
+
+// the cells along each axis are numbered with at most this many bits, so that the three numbers of a cell
+// make an exact key of 63 bits
+#define CLUSTER_AXIS_BITS 21
+
+// the cell size is refined until the number of occupied cells is within this fraction of the target
+#define CLUSTER_CELL_TOLERANCE 0.05
+#define CLUSTER_MAX_PASSES     4
+
+// cells handed to the quadric kernels at once
+#define CLUSTER_BLOCK_SIZE 256
+
+
+static int BitsFor(long long n)
+{
+    int bits = 1;
+    while(bits < 62 && (1LL << bits) < n) bits++;
+
+    return bits;
+}
+
+// the key of the cell of each vertex, and the vertices sorted by it. coordinates are normalized into [-1,1]
+static void ComputeCellKeys(const Real *coord, int n_vertices, double cellSize, int axisBits,
+                            vector<unsigned long long> &keys, vector<int> &sortedVertices)
+{
+    long long maxCell = (1LL << axisBits) - 1;
+
+    keys.resize(n_vertices);
+    sortedVertices.resize(n_vertices);
+
+    #pragma omp parallel for
+    for(int v = 0; v < n_vertices; v++){
+        unsigned long long key = 0;
+
+        for(int k = 0; k < 3; k++){
+            long long cell = (long long)floor((coord[3*v+k] + 1.0) / cellSize);
+            if(cell < 0)       cell = 0;
+            if(cell > maxCell) cell = maxCell;
+
+            key = (key << axisBits) | (unsigned long long)cell;
+        }
+
+        keys[v] = key;
+        sortedVertices[v] = v;
+    }
+
+    RadixSort(keys, sortedVertices, 3*axisBits);
+}
+
+// the plane of a face as a quadric, weighted by the area of the face
+static void AddFaceQuadric(const Real *a, const Real *b, const Real *c, double *q)
+{
+    double p0[3], edge1[3], edge2[3], normal[3];
+
+    for(int k = 0; k < 3; k++){
+        p0[k]    = a[k];
+        edge1[k] = (double)b[k] - a[k];
+        edge2[k] = (double)c[k] - a[k];
+    }
+
+    CrossProduct(edge1, edge2, normal);
+
+    double length = GetLength(normal);
+    if( !(length > 0.0) ) return;
+
+    double area = 0.5 * length;
+
+    for(int k = 0; k < 3; k++) normal[k] /= length;
+
+    double d = -DotProduct(normal, p0);
+    double plane[4] = { normal[0], normal[1], normal[2], d };
+
+    int i = 0;
+    for(int r = 0; r < 4; r++){
+        for(int s = r; s < 4; s++) q[i++] += area * plane[r] * plane[s];
+    }
+}
+
+// Faces of different cells often meet at a cell only by a vertex, or along an edge of more than two faces, which
+// the halfedge structure cannot hold: a vertex must have one fan of faces around it. Halfedges are paired as in
+// AddEdgeInfo (exactly two, in opposite directions), and each fan around a vertex after the first gets a copy
+// of the vertex. returns the number of copies
+static int SplitNonManifoldVertices(vector<int> &corner, int n_faces, vector<Real> &coord, int &n_vertices)
+{
+    int n_halfedges = 3*n_faces;
+
+    int vertexBits = 1;
+    while(vertexBits < 31 && (1 << vertexBits) < n_vertices) vertexBits++;
+
+    vector<unsigned long long> keys(n_halfedges);
+    vector<int>                sortedHalfEdges(n_halfedges);
+
+    #pragma omp parallel for
+    for(int he = 0; he < n_halfedges; he++){
+        unsigned long long a = corner[he];
+        unsigned long long b = corner[ NextHalfEdge(he) ];
+
+        keys[he] = (a < b) ? (a << vertexBits) | b : (b << vertexBits) | a;
+        sortedHalfEdges[he] = he;
+    }
+
+    RadixSort(keys, sortedHalfEdges, 2*vertexBits);
+
+    vector<int> mate(n_halfedges, NIL);
+
+    #pragma omp parallel for
+    for(int i = 0; i < n_halfedges; i++){
+        if(i > 0 && keys[i] == keys[i-1]) continue;
+        if(i+2 < n_halfedges && keys[i+2] == keys[i]) continue;
+        if(i+1 >= n_halfedges || keys[i+1] != keys[i]) continue;
+
+        int he0 = sortedHalfEdges[i];
+        int he1 = sortedHalfEdges[i+1];
+
+        if(corner[he0] != corner[he1]){
+            mate[he0] = he1;
+            mate[he1] = he0;
+        }
+    }
+
+    vector<unsigned long long>().swap(keys);
+    vector<int>().swap(sortedHalfEdges);
+
+    // fans are visited in the order of their first halfedge, so the copies are numbered the same on any number
+    // of threads
+    vector<char> isVisited(n_halfedges, false), isClaimed(n_vertices, false);
+    vector<int>  fan;
+    int n_original = n_vertices;
+
+    for(int he = 0; he < n_halfedges; he++){
+        if(isVisited[he]) continue;
+
+        int v = corner[he];
+
+        // around "v" one way until a boundary or back to "he", then from "he" the other way
+        fan.clear();
+
+        int hep = he;
+        do{
+            fan.push_back(hep);
+            isVisited[hep] = true;
+            hep = mate[ PrevHalfEdge(hep) ];
+        }while(hep != NIL && hep != he);
+
+        if(hep == NIL){
+            for(hep = mate[he]; hep != NIL; hep = mate[hep]){
+                hep = NextHalfEdge(hep);
+                fan.push_back(hep);
+                isVisited[hep] = true;
+            }
+        }
+
+        if(isClaimed[v] == false){
+            isClaimed[v] = true;
+            continue;
+        }
+
+        Real copy[3] = { coord[3*v], coord[3*v+1], coord[3*v+2] };
+
+        coord.insert(coord.end(), copy, copy + 3);
+        for(unsigned int i = 0; i < fan.size(); i++) corner[ fan[i] ] = n_vertices;
+        n_vertices++;
+    }
+
+    return n_vertices - n_original;
+}
+
+// Vertex clustering of Lindstrom (Out-of-core simplification of large polygonal models, 2000), to bring a dense
+// mesh down to about "clusterFaces" faces before the quadric simplification.
+// The bounding cube is divided into a uniform grid, and all the vertices in a cell become one vertex. A face
+// survives if its corners are in three different cells. The vertex of a cell is placed where the quadric of the
+// planes of its faces is the smallest, or at the mean of its vertices if that point is not unique or is outside
+// of the cell.
+// The cell size is found by counting the occupied cells for a guess and scaling it by the square root of the
+// ratio to the target, as for a surface; the faces are then about twice the cells. The quadrics are gathered per
+// cell from the corners sorted by cell rather than added by each face, so that the result does not depend on
+// the number of threads
+void Mesh::ClusterVertices()
+{
+    STAT_TIMER(PHASE_CLUSTER);
+
+    double startTime = GetWallClockTime();
+
+    int n_inputVertices = n_vertices, n_inputFaces = n_faces;
+
+    double targetCells = (clusterFaces / 2 > 4) ? clusterFaces / 2 : 4;
+    double minCellSize = 2.0 / (1 << CLUSTER_AXIS_BITS);
+    double cellSize    = 2.0 / sqrt(targetCells);
+
+    vector<unsigned long long> keys;
+    vector<int>                sortedVertices;
+    int n_cells = 0, axisBits = 0, pass;
+
+    for(pass = 1; ; pass++){
+        if(cellSize < minCellSize) cellSize = minCellSize;
+
+        axisBits = BitsFor((long long)ceil(2.0 / cellSize) + 1);
+        if(axisBits > CLUSTER_AXIS_BITS) axisBits = CLUSTER_AXIS_BITS;
+
+        ComputeCellKeys(&vertices.coord[0], n_vertices, cellSize, axisBits, keys, sortedVertices);
+
+        n_cells = 0;
+
+        #pragma omp parallel for reduction(+:n_cells)
+        for(int i = 0; i < n_vertices; i++){
+            if(i == 0 || keys[i] != keys[i-1]) n_cells++;
+        }
+
+        if(fabs(n_cells - targetCells) <= CLUSTER_CELL_TOLERANCE * targetCells || pass == CLUSTER_MAX_PASSES) break;
+
+        cellSize *= sqrt(n_cells / targetCells);
+    }
+
+    // cells are numbered in the order of their keys. "cellVertexBegin[c]" is where the vertices of "c" start
+    // in "sortedVertices"
+    vector<int> cellOfVertex(n_vertices), cellVertexBegin(n_cells + 1);
+
+    for(int i = 0, c = -1; i < n_vertices; i++){
+        if(i == 0 || keys[i] != keys[i-1]) cellVertexBegin[++c] = i;
+        cellOfVertex[ sortedVertices[i] ] = c;
+    }
+    cellVertexBegin[n_cells] = n_vertices;
+
+    vector<unsigned long long>().swap(keys);
+
+    /////////////////////////////////////////////////////////////////////////////
+    // the faces of each cell: the corners sorted by the cell of their vertex, stable, so in face order
+    /////////////////////////////////////////////////////////////////////////////
+    vector<int> &corner = halfedges.vertex;
+    int n_corners = 3*n_faces;
+
+    vector<unsigned long long> cornerKeys(n_corners);
+    vector<int>                cornerFaces(n_corners);
+
+    #pragma omp parallel for
+    for(int i = 0; i < n_corners; i++){
+        cornerKeys[i]  = cellOfVertex[ corner[i] ];
+        cornerFaces[i] = i / 3;
+    }
+
+    RadixSort(cornerKeys, cornerFaces, BitsFor(n_cells));
+
+    vector<int> cellCornerBegin(n_cells + 1, n_corners);
+
+    for(int i = n_corners - 1; i >= 0; i--) cellCornerBegin[ cornerKeys[i] ] = i;
+    for(int c = n_cells - 1; c >= 0; c--) if(cellCornerBegin[c] > cellCornerBegin[c+1]) cellCornerBegin[c] = cellCornerBegin[c+1];
+
+    vector<unsigned long long>().swap(cornerKeys);
+
+    /////////////////////////////////////////////////////////////////////////////
+    // one vertex per cell
+    /////////////////////////////////////////////////////////////////////////////
+    vector<Real> cellCoord(3*n_cells);
+    int n_blocks = (n_cells + CLUSTER_BLOCK_SIZE - 1) / CLUSTER_BLOCK_SIZE;
+
+    #pragma omp parallel for schedule(dynamic, 4)
+    for(int b = 0; b < n_blocks; b++){
+        double          q[QUADRIC_SIZE * CLUSTER_BLOCK_SIZE], optimal[3 * CLUSTER_BLOCK_SIZE], cost[CLUSTER_BLOCK_SIZE];
+        double          zero[QUADRIC_SIZE] = { 0.0 };
+        Real            mean[3 * CLUSTER_BLOCK_SIZE];
+        QuadricCollapse collapse[CLUSTER_BLOCK_SIZE];
+
+        int begin = b * CLUSTER_BLOCK_SIZE;
+        int n     = (n_cells - begin < CLUSTER_BLOCK_SIZE) ? n_cells - begin : CLUSTER_BLOCK_SIZE;
+
+        for(int i = 0; i < n; i++){
+            int c = begin + i;
+            double *qc = &q[QUADRIC_SIZE * i];
+            double sum[3] = { 0.0, 0.0, 0.0 };
+
+            for(int k = 0; k < QUADRIC_SIZE; k++) qc[k] = 0.0;
+
+            for(int j = cellCornerBegin[c]; j < cellCornerBegin[c+1]; j++){
+                int f = cornerFaces[j];
+                AddFaceQuadric(VertexCoord(corner[3*f]), VertexCoord(corner[3*f+1]), VertexCoord(corner[3*f+2]), qc);
+            }
+
+            for(int j = cellVertexBegin[c]; j < cellVertexBegin[c+1]; j++){
+                const Real *coord = VertexCoord(sortedVertices[j]);
+                for(int k = 0; k < 3; k++) sum[k] += coord[k];
+            }
+
+            int n_cellVertices = cellVertexBegin[c+1] - cellVertexBegin[c];
+            for(int k = 0; k < 3; k++) mean[3*i+k] = (Real)(sum[k] / n_cellVertices);
+
+            // the kernels minimize q0 + q1, and fall back to coord0, coord1 or their midpoint: here all the mean
+            collapse[i].q0     = qc;
+            collapse[i].q1     = zero;
+            collapse[i].coord0 = &mean[3*i];
+            collapse[i].coord1 = &mean[3*i];
+        }
+
+        ComputeQuadricCollapses(n, collapse, optimal, cost);
+
+        for(int i = 0; i < n; i++){
+            int c = begin + i;
+            const Real *first = VertexCoord(sortedVertices[ cellVertexBegin[c] ]);
+            bool isInside = true;
+
+            // the cell of the first vertex is the cell, with half a cell around it, as the quadric of a nearly
+            // flat cell puts the point anywhere along the plane
+            for(int k = 0; k < 3; k++){
+                double low = (floor((first[k] + 1.0) / cellSize) - 0.5) * cellSize - 1.0;
+
+                if( !(optimal[3*i+k] >= low && optimal[3*i+k] <= low + 2.0*cellSize) ) isInside = false;
+            }
+
+            for(int k = 0; k < 3; k++) cellCoord[3*c+k] = isInside ? (Real)optimal[3*i+k] : mean[3*i+k];
+        }
+    }
+
+    vector<int>().swap(cornerFaces);
+    vector<int>().swap(sortedVertices);
+
+    #pragma omp parallel for
+    for(int i = 0; i < n_corners; i++) corner[i] = cellOfVertex[ corner[i] ];
+
+    n_vertices = n_cells;
+    vertices.coord.swap(cellCoord);
+
+    int n_degenerate, n_duplicate;
+    RemoveDegenerateFaces(n_degenerate, n_duplicate);
+
+    int n_split = SplitNonManifoldVertices(corner, n_faces, vertices.coord, n_vertices);
+
+    n_clusterRemovedVertices = n_inputVertices - n_vertices;
+    n_clusterRemovedFaces    = n_inputFaces    - n_faces;
+
+    if(isVerbose){
+        fprintf(stderr, "clustering: %d -> %d vertices, %d -> %d faces (%d collapsed, %d duplicate), %d vertices split, cell %.3g in %d passes, %.3f sec\n",
+                n_inputVertices, n_vertices, n_inputFaces, n_faces, n_degenerate, n_duplicate, n_split, cellSize, pass,
+                GetWallClockTime() - startTime);
+    }
+}
@@ -1,5 +1,24 @@
 
 #include "mesh.h"
+#include "progressive.h"
+#include "render.h"
+#include <cstddef>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include <GL/glut.h>
+
+#ifndef _WIN32
+#include <GL/glx.h>
+#endif
+
+// the vertex data is "Real", float or double
+inline void glNormal3v(const GLfloat  *v){ glNormal3fv(v); }
+inline void glNormal3v(const GLdouble *v){ glNormal3dv(v); }
+inline void glVertex3v(const GLfloat  *v){ glVertex3fv(v); }
+inline void glVertex3v(const GLdouble *v){ glVertex3dv(v); }
 
 void Mesh::Display(int mode)
 {
@@ -11,32 +30,32 @@ void Mesh::Display(int mode)
 
         glEnable(GL_LIGHTING);
 
-        for(FaceIter fi = faces.begin(); fi != faces.end(); fi++){ 
+        for(int f = 0; f < n_faces; f++){ 
 
-            if(fi->isActive){
+            if(faces.isActive[f]){
                 glBegin(GL_TRIANGLES);
-                glNormal3dv(fi->halfedge[0].vertex->normal);
-                glVertex3dv(fi->halfedge[0].vertex->coord);
-                glNormal3dv(fi->halfedge[1].vertex->normal);
-                glVertex3dv(fi->halfedge[1].vertex->coord);
-                glNormal3dv(fi->halfedge[2].vertex->normal);
-                glVertex3dv(fi->halfedge[2].vertex->coord);
+                glNormal3v(VertexNormal(halfedges.vertex[3*f  ]));
+                glVertex3v(VertexCoord (halfedges.vertex[3*f  ]));
+                glNormal3v(VertexNormal(halfedges.vertex[3*f+1]));
+                glVertex3v(VertexCoord (halfedges.vertex[3*f+1]));
+                glNormal3v(VertexNormal(halfedges.vertex[3*f+2]));
+                glVertex3v(VertexCoord (halfedges.vertex[3*f+2]));
                 glEnd();
             }
         }
 
     }else if(mode == 1){
 
-        for(FaceIter fi = faces.begin(); fi != faces.end(); fi++){ 
+        for(int f = 0; f < n_faces; f++){ 
 
-            if(fi->isActive){
+            if(faces.isActive[f]){
                 glBegin(GL_TRIANGLES);
-                glNormal3dv(fi->halfedge[0].vertex->normal);
-                glVertex3dv(fi->halfedge[0].vertex->coord);
-                glNormal3dv(fi->halfedge[1].vertex->normal);
-                glVertex3dv(fi->halfedge[1].vertex->coord);
-                glNormal3dv(fi->halfedge[2].vertex->normal);
-                glVertex3dv(fi->halfedge[2].vertex->coord);
+                glNormal3v(VertexNormal(halfedges.vertex[3*f  ]));
+                glVertex3v(VertexCoord (halfedges.vertex[3*f  ]));
+                glNormal3v(VertexNormal(halfedges.vertex[3*f+1]));
+                glVertex3v(VertexCoord (halfedges.vertex[3*f+1]));
+                glNormal3v(VertexNormal(halfedges.vertex[3*f+2]));
+                glVertex3v(VertexCoord (halfedges.vertex[3*f+2]));
                 glEnd();
             }
         }
@@ -45,12 +64,12 @@ void Mesh::Display(int mode)
         glLineWidth(1.0);
         glColor3d(0, 0, 0);
 
-        for(FaceIter fi = faces.begin(); fi != faces.end(); fi++){ 
-            if(fi->isActive){
+        for(int f = 0; f < n_faces; f++){ 
+            if(faces.isActive[f]){
                 glBegin(GL_LINE_LOOP);
-                glVertex3dv(fi->halfedge[0].vertex->coord);
-                glVertex3dv(fi->halfedge[1].vertex->coord);
-                glVertex3dv(fi->halfedge[2].vertex->coord);
+                glVertex3v(VertexCoord(halfedges.vertex[3*f  ]));
+                glVertex3v(VertexCoord(halfedges.vertex[3*f+1]));
+                glVertex3v(VertexCoord(halfedges.vertex[3*f+2]));
                 glEnd();
             }
         }
@@ -59,3 +78,175 @@ void Mesh::Display(int mode)
 
 
 }
+
+
+void ProgressiveMesh::Display(int mode)
+{
+    glEnable(GL_LIGHTING);
+    glEnable( GL_POLYGON_OFFSET_FILL ); 
+    glPolygonOffset(1.0, 1.0);
+
+    glBegin(GL_TRIANGLES);
+    for(int i = 0; i < 3*n_faces; i++){
+        glNormal3fv(&normal[3*corner[i]]);
+        glVertex3fv(&coord [3*corner[i]]);
+    }
+    glEnd();
+
+    if(mode == 1){
+        glDisable(GL_LIGHTING);
+        glLineWidth(1.0);
+        glColor3d(0, 0, 0);
+
+        for(int f = 0; f < n_faces; f++){
+            glBegin(GL_LINE_LOOP);
+            glVertex3fv(&coord[3*corner[3*f  ]]);
+            glVertex3fv(&coord[3*corner[3*f+1]]);
+            glVertex3fv(&coord[3*corner[3*f+2]]);
+            glEnd();
+        }
+    }
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// RenderBuffer
+/////////////////////////////////////////////////////////////////////////////
+
+// buffer objects are OpenGL 1.5, and the headers of Windows stop at 1.1, so they are looked up at run time.
+// without them the arrays are drawn from memory
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+#ifndef GL_ARRAY_BUFFER
+#define GL_ARRAY_BUFFER         0x8892
+#define GL_ELEMENT_ARRAY_BUFFER 0x8893
+#define GL_DYNAMIC_DRAW         0x88E8
+#endif
+
+typedef void (APIENTRY *GenBuffersFunction)(GLsizei n, GLuint *buffers);
+typedef void (APIENTRY *BindBufferFunction)(GLenum target, GLuint buffer);
+typedef void (APIENTRY *BufferDataFunction)(GLenum target, ptrdiff_t size, const void *data, GLenum usage);
+typedef void (APIENTRY *BufferSubDataFunction)(GLenum target, ptrdiff_t offset, ptrdiff_t size, const void *data);
+
+static GenBuffersFunction    genBuffers    = NULL;
+static BindBufferFunction    bindBuffer    = NULL;
+static BufferDataFunction    bufferData    = NULL;
+static BufferSubDataFunction bufferSubData = NULL;
+
+static void *GetGLFunction(const char *name)
+{
+#ifdef _WIN32
+    return (void*)wglGetProcAddress(name);
+#else
+    return (void*)glXGetProcAddress((const GLubyte*)name);
+#endif
+}
+
+static bool HasBufferObjects()
+{
+    static int isLoaded = -1;
+
+    if(isLoaded == -1){
+        genBuffers    = (GenBuffersFunction)   GetGLFunction("glGenBuffers");
+        bindBuffer    = (BindBufferFunction)   GetGLFunction("glBindBuffer");
+        bufferData    = (BufferDataFunction)   GetGLFunction("glBufferData");
+        bufferSubData = (BufferSubDataFunction)GetGLFunction("glBufferSubData");
+
+        isLoaded = (genBuffers != NULL && bindBuffer != NULL && bufferData != NULL && bufferSubData != NULL);
+    }
+
+    return isLoaded == 1;
+}
+
+
+// one call per range, or one for all of them if they are many: a call costs about as much as some
+// kilobytes of data
+#define MAX_UPLOAD_CALLS 64
+
+static void UploadRanges(GLenum target, const vector<BufferRange> &ranges, const char *data, int elementBytes)
+{
+    if(ranges.empty()) return;
+
+    if(ranges.size() > MAX_UPLOAD_CALLS){
+        int begin = ranges.front().begin, end = ranges.back().end;
+
+        bufferSubData(target, (ptrdiff_t)begin*elementBytes, (ptrdiff_t)(end - begin)*elementBytes, data + (ptrdiff_t)begin*elementBytes);
+        return;
+    }
+
+    for(unsigned int i = 0; i < ranges.size(); i++){
+        int begin = ranges[i].begin, end = ranges[i].end;
+
+        bufferSubData(target, (ptrdiff_t)begin*elementBytes, (ptrdiff_t)(end - begin)*elementBytes, data + (ptrdiff_t)begin*elementBytes);
+    }
+}
+
+
+void RenderBuffer::Display(int mode)
+{
+    const char *vertexBase = (const char*)&vertices[0];
+    const char *indexBase  = indices.empty() ? NULL : (const char*)&indices[0];
+
+    if(HasBufferObjects()){
+        if(vertexBufferId == 0){
+            GLuint id[2];
+            genBuffers(2, id);
+            vertexBufferId = id[0];
+            indexBufferId  = id[1];
+        }
+
+        bindBuffer(GL_ARRAY_BUFFER,         vertexBufferId);
+        bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferId);
+
+        if(isUploaded == false){
+            // room for every face, so that the triangles appended later fit
+            bufferData(GL_ARRAY_BUFFER, vertices.size()*sizeof(float), &vertices[0], GL_DYNAMIC_DRAW);
+            bufferData(GL_ELEMENT_ARRAY_BUFFER, 3*MaxNumberOfTriangles()*sizeof(unsigned int), NULL, GL_DYNAMIC_DRAW);
+            if(indices.empty() == false) bufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, indices.size()*sizeof(unsigned int), &indices[0]);
+
+            isUploaded = true;
+        }else{
+            UploadRanges(GL_ARRAY_BUFFER,         DirtyVertexRanges(),   (const char*)&vertices[0], 6*sizeof(float));
+            UploadRanges(GL_ELEMENT_ARRAY_BUFFER, DirtyTriangleRanges(), indexBase,                 3*sizeof(unsigned int));
+        }
+
+        // offsets into the buffer objects
+        vertexBase = NULL;
+        indexBase  = NULL;
+    }
+
+    ClearDirtyRanges();
+
+    // the normals of a blended geomorph are not of unit length
+    glEnable(GL_NORMALIZE);
+    glEnable(GL_LIGHTING);
+    glEnable( GL_POLYGON_OFFSET_FILL ); 
+    glPolygonOffset(1.0, 1.0);
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glVertexPointer(3, GL_FLOAT, 6*sizeof(float), vertexBase);
+    glNormalPointer(   GL_FLOAT, 6*sizeof(float), vertexBase + 3*sizeof(float));
+
+    glDrawElements(GL_TRIANGLES, (GLsizei)indices.size(), GL_UNSIGNED_INT, indexBase);
+
+    if(mode == 1){
+        glDisable(GL_LIGHTING);
+        glLineWidth(1.0);
+        glColor3d(0, 0, 0);
+
+        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+        glDrawElements(GL_TRIANGLES, (GLsizei)indices.size(), GL_UNSIGNED_INT, indexBase);
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    }
+
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+
+    if(HasBufferObjects()){
+        bindBuffer(GL_ARRAY_BUFFER,         0);
+        bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
+}
@@ -0,0 +1,236 @@
+#include "fileio.h"
+#include <cstdio>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+
+MappedFile::MappedFile()
+{
+    mapping = NULL;
+    buffer  = NULL;
+    data    = NULL;
+    size    = 0;
+
+#ifdef _WIN32
+    fileHandle = mappingHandle = NULL;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+bool MappedFile::Open(const char *filename)
+{
+    Close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if(file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(file, &fileSize);
+    size = (size_t)fileSize.QuadPart;
+    fileHandle = file;
+
+    if(size == 0){
+        data = "";
+        return true;
+    }
+
+    mappingHandle = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(mappingHandle != NULL) mapping = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+#else
+    int fd = open(filename, O_RDONLY);
+    if(fd < 0) return false;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0){
+        close(fd);
+        return false;
+    }
+    size = (size_t)st.st_size;
+
+    if(size == 0){
+        close(fd);
+        data = "";
+        return true;
+    }
+
+    mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(mapping == MAP_FAILED) mapping = NULL;
+    else                      madvise(mapping, size, MADV_SEQUENTIAL);
+
+    close(fd);
+#endif
+
+    if(mapping != NULL){
+        data = (const char*)mapping;
+        return true;
+    }
+
+    // mapping failed. read the whole file instead
+    FILE *fp = fopen(filename, "rb");
+    if(fp == NULL) return false;
+
+    buffer = (char*)malloc(size);
+    if(buffer == NULL || fread(buffer, 1, size, fp) != size){
+        fclose(fp);
+        Close();
+        return false;
+    }
+    fclose(fp);
+
+    data = buffer;
+    return true;
+}
+
+void MappedFile::Close()
+{
+#ifdef _WIN32
+    if(mapping       != NULL) UnmapViewOfFile(mapping);
+    if(mappingHandle != NULL) CloseHandle((HANDLE)mappingHandle);
+    if(fileHandle    != NULL) CloseHandle((HANDLE)fileHandle);
+    fileHandle = mappingHandle = NULL;
+#else
+    if(mapping != NULL) munmap(mapping, size);
+#endif
+
+    if(buffer != NULL) free(buffer);
+
+    mapping = NULL;
+    buffer  = NULL;
+    data    = NULL;
+    size    = 0;
+}
+
+
+ScratchFile::ScratchFile()
+{
+    mapping = NULL;
+    data    = NULL;
+    size    = 0;
+
+#ifdef _WIN32
+    fileHandle = mappingHandle = NULL;
+#endif
+}
+
+ScratchFile::~ScratchFile()
+{
+    Close();
+}
+
+bool ScratchFile::Create(const char *filename, size_t size_in)
+{
+    Close();
+
+    if(size_in == 0) return true;
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                              FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+    if(file == INVALID_HANDLE_VALUE) return false;
+    fileHandle = file;
+
+    unsigned long long n = size_in;
+    mappingHandle = CreateFileMappingA(file, NULL, PAGE_READWRITE, (DWORD)(n >> 32), (DWORD)(n & 0xffffffffULL), NULL);
+    if(mappingHandle != NULL) mapping = MapViewOfFile(mappingHandle, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+#else
+    int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if(fd < 0) return false;
+
+    if(ftruncate(fd, (off_t)size_in) == 0){
+        mapping = mmap(NULL, size_in, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if(mapping == MAP_FAILED) mapping = NULL;
+    }
+
+    // the mapping keeps the data, the name is not needed any more
+    close(fd);
+    unlink(filename);
+#endif
+
+    if(mapping == NULL){
+        Close();
+        return false;
+    }
+
+    data = (char*)mapping;
+    size = size_in;
+    return true;
+}
+
+void ScratchFile::Close()
+{
+#ifdef _WIN32
+    if(mapping       != NULL) UnmapViewOfFile(mapping);
+    if(mappingHandle != NULL) CloseHandle((HANDLE)mappingHandle);
+    if(fileHandle    != NULL) CloseHandle((HANDLE)fileHandle);
+    fileHandle = mappingHandle = NULL;
+#else
+    if(mapping != NULL) munmap(mapping, size);
+#endif
+
+    mapping = NULL;
+    data    = NULL;
+    size    = 0;
+}
+
+
+void SplitIntoLineChunks(const char *begin, const char *end, int n_chunks, std::vector<const char*> &chunkBegin)
+{
+    if((end - begin) / n_chunks < 65536) n_chunks = (int)((end - begin) / 65536) + 1;
+
+    chunkBegin.resize(n_chunks+1);
+
+    chunkBegin[0]        = begin;
+    chunkBegin[n_chunks] = end;
+
+    for(int c = 1; c < n_chunks; c++){
+        const char *b = begin + (end - begin) * c / n_chunks;
+
+        b = SkipLine(b-1, end); // stays at "b" if it is already the first character of a line
+        if(b < chunkBegin[c-1]) b = chunkBegin[c-1];
+
+        chunkBegin[c] = b;
+    }
+}
+
+
+bool ParseOFFHeader(const char *&p, const char *end, int &n_vertices, int &n_faces)
+{
+    while(p < end && IsBlankOrComment(p, end)) p = SkipLine(p, end);
+
+    const char *keyword = SkipSpaces(p, end), *q = keyword;
+    while(q < end && ((*q >= 'A' && *q <= 'Z') || (*q >= 'a' && *q <= 'z'))) q++;
+
+    if(q > keyword){
+        if(q - keyword < 3 || strncmp(q-3, "OFF", 3) != 0){
+            fprintf(stderr, "not an OFF file.\n");
+            return false;
+        }
+
+        if(IsBlankOrComment(q, end)){
+            p = SkipLine(q, end);
+            while(p < end && IsBlankOrComment(p, end)) p = SkipLine(p, end);
+            q = p;
+        }
+    }
+
+    if( ParseInt(q, end, n_vertices) == false || ParseInt(q, end, n_faces) == false ||
+        n_vertices < 0 || n_faces < 0 ){
+        fprintf(stderr, "the numbers of vertices and faces cannot be read.\n");
+        return false;
+    }
+
+    p = SkipLine(q, end);
+    return true;
+}
@@ -0,0 +1,211 @@
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+
+// read-only view of a whole file. the file is memory-mapped, or read into memory if mapping fails.
+// the contents are not null-terminated, every parser below is bounded by an "end" pointer
+class MappedFile {
+    void  *mapping;
+    char  *buffer;
+
+#ifdef _WIN32
+    void  *fileHandle, *mappingHandle;
+#endif
+
+public:
+    const char *data;
+    size_t      size;
+
+    MappedFile();
+    ~MappedFile();
+
+    bool Open(const char *filename);
+    void Close();
+};
+
+
+// read-write memory-mapped file of a fixed size, for working data that may not fit in memory.
+// the file is removed when it is closed (on POSIX, as soon as it is mapped)
+class ScratchFile {
+    void  *mapping;
+
+#ifdef _WIN32
+    void  *fileHandle, *mappingHandle;
+#endif
+
+public:
+    char   *data;
+    size_t  size;
+
+    ScratchFile();
+    ~ScratchFile();
+
+    bool Create(const char *filename, size_t size_in);
+    void Close();
+};
+
+
+// case-insensitive comparison of a file extension such as ".ply"
+inline bool HasExtension(const char *extension, const char *expected)
+{
+    for(; *extension != '\0' && *expected != '\0'; extension++, expected++){
+        char c = *extension;
+        if(c >= 'A' && c <= 'Z') c += 'a' - 'A';
+        if(c != *expected) return false;
+    }
+    return *extension == *expected;
+}
+
+// split [begin, end) into at most "n_chunks" pieces, each starting at the beginning of a line.
+// chunk c is [chunkBegin[c], chunkBegin[c+1]). chunks are at least 64KB so that small files are not over-split
+extern void SplitIntoLineChunks(const char *begin, const char *end, int n_chunks, std::vector<const char*> &chunkBegin);
+
+
+///////////////////////////////////////////////////////////////
+// text parsing on [p, end)
+///////////////////////////////////////////////////////////////
+
+inline bool IsSpace(char c){ return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f'; }
+
+// skip spaces and tabs, but not the end of the line
+inline const char* SkipSpaces(const char *p, const char *end)
+{
+    while(p < end && IsSpace(*p)) p++;
+    return p;
+}
+
+// move to the first character of the next line
+inline const char* SkipLine(const char *p, const char *end)
+{
+    const char *q = (const char*)memchr(p, '\n', end - p);
+    return (q == NULL) ? end : q + 1;
+}
+
+// true if nothing but spaces or a '#' comment is left on the line
+inline bool IsBlankOrComment(const char *p, const char *end)
+{
+    p = SkipSpaces(p, end);
+    return p == end || *p == '\n' || *p == '#';
+}
+
+// true at the end of the text, of the line, or before a space: where a number must end
+inline bool IsDelimiter(const char *p, const char *end){ return p == end || *p == '\n' || IsSpace(*p); }
+
+inline bool ParseInt(const char *&p, const char *end, int &value)
+{
+    const char *q = SkipSpaces(p, end);
+
+    bool negative = false;
+    if(q < end && (*q == '-' || *q == '+')){ negative = (*q == '-'); q++; }
+
+    if(q == end || *q < '0' || *q > '9') return false;
+
+    // a number that does not fit in an int is an error, not a wrapped count
+    long long n = 0;
+    while(q < end && *q >= '0' && *q <= '9'){
+        n = n*10 + (*q - '0');
+        if(n > INT_MAX) return false;
+        q++;
+    }
+
+    value = (int)(negative ? -n : n);
+    p = q;
+    return true;
+}
+
+// exact powers of ten are exactly representable as double up to 1e22
+static const double exactPowerOf10[23] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Decimal numbers with at most 15 significant digits and a small exponent are converted with a single
+// multiplication or division of two exact doubles, which is correctly rounded, i.e. the same result as strtod.
+// Anything else (long mantissas, large exponents, "inf", "nan") falls back to strtod.
+// The number must be followed by a space or the end of the line: "1.5abc" is an error, not 1.5
+inline bool ParseDouble(const char *&p, const char *end, double &value)
+{
+    const char *q = SkipSpaces(p, end);
+    const char *start = q;
+
+    bool negative = false;
+    if(q < end && (*q == '-' || *q == '+')){ negative = (*q == '-'); q++; }
+
+    unsigned long long mantissa = 0;
+    int  n_digits = 0, exponent = 0;
+    bool hasDigits = false;
+
+    while(q < end && *q == '0'){ q++; hasDigits = true; } // leading zeros are not significant
+
+    while(q < end && *q >= '0' && *q <= '9'){
+        if(n_digits < 19){ mantissa = mantissa*10 + (*q - '0'); n_digits++; }
+        else             exponent++;
+        q++;
+        hasDigits = true;
+    }
+
+    if(q < end && *q == '.'){
+        q++;
+        if(n_digits == 0) while(q < end && *q == '0'){ q++; exponent--; hasDigits = true; }
+
+        while(q < end && *q >= '0' && *q <= '9'){
+            if(n_digits < 19){ mantissa = mantissa*10 + (*q - '0'); n_digits++; exponent--; }
+            q++;
+            hasDigits = true;
+        }
+    }
+
+    if(hasDigits == false){
+        // not a plain decimal number (e.g. "inf" or "nan")
+        char buf[64];
+        int  length = 0;
+        while(start + length < end && length < 63 && IsSpace(start[length]) == false && start[length] != '\n'){
+            buf[length] = start[length];
+            length++;
+        }
+        buf[length] = '\0';
+
+        char *parsedEnd;
+        value = strtod(buf, &parsedEnd);
+        if(parsedEnd == buf || IsDelimiter(start + (parsedEnd - buf), end) == false) return false;
+
+        p = start + (parsedEnd - buf);
+        return true;
+    }
+
+    if(q < end && (*q == 'e' || *q == 'E')){
+        const char *r = q + 1;
+        int exponentPart;
+
+        if(r < end && IsSpace(*r) == false && ParseInt(r, end, exponentPart)){
+            exponent += exponentPart;
+            q = r;
+        }
+    }
+
+    if(IsDelimiter(q, end) == false) return false;
+
+    if(n_digits <= 15 && exponent >= -22 && exponent <= 22){
+        value = (double)mantissa;
+        if(exponent < 0) value /= exactPowerOf10[-exponent];
+        else             value *= exactPowerOf10[ exponent];
+        if(negative) value = -value;
+    }else{
+        char buf[128];
+        int  length = (int)(q - start);
+        if(length > 127) length = 127;
+        memcpy(buf, start, length);
+        buf[length] = '\0';
+
+        value = strtod(buf, NULL);
+    }
+
+    p = q;
+    return true;
+}
+
+// "OFF" (possibly with a prefix such as "C" or "N") and the numbers of vertices and faces, either on the same
+// line or on the next one. "p" is moved to the line after the numbers
+extern bool ParseOFFHeader(const char *&p, const char *end, int &n_vertices, int &n_faces);
@@ -0,0 +1,741 @@
+#include "mesh.h"
+#include "parallel.h"
+#include "fileio.h"
+#include <cstdio>
+#include <string>
+#include <sstream>
+
+
+/////////////////////////////////////////////////////////////////////////////
+// PLY
+/////////////////////////////////////////////////////////////////////////////
+
+enum PLYType { PLY_CHAR, PLY_UCHAR, PLY_SHORT, PLY_USHORT, PLY_INT, PLY_UINT, PLY_FLOAT, PLY_DOUBLE, PLY_UNKNOWN };
+
+struct PLYProperty {
+    string name;
+    int    type;
+    int    countType;  // type of the element count if "isList"
+    bool   isList;
+};
+
+struct PLYElement {
+    string name;
+    int    count;
+    vector<PLYProperty> properties;
+};
+
+static int GetPLYType(const string &name)
+{
+    if(name == "char"   || name == "int8"   ) return PLY_CHAR;
+    if(name == "uchar"  || name == "uint8"  ) return PLY_UCHAR;
+    if(name == "short"  || name == "int16"  ) return PLY_SHORT;
+    if(name == "ushort" || name == "uint16" ) return PLY_USHORT;
+    if(name == "int"    || name == "int32"  ) return PLY_INT;
+    if(name == "uint"   || name == "uint32" ) return PLY_UINT;
+    if(name == "float"  || name == "float32") return PLY_FLOAT;
+    if(name == "double" || name == "float64") return PLY_DOUBLE;
+    return PLY_UNKNOWN;
+}
+
+static int GetPLYTypeSize(int type)
+{
+    static const int size[] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+    return size[type];
+}
+
+// read a binary value of "type" at "p". "swapBytes" is true if the file and the machine differ in endianness
+static double ReadPLYValue(const char *p, int type, bool swapBytes)
+{
+    unsigned char bytes[8];
+    int size = GetPLYTypeSize(type);
+
+    for(int i = 0; i < size; i++) bytes[i] = p[swapBytes ? size-1-i : i];
+
+    switch(type){
+    case PLY_CHAR:   return *(signed char*)bytes;
+    case PLY_UCHAR:  return *(unsigned char*)bytes;
+    case PLY_SHORT:  { short          v; memcpy(&v, bytes, 2); return v; }
+    case PLY_USHORT: { unsigned short v; memcpy(&v, bytes, 2); return v; }
+    case PLY_INT:    { int            v; memcpy(&v, bytes, 4); return v; }
+    case PLY_UINT:   { unsigned int   v; memcpy(&v, bytes, 4); return v; }
+    case PLY_FLOAT:  { float          v; memcpy(&v, bytes, 4); return v; }
+    default:         { double         v; memcpy(&v, bytes, 8); return v; }
+    }
+}
+
+// size in bytes of one binary record of "element" starting at "p", or -1 if it exceeds "end",
+// -2 if a list has a negative count
+static long long GetPLYRecordSize(const PLYElement &element, const char *p, const char *end, bool swapBytes)
+{
+    long long size = 0;
+
+    for(unsigned int i = 0; i < element.properties.size(); i++){
+        const PLYProperty &property = element.properties[i];
+
+        if(property.isList){
+            if(p + size + GetPLYTypeSize(property.countType) > end) return -1;
+
+            int count = (int)ReadPLYValue(p + size, property.countType, swapBytes);
+            if(count < 0) return -2;
+
+            size += GetPLYTypeSize(property.countType) + (long long)count * GetPLYTypeSize(property.type);
+        }else{
+            size += GetPLYTypeSize(property.type);
+        }
+    }
+
+    return (p + size > end) ? -1 : size;
+}
+
+// index of the property with one of the given names, or -1
+static int FindPLYProperty(const PLYElement &element, const char *name0, const char *name1)
+{
+    for(unsigned int i = 0; i < element.properties.size(); i++){
+        if(element.properties[i].name == name0 || element.properties[i].name == name1) return i;
+    }
+    return -1;
+}
+
+
+bool Mesh::ReadPLYFile(char *filename)
+{
+    double startTime = GetWallClockTime();
+
+    MappedFile file;
+
+    if( file.Open(filename) == false ){
+        cerr << "file cannot be read.\n";
+        return false;
+    }
+
+    const char *p   = file.data;
+    const char *end = file.data + file.size;
+
+    /////////////////////////////////////////////////////////////////////////////
+    // header
+    /////////////////////////////////////////////////////////////////////////////
+    enum { ASCII, BINARY_LITTLE_ENDIAN, BINARY_BIG_ENDIAN } format = ASCII;
+
+    vector<PLYElement> elements;
+    bool isHeaderComplete = false;
+
+    for(int lineNumber = 0; p < end; lineNumber++){
+        const char *lineEnd = SkipLine(p, end);
+
+        istringstream line(string(p, lineEnd));
+        string keyword;
+        line >> keyword;
+
+        p = lineEnd;
+
+        if(lineNumber == 0){
+            if(keyword != "ply"){
+                cerr << "not a PLY file.\n";
+                return false;
+            }
+        }else if(keyword == "format"){
+            string name;
+            line >> name;
+
+            if     (name == "ascii")                format = ASCII;
+            else if(name == "binary_little_endian") format = BINARY_LITTLE_ENDIAN;
+            else if(name == "binary_big_endian")    format = BINARY_BIG_ENDIAN;
+            else{
+                cerr << "unknown PLY format " << name << endl;
+                return false;
+            }
+        }else if(keyword == "element"){
+            PLYElement element;
+            line >> element.name >> element.count;
+            elements.push_back(element);
+        }else if(keyword == "property" && elements.empty() == false){
+            PLYProperty property;
+            string type;
+            line >> type;
+
+            property.isList = (type == "list");
+
+            if(property.isList){
+                string countType;
+                line >> countType >> type;
+                property.countType = GetPLYType(countType);
+            }
+
+            property.type = GetPLYType(type);
+            line >> property.name;
+
+            if(property.type == PLY_UNKNOWN || (property.isList && property.countType == PLY_UNKNOWN)){
+                cerr << "unknown PLY property type " << type << endl;
+                return false;
+            }
+
+            elements.back().properties.push_back(property);
+        }else if(keyword == "end_header"){
+            isHeaderComplete = true;
+            break;
+        }
+    }
+
+    if(isHeaderComplete == false){
+        cerr << "PLY header is incomplete.\n";
+        return false;
+    }
+
+    // check the byte order of this machine
+    unsigned int one = 1;
+    bool isLittleEndianMachine = (*(unsigned char*)&one == 1);
+    bool swapBytes = (format == BINARY_LITTLE_ENDIAN && isLittleEndianMachine == false) ||
+                     (format == BINARY_BIG_ENDIAN    && isLittleEndianMachine);
+
+    n_vertices = n_faces = 0;
+    bool hasFaces = false;
+
+    /////////////////////////////////////////////////////////////////////////////
+    // elements
+    /////////////////////////////////////////////////////////////////////////////
+    for(unsigned int k = 0; k < elements.size(); k++){
+        const PLYElement &element = elements[k];
+
+        bool isVertex = (element.name == "vertex");
+        bool isFace   = (element.name == "face");
+
+        int xIndex = -1, yIndex = -1, zIndex = -1, listIndex = -1;
+
+        if(isVertex){
+            xIndex = FindPLYProperty(element, "x", "x");
+            yIndex = FindPLYProperty(element, "y", "y");
+            zIndex = FindPLYProperty(element, "z", "z");
+
+            if(xIndex < 0 || yIndex < 0 || zIndex < 0){
+                cerr << "PLY vertex has no x, y or z.\n";
+                return false;
+            }
+
+            n_vertices = element.count;
+            vertices.coord.resize(3*n_vertices);
+        }
+
+        if(isFace){
+            listIndex = FindPLYProperty(element, "vertex_indices", "vertex_index");
+
+            if(listIndex < 0 || element.properties[listIndex].isList == false){
+                cerr << "PLY face has no vertex_indices.\n";
+                return false;
+            }
+
+            hasFaces = true;
+        }
+
+        /////////////////////////////////////////////////////////////////////////////
+        // ascii: one record per line
+        /////////////////////////////////////////////////////////////////////////////
+        if(format == ASCII){
+            vector<double> values;
+
+            for(int r = 0; r < element.count; r++){
+                while(p < end && IsBlankOrComment(p, end)) p = SkipLine(p, end);
+
+                if(p == end){
+                    cerr << "unexpected end of file.\n";
+                    return false;
+                }
+
+                const char *q = p;
+                p = SkipLine(p, end);
+
+                if(isVertex == false && isFace == false) continue;
+
+                // read every value of the line. for the face, the values of the list follow its count
+                int listStart = -1, listCount = 0;
+                values.clear();
+
+                for(unsigned int i = 0; i < element.properties.size(); i++){
+                    double value;
+
+                    if(element.properties[i].isList){
+                        if(ParseDouble(q, p, value) == false) break;
+
+                        if((int)i == listIndex){
+                            listStart = (int)values.size();
+                            listCount = (int)value;
+                        }
+
+                        for(int j = (int)value; j > 0; j--){
+                            double item;
+                            if(ParseDouble(q, p, item) == false) break;
+                            values.push_back(item);
+                        }
+                    }else{
+                        if(ParseDouble(q, p, value) == false) break;
+                        values.push_back(value);
+                    }
+                }
+
+                if(isVertex){
+                    if((int)values.size() < (int)element.properties.size()){
+                        cerr << "vertex " << r << " cannot be read.\n";
+                        return false;
+                    }
+
+                    vertices.coord[3*r  ] = (Real)values[xIndex];
+                    vertices.coord[3*r+1] = (Real)values[yIndex];
+                    vertices.coord[3*r+2] = (Real)values[zIndex];
+                }else{
+                    if(listStart < 0 || listStart + listCount > (int)values.size()){
+                        cerr << "face " << r << " cannot be read.\n";
+                        return false;
+                    }
+
+                    // triangulate as a fan
+                    for(int j = 2; j < listCount; j++){
+                        halfedges.vertex.push_back((int)values[listStart]);
+                        halfedges.vertex.push_back((int)values[listStart+j-1]);
+                        halfedges.vertex.push_back((int)values[listStart+j]);
+                    }
+                }
+            }
+
+            continue;
+        }
+
+        /////////////////////////////////////////////////////////////////////////////
+        // binary
+        /////////////////////////////////////////////////////////////////////////////
+
+        // records of fixed size, i.e. without lists, are copied in parallel
+        bool hasList = false;
+        int  recordSize = 0;
+        int  offset[3] = { 0, 0, 0 };
+
+        for(unsigned int i = 0; i < element.properties.size(); i++){
+            if(element.properties[i].isList) hasList = true;
+            else{
+                if((int)i == xIndex) offset[0] = recordSize;
+                if((int)i == yIndex) offset[1] = recordSize;
+                if((int)i == zIndex) offset[2] = recordSize;
+                recordSize += GetPLYTypeSize(element.properties[i].type);
+            }
+        }
+
+        if(isVertex && hasList == false){
+            if(p + (long long)recordSize * element.count > end){
+                cerr << "unexpected end of file.\n";
+                return false;
+            }
+
+            int type[3] = { element.properties[xIndex].type, element.properties[yIndex].type, element.properties[zIndex].type };
+
+            const char *base = p;
+
+            #pragma omp parallel for
+            for(int v = 0; v < n_vertices; v++){
+                const char *record = base + (long long)recordSize * v;
+                Real       *coord  = VertexCoord(v);
+
+                if(type[0] == PLY_FLOAT && type[1] == PLY_FLOAT && type[2] == PLY_FLOAT && swapBytes == false){
+                    float xyz[3];
+                    memcpy(&xyz[0], record + offset[0], 4);
+                    memcpy(&xyz[1], record + offset[1], 4);
+                    memcpy(&xyz[2], record + offset[2], 4);
+
+                    coord[0] = xyz[0];  coord[1] = xyz[1];  coord[2] = xyz[2];
+                }else{
+                    for(int i = 0; i < 3; i++) coord[i] = (Real)ReadPLYValue(record + offset[i], type[i], swapBytes);
+                }
+            }
+
+            p += (long long)recordSize * element.count;
+            continue;
+        }
+
+        if(isFace && element.properties.size() == 1){
+            // if every face is a triangle, the records have a fixed size and are copied in parallel
+            const PLYProperty &list = element.properties[listIndex];
+
+            int countSize = GetPLYTypeSize(list.countType);
+            int indexSize = GetPLYTypeSize(list.type);
+            int triangleRecordSize = countSize + 3*indexSize;
+
+            if(p + (long long)triangleRecordSize * element.count <= end){
+                const char *base = p;
+                int n_non_triangles = 0;
+
+                n_faces = element.count;
+                halfedges.vertex.resize(3*n_faces);
+
+                #pragma omp parallel for reduction(+:n_non_triangles)
+                for(int f = 0; f < n_faces; f++){
+                    const char *record = base + (long long)triangleRecordSize * f;
+
+                    if((int)ReadPLYValue(record, list.countType, swapBytes) != 3){
+                        n_non_triangles++;
+                        continue;
+                    }
+
+                    int *v_id = &halfedges.vertex[3*f];
+
+                    if(indexSize == 4 && swapBytes == false){
+                        memcpy(v_id, record + countSize, 12);
+                    }else{
+                        for(int i = 0; i < 3; i++) v_id[i] = (int)ReadPLYValue(record + countSize + i*indexSize, list.type, swapBytes);
+                    }
+                }
+
+                if(n_non_triangles == 0){
+                    p += (long long)triangleRecordSize * element.count;
+                    continue;
+                }
+
+                // some face is not a triangle. read them one by one
+                n_faces = 0;
+                halfedges.vertex.clear();
+            }
+        }
+
+        // general case: records of variable size are walked one by one
+        for(int r = 0; r < element.count; r++){
+            long long size = GetPLYRecordSize(element, p, end, swapBytes);
+
+            if(size == -2){
+                cerr << element.name << " " << r << " has a negative list count.\n";
+                return false;
+            }
+            if(size < 0){
+                cerr << "unexpected end of file.\n";
+                return false;
+            }
+
+            if(isVertex || isFace){
+                const char *q = p;
+
+                for(unsigned int i = 0; i < element.properties.size(); i++){
+                    const PLYProperty &property = element.properties[i];
+
+                    if(property.isList){
+                        int count = (int)ReadPLYValue(q, property.countType, swapBytes);
+                        q += GetPLYTypeSize(property.countType);
+
+                        if((int)i == listIndex){
+                            int indexSize = GetPLYTypeSize(property.type);
+
+                            for(int j = 2; j < count; j++){
+                                halfedges.vertex.push_back((int)ReadPLYValue(q,                 property.type, swapBytes));
+                                halfedges.vertex.push_back((int)ReadPLYValue(q + (j-1)*indexSize, property.type, swapBytes));
+                                halfedges.vertex.push_back((int)ReadPLYValue(q +  j   *indexSize, property.type, swapBytes));
+                            }
+                        }
+
+                        q += count * GetPLYTypeSize(property.type);
+                    }else{
+                        if((int)i == xIndex) vertices.coord[3*r  ] = (Real)ReadPLYValue(q, property.type, swapBytes);
+                        if((int)i == yIndex) vertices.coord[3*r+1] = (Real)ReadPLYValue(q, property.type, swapBytes);
+                        if((int)i == zIndex) vertices.coord[3*r+2] = (Real)ReadPLYValue(q, property.type, swapBytes);
+
+                        q += GetPLYTypeSize(property.type);
+                    }
+                }
+            }
+
+            p += size;
+        }
+    }
+
+    if(hasFaces == false){
+        cerr << "PLY file has no faces.\n";
+        return false;
+    }
+
+    n_faces = (int)halfedges.vertex.size() / 3;
+
+    for(int he = 0; he < 3*n_faces; he++){
+        if(halfedges.vertex[he] < 0 || halfedges.vertex[he] >= n_vertices){
+            cerr << "vertex index out of range.\n";
+            return false;
+        }
+    }
+
+    if(isVerbose) fprintf(stderr, "Reading PLY file done... %.3f sec\n", GetWallClockTime() - startTime);
+
+    if(isVerbose) cerr << "# of vertices  " << n_vertices << endl;
+    if(isVerbose) cerr << "# of faces     " << n_faces    << endl;
+
+    return true;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// OBJ (only "v" and "f" are used)
+/////////////////////////////////////////////////////////////////////////////
+
+bool Mesh::ReadOBJFile(char *filename)
+{
+    double startTime = GetWallClockTime(), phaseTime = startTime;
+
+    MappedFile file;
+
+    if( file.Open(filename) == false ){
+        cerr << "file cannot be read.\n";
+        return false;
+    }
+
+    const char *end = file.data + file.size;
+
+    vector<const char*> chunkBegin;
+    SplitIntoLineChunks(file.data, end, 4*omp_get_max_threads(), chunkBegin);
+
+    int n_chunks = (int)chunkBegin.size() - 1;
+
+    // count "v" lines of each chunk so that every chunk knows the index of its first vertex,
+    // which is also needed to resolve negative (relative) indices
+    vector<int> chunkVertex(n_chunks+1, 0);
+
+    #pragma omp parallel for schedule(dynamic)
+    for(int c = 0; c < n_chunks; c++){
+        int count = 0;
+
+        for(const char *line = chunkBegin[c]; line < chunkBegin[c+1]; line = SkipLine(line, end)){
+            const char *q = SkipSpaces(line, end);
+            if(q + 1 < end && q[0] == 'v' && IsSpace(q[1])) count++;
+        }
+
+        chunkVertex[c+1] = count;
+    }
+
+    for(int c = 0; c < n_chunks; c++) chunkVertex[c+1] += chunkVertex[c];
+
+    n_vertices = chunkVertex[n_chunks];
+    vertices.coord.resize(3*n_vertices);
+
+    if(isVerbose) fprintf(stderr, "  %-22s %8.3f sec\n", "counting vertices", GetWallClockTime() - phaseTime);
+    phaseTime = GetWallClockTime();
+
+    vector< vector<int> > chunkTriangles(n_chunks);
+    vector<int>           chunkError(n_chunks, 0);
+
+    #pragma omp parallel for schedule(dynamic)
+    for(int c = 0; c < n_chunks; c++){
+        int v = chunkVertex[c];
+
+        vector<int> &triangles = chunkTriangles[c];
+
+        for(const char *line = chunkBegin[c]; line < chunkBegin[c+1]; line = SkipLine(line, end)){
+            const char *q = SkipSpaces(line, end);
+
+            if(q + 1 >= end || IsSpace(q[1]) == false) continue;
+
+            if(q[0] == 'v'){
+                q++;
+
+                double coord_in[3];
+
+                if( ParseDouble(q, end, coord_in[0]) == false ||
+                    ParseDouble(q, end, coord_in[1]) == false ||
+                    ParseDouble(q, end, coord_in[2]) == false ){
+                    chunkError[c] = 1;
+                    break;
+                }
+
+                for(int i = 0; i < 3; i++) VertexCoord(v)[i] = (Real)coord_in[i];
+
+                v++;
+            }else if(q[0] == 'f'){
+                q++;
+
+                // each corner is "v", "v/vt", "v//vn" or "v/vt/vn". only "v" is used
+                int v_id[3], n = 0, index;
+                const char *lineEnd = SkipLine(q, end);
+
+                while(ParseInt(q, lineEnd, index)){
+                    while(q < lineEnd && IsSpace(*q) == false && *q != '\n') q++; // skip "/vt/vn"
+
+                    index = (index < 0) ? v + index : index - 1;
+
+                    if(n < 2){
+                        v_id[n] = index;
+                    }else{
+                        triangles.push_back(v_id[0]);
+                        triangles.push_back(v_id[1]);
+                        triangles.push_back(index);
+                        v_id[1] = index;
+                    }
+                    n++;
+                }
+            }
+        }
+    }
+
+    for(int c = 0; c < n_chunks; c++){
+        if(chunkError[c]){
+            cerr << "vertex cannot be read.\n";
+            return false;
+        }
+    }
+
+    if(isVerbose) fprintf(stderr, "  %-22s %8.3f sec\n", "parsing", GetWallClockTime() - phaseTime);
+
+    vector<int> chunkOffset(n_chunks+1, 0);
+    for(int c = 0; c < n_chunks; c++) chunkOffset[c+1] = chunkOffset[c] + (int)chunkTriangles[c].size();
+
+    n_faces = chunkOffset[n_chunks] / 3;
+    halfedges.vertex.resize(3*n_faces);
+
+    int n_invalid_indices = 0;
+
+    #pragma omp parallel for schedule(dynamic) reduction(+:n_invalid_indices)
+    for(int c = 0; c < n_chunks; c++){
+        for(unsigned int i = 0; i < chunkTriangles[c].size(); i++){
+            int index = chunkTriangles[c][i];
+
+            halfedges.vertex[chunkOffset[c] + i] = index;
+            if(index < 0 || index >= n_vertices) n_invalid_indices++;
+        }
+
+        vector<int>().swap(chunkTriangles[c]);
+    }
+
+    if(n_invalid_indices > 0){
+        cerr << "vertex index out of range.\n";
+        return false;
+    }
+
+    if(isVerbose) fprintf(stderr, "Reading OBJ file done... %.3f sec\n", GetWallClockTime() - startTime);
+
+    if(isVerbose) cerr << "# of vertices  " << n_vertices << endl;
+    if(isVerbose) cerr << "# of faces     " << n_faces    << endl;
+
+    return true;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// binary STL
+/////////////////////////////////////////////////////////////////////////////
+
+bool Mesh::ReadSTLFile(char *filename)
+{
+    double startTime = GetWallClockTime();
+
+    MappedFile file;
+
+    if( file.Open(filename) == false ){
+        cerr << "file cannot be read.\n";
+        return false;
+    }
+
+    // 80 bytes header, number of triangles, and 50 bytes per triangle:
+    // normal (3 floats), 3 corners (9 floats) and 2 bytes of attribute
+    unsigned int n_triangles = 0;
+    if(file.size >= 84) memcpy(&n_triangles, file.data + 80, 4);
+
+    if(file.size < 84 || file.size != 84 + 50 * (size_t)n_triangles){
+        cerr << "not a binary STL file (ASCII STL is not supported).\n";
+        return false;
+    }
+
+    n_faces = (int)n_triangles;
+
+    vector<float> corners(9*(size_t)n_faces);
+
+    const char *base = file.data + 84;
+
+    #pragma omp parallel for
+    for(int f = 0; f < n_faces; f++){
+        memcpy(&corners[9*(size_t)f], base + 50*(size_t)f + 12, 36);
+    }
+
+    MergeIdenticalVertices(corners);
+
+    if(isVerbose) fprintf(stderr, "Reading STL file done... %.3f sec\n", GetWallClockTime() - startTime);
+
+    if(isVerbose) cerr << "# of vertices  " << n_vertices << endl;
+    if(isVerbose) cerr << "# of faces     " << n_faces    << endl;
+
+    return true;
+}
+
+
+// STL stores each triangle with its own copies of the corners.
+// corners with bit-identical coordinates are merged into one vertex, numbered in the order of first appearance
+void Mesh::MergeIdenticalVertices(vector<float> &corners)
+{
+    int n_corners = (int)(corners.size() / 3);
+
+    vector<unsigned long long> keys(n_corners);
+    vector<int>                sortedCorners(n_corners);
+
+    #pragma omp parallel for
+    for(int i = 0; i < n_corners; i++){
+        unsigned int bits[3];
+
+        for(int k = 0; k < 3; k++){
+            float value = corners[3*(size_t)i + k];
+            if(value == 0.0f) value = 0.0f; // -0 and +0 are the same position
+            memcpy(&bits[k], &value, 4);
+        }
+
+        unsigned long long h = bits[0];
+        h = h * 0x9E3779B97F4A7C15ULL ^ bits[1];
+        h = h * 0x9E3779B97F4A7C15ULL ^ bits[2];
+        h = h * 0x9E3779B97F4A7C15ULL;
+
+        keys[i] = h ^ (h >> 29);
+        sortedCorners[i] = i;
+    }
+
+    RadixSort(keys, sortedCorners, 64);
+
+    // in each run of equal hashes, map every corner to the first (smallest) corner with the same coordinates.
+    // radix sort is stable, so corners within a run are in increasing order
+    vector<int> representative(n_corners);
+
+    #pragma omp parallel for
+    for(int i = 0; i < n_corners; i++){
+        if(i > 0 && keys[i] == keys[i-1]) continue;
+
+        int runEnd = i + 1;
+        while(runEnd < n_corners && keys[runEnd] == keys[i]) runEnd++;
+
+        for(int j = i; j < runEnd; j++){
+            int corner = sortedCorners[j];
+            representative[corner] = corner;
+
+            for(int k = i; k < j; k++){
+                int other = sortedCorners[k];
+
+                if(memcmp(&corners[3*(size_t)corner], &corners[3*(size_t)other], 12) == 0 ||
+                   (corners[3*(size_t)corner  ] == corners[3*(size_t)other  ] &&
+                    corners[3*(size_t)corner+1] == corners[3*(size_t)other+1] &&
+                    corners[3*(size_t)corner+2] == corners[3*(size_t)other+2])){
+                    representative[corner] = representative[other];
+                    break;
+                }
+            }
+        }
+    }
+
+    keys.clear();
+    sortedCorners.clear();
+
+    // number the representatives in corner order
+    vector<int> vertexId(n_corners);
+
+    n_vertices = 0;
+    for(int i = 0; i < n_corners; i++){
+        if(representative[i] == i) vertexId[i] = n_vertices++;
+    }
+
+    vertices.coord.resize(3*n_vertices);
+    halfedges.vertex.resize(n_corners);
+
+    #pragma omp parallel for
+    for(int i = 0; i < n_corners; i++){
+        int v = vertexId[ representative[i] ];
+
+        halfedges.vertex[i] = v;
+
+        if(representative[i] == i){
+            for(int k = 0; k < 3; k++) vertices.coord[3*v+k] = corners[3*(size_t)i + k];
+        }
+    }
+}
@@ -0,0 +1,343 @@
+#include "mesh.h"
+#include "generate.h"
+#include <cmath>
+#include <cstring>
+
+
+/////////////////////////////////////////////////////////////////////////////
+// sphere
+/////////////////////////////////////////////////////////////////////////////
+
+static const double icosahedronCoord[12][3] = {
+    { -1,  1.6180339887498949, 0 }, {  1,  1.6180339887498949, 0 }, { -1, -1.6180339887498949, 0 }, {  1, -1.6180339887498949, 0 },
+    { 0, -1,  1.6180339887498949 }, { 0,  1,  1.6180339887498949 }, { 0, -1, -1.6180339887498949 }, { 0,  1, -1.6180339887498949 },
+    {  1.6180339887498949, 0, -1 }, {  1.6180339887498949, 0,  1 }, { -1.6180339887498949, 0, -1 }, { -1.6180339887498949, 0,  1 }
+};
+
+static const int icosahedronCorner[20][3] = {
+    { 0, 11,  5 }, { 0,  5,  1 }, { 0,  1,  7 }, { 0,  7, 10 }, { 0, 10, 11 },
+    { 1,  5,  9 }, { 5, 11,  4 }, { 11, 10, 2 }, { 10, 7,  6 }, { 7,  1,  8 },
+    { 3,  9,  4 }, { 3,  4,  2 }, { 3,  2,  6 }, { 3,  6,  8 }, { 3,  8,  9 },
+    { 4,  9,  5 }, { 2,  4, 11 }, { 6,  2, 10 }, { 8,  6,  7 }, { 9,  8,  1 }
+};
+
+// the points of a face are a + (b-a)*i/n + (c-a)*j/n, i+j <= n. the 12 corners come first, then the n-1
+// points inside each of the 30 edges, from the corner of lower index, then the points inside each face
+struct SphereLayout {
+    int n;
+    int edgeEnd[30][2];
+    int edgeOfFace[20][3];   // the edges a-b, a-c and b-c of each face
+
+    int  EdgeIndex(int u, int w);
+    int  EdgePoint(int e, int u, int k);
+    int  Point(int f, int i, int j);
+};
+
+int SphereLayout::EdgeIndex(int u, int w)
+{
+    if(u > w){ int t = u; u = w; w = t; }
+
+    for(int e = 0; e < 30; e++) if(edgeEnd[e][0] == u && edgeEnd[e][1] == w) return e;
+
+    return NIL;
+}
+
+// the k-th point from u on edge e, 0 < k < n
+int SphereLayout::EdgePoint(int e, int u, int k)
+{
+    return 12 + e*(n-1) + ((u == edgeEnd[e][0]) ? k-1 : n-k-1);
+}
+
+int SphereLayout::Point(int f, int i, int j)
+{
+    const int *c = icosahedronCorner[f];
+
+    if(j == 0 && i == 0) return c[0];
+    if(j == 0 && i == n) return c[1];
+    if(i == 0 && j == n) return c[2];
+
+    if(j == 0)     return EdgePoint(edgeOfFace[f][0], c[0], i);
+    if(i == 0)     return EdgePoint(edgeOfFace[f][1], c[0], j);
+    if(i + j == n) return EdgePoint(edgeOfFace[f][2], c[1], j);
+
+    // rows j = 1 .. n-2 of n-1-j points
+    int row = (j-1)*(n-1) - (j-1)*j/2;
+
+    return 12 + 30*(n-1) + f*((n-1)*(n-2)/2) + row + (i-1);
+}
+
+
+void GenerateSphere(int n_target_faces, GeneratedMesh &mesh)
+{
+    SphereLayout layout;
+
+    int n = 1;
+    while(20.0*n*n < n_target_faces) n++;
+
+    layout.n = n;
+
+    // the edges not found yet must match no pair of corners
+    for(int e = 0; e < 30; e++) layout.edgeEnd[e][0] = layout.edgeEnd[e][1] = NIL;
+
+    int n_edges = 0;
+    for(int f = 0; f < 20; f++){
+        for(int k = 0; k < 3; k++){
+            int u = icosahedronCorner[f][k], w = icosahedronCorner[f][(k+1)%3];
+            if(u > w){ int t = u; u = w; w = t; }
+
+            if(layout.EdgeIndex(u, w) == NIL){
+                layout.edgeEnd[n_edges][0] = u;
+                layout.edgeEnd[n_edges][1] = w;
+                n_edges++;
+            }
+        }
+    }
+
+    for(int f = 0; f < 20; f++){
+        const int *c = icosahedronCorner[f];
+
+        layout.edgeOfFace[f][0] = layout.EdgeIndex(c[0], c[1]);
+        layout.edgeOfFace[f][1] = layout.EdgeIndex(c[0], c[2]);
+        layout.edgeOfFace[f][2] = layout.EdgeIndex(c[1], c[2]);
+    }
+
+    int n_vertices = 12 + 30*(n-1) + 20*((n-1)*(n-2)/2);
+
+    mesh.coord.resize(3*n_vertices);
+    mesh.corner.resize(3*20*n*n);
+
+    for(int v = 0; v < 12; v++) for(int k = 0; k < 3; k++) mesh.coord[3*v+k] = icosahedronCoord[v][k];
+
+    // each point of an edge is computed once, from its first end, so that the faces on both sides share it exactly
+    for(int e = 0; e < 30; e++){
+        const double *u = icosahedronCoord[layout.edgeEnd[e][0]];
+        const double *w = icosahedronCoord[layout.edgeEnd[e][1]];
+
+        for(int k = 1; k < n; k++){
+            int v = layout.EdgePoint(e, layout.edgeEnd[e][0], k);
+
+            for(int d = 0; d < 3; d++) mesh.coord[3*v+d] = u[d] + (w[d] - u[d]) * k / n;
+        }
+    }
+
+    #pragma omp parallel for
+    for(int f = 0; f < 20; f++){
+        const double *a = icosahedronCoord[icosahedronCorner[f][0]];
+        const double *b = icosahedronCoord[icosahedronCorner[f][1]];
+        const double *c = icosahedronCoord[icosahedronCorner[f][2]];
+
+        for(int j = 1; j < n; j++){
+            for(int i = 1; i + j < n; i++){
+                int v = layout.Point(f, i, j);
+
+                for(int d = 0; d < 3; d++) mesh.coord[3*v+d] = a[d] + (b[d] - a[d]) * i / n + (c[d] - a[d]) * j / n;
+            }
+        }
+
+        int *corner = &mesh.corner[3*f*n*n];
+
+        for(int j = 0; j < n; j++){
+            for(int i = 0; i + j < n; i++){
+                corner[0] = layout.Point(f, i,   j);
+                corner[1] = layout.Point(f, i+1, j);
+                corner[2] = layout.Point(f, i,   j+1);
+                corner += 3;
+
+                if(i + j < n-1){
+                    corner[0] = layout.Point(f, i+1, j);
+                    corner[1] = layout.Point(f, i+1, j+1);
+                    corner[2] = layout.Point(f, i,   j+1);
+                    corner += 3;
+                }
+            }
+        }
+    }
+
+    // onto the sphere
+    #pragma omp parallel for
+    for(int v = 0; v < n_vertices; v++) Normalize(&mesh.coord[3*v]);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// noisy grid
+/////////////////////////////////////////////////////////////////////////////
+
+// a number in [0,1) that depends only on its arguments
+static double HashNoise(unsigned int i, unsigned int j, unsigned int seed)
+{
+    unsigned int h = i * 73856093u ^ j * 19349663u ^ seed * 83492791u;
+
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+
+    return h / 4294967296.0;
+}
+
+// 9 holes of radius 0.08 in the unit square, 18% of its area. a vertex between two cells removed diagonally
+// always has a third one removed, so the boundaries stay manifold
+static bool IsInHole(double x, double y)
+{
+    for(int a = 1; a <= 3; a++){
+        for(int b = 1; b <= 3; b++){
+            double dx = x - 0.25*a, dy = y - 0.25*b;
+
+            if(dx*dx + dy*dy < 0.08*0.08) return true;
+        }
+    }
+
+    return false;
+}
+
+void GenerateNoisyGrid(int n_target_faces, unsigned int seed, GeneratedMesh &mesh)
+{
+    int m = (int)ceil(sqrt(n_target_faces / (2.0 * 0.82)));
+    if(m < 4) m = 4;
+
+    for(;; m++){
+        vector<int> vertexId((size_t)(m+1)*(m+1), NIL);
+
+        mesh.corner.clear();
+        mesh.coord.clear();
+
+        for(int j = 0; j < m; j++){
+            for(int i = 0; i < m; i++){
+                if(IsInHole((i + 0.5) / m, (j + 0.5) / m)) continue;
+
+                int quad[4] = { j*(m+1) + i, j*(m+1) + i+1, (j+1)*(m+1) + i+1, (j+1)*(m+1) + i };
+
+                for(int k = 0; k < 4; k++){
+                    int v = quad[k];
+
+                    if(vertexId[v] != NIL) continue;
+
+                    vertexId[v] = (int)mesh.coord.size() / 3;
+
+                    double x = (double)(v % (m+1)) / m, y = (double)(v / (m+1)) / m;
+
+                    mesh.coord.push_back(x);
+                    mesh.coord.push_back(y);
+                    mesh.coord.push_back(0.05 * (sin(6.1*x) * cos(5.3*y) + 0.5 * sin(17.3*x + 3.1*y)) +
+                                         0.002 * (HashNoise(v % (m+1), v / (m+1), seed) - 0.5));
+                }
+
+                // the diagonals alternate, so that no direction is preferred
+                int d = (i + j) % 2;
+
+                mesh.corner.push_back(vertexId[quad[d]]);
+                mesh.corner.push_back(vertexId[quad[d+1]]);
+                mesh.corner.push_back(vertexId[quad[(d+2)%4]]);
+
+                mesh.corner.push_back(vertexId[quad[d]]);
+                mesh.corner.push_back(vertexId[quad[(d+2)%4]]);
+                mesh.corner.push_back(vertexId[quad[(d+3)%4]]);
+            }
+        }
+
+        if(mesh.NumberOfFaces() >= n_target_faces) return;
+    }
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// fans
+/////////////////////////////////////////////////////////////////////////////
+
+// the lattice of N+1 x N+1 points, N = m*k, has the block borders on every k-th row and column.
+// the points on the rows come first, then the other points on the columns, then the centers of the blocks
+struct FanLayout {
+    int m, k, N;
+
+    int Point(int i, int j){
+        if(j % k == 0) return (j/k)*(N+1) + i;
+        return (m+1)*(N+1) + (i/k)*(m*(k-1)) + (j/k)*(k-1) + (j%k - 1);
+    }
+    int Center(int bi, int bj){ return (m+1)*(N+1) + (m+1)*m*(k-1) + bj*m + bi; }
+};
+
+static double FanHeight(double x, double y)
+{
+    return 0.1 * sin(3.0*x) * sin(2.0*y);
+}
+
+void GenerateFans(int n_target_faces, int valence, GeneratedMesh &mesh)
+{
+    if(valence < 8) valence = 8;
+
+    FanLayout layout;
+
+    layout.k = valence / 4;
+    layout.m = 1;
+    while((double)layout.m * layout.m * 4 * layout.k < n_target_faces) layout.m++;
+    layout.N = layout.m * layout.k;
+
+    int m = layout.m, k = layout.k, N = layout.N;
+
+    int n_vertices = layout.Center(0, 0) + m*m;
+
+    mesh.coord.resize(3*n_vertices);
+    mesh.corner.resize(3*(size_t)m*m*4*k);
+
+    #pragma omp parallel for
+    for(int j = 0; j <= N; j++){
+        for(int i = 0; i <= N; i++){
+            if(j % k != 0 && i % k != 0) continue;
+
+            double *p = &mesh.coord[3*layout.Point(i, j)];
+
+            p[0] = (double)i / N;
+            p[1] = (double)j / N;
+            p[2] = FanHeight(p[0], p[1]);
+        }
+    }
+
+    #pragma omp parallel for
+    for(int b = 0; b < m*m; b++){
+        int bi = b % m, bj = b / m;
+
+        int center = layout.Center(bi, bj);
+
+        double *p = &mesh.coord[3*center];
+        p[0] = (bi + 0.5) / m;
+        p[1] = (bj + 0.5) / m;
+        p[2] = FanHeight(p[0], p[1]);
+
+        // the border, counterclockwise from the lower left corner
+        int *corner = &mesh.corner[3*(size_t)b*4*k];
+        int  first  = layout.Point(bi*k, bj*k);
+        int  prev   = first;
+
+        for(int t = 1; t <= 4*k; t++){
+            int side = (t-1) / k, s = t - side*k;
+            int i, j;
+
+            if     (side == 0){ i = bi*k + s;     j = bj*k;         }
+            else if(side == 1){ i = (bi+1)*k;     j = bj*k + s;     }
+            else if(side == 2){ i = (bi+1)*k - s; j = (bj+1)*k;     }
+            else              { i = bi*k;         j = (bj+1)*k - s; }
+
+            int next = (t == 4*k) ? first : layout.Point(i, j);
+
+            corner[0] = center;
+            corner[1] = prev;
+            corner[2] = next;
+            corner += 3;
+
+            prev = next;
+        }
+    }
+}
+
+
+bool GenerateMesh(const char *name, int n_target_faces, GeneratedMesh &mesh)
+{
+    if     (strcmp(name, "sphere") == 0) GenerateSphere(n_target_faces, mesh);
+    else if(strcmp(name, "grid")   == 0) GenerateNoisyGrid(n_target_faces, 1, mesh);
+    else if(strcmp(name, "fan")    == 0) GenerateFans(n_target_faces, 64, mesh);
+    else return false;
+
+    return true;
+}
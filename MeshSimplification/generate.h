@@ -0,0 +1,25 @@
+// Procedural meshes for the benchmark (bench.cpp), for Mesh::ConstructMeshDataStructure(n_vertices, coord,
+// n_faces, corner). Each generator makes the smallest mesh of its kind with at least "n_target_faces" faces,
+// the same one on every platform, and uses only memory proportional to it.
+//
+//   sphere  an icosahedron whose faces are split into n x n triangles, projected onto the unit sphere.
+//           closed, valence 6 except at the 12 corners (valence 5)
+//   grid    a height field of sums of sines plus noise over a square, with round holes punched out of it:
+//           an outer boundary and one boundary loop per hole
+//   fan     a square of blocks, each a fan of triangles from its center to the vertices along its border.
+//           the centers have the given valence, the border vertices 4 to 8
+
+struct GeneratedMesh {
+    vector<double> coord;   // 3 per vertex
+    vector<int>    corner;  // 3 per face, counterclockwise
+
+    int NumberOfVertices(){ return (int)coord.size() / 3; }
+    int NumberOfFaces()   { return (int)corner.size() / 3; }
+};
+
+extern void GenerateSphere(int n_target_faces, GeneratedMesh &mesh);
+extern void GenerateNoisyGrid(int n_target_faces, unsigned int seed, GeneratedMesh &mesh);
+extern void GenerateFans(int n_target_faces, int valence, GeneratedMesh &mesh);   // valence: a multiple of 4, at least 8
+
+// "sphere", "grid" or "fan", with the defaults of the benchmark. false if the name is none of these
+extern bool GenerateMesh(const char *name, int n_target_faces, GeneratedMesh &mesh);
@@ -0,0 +1,208 @@
+#include "mesh.h"
+#include "simplification.h"
+#include "quadric.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define GEOMORPH_X86
+#include <emmintrin.h>
+#endif
+
+#if defined(GEOMORPH_X86) && defined(__GNUC__)
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#else
+#define TARGET_SSE2
+#endif
+
+
+/////////////////////////////////////////////////////////////////////////////
+// blending
+/////////////////////////////////////////////////////////////////////////////
+
+static void BlendScalar(int n, const float *start, const float *end, float t, float *blended)
+{
+    float s = 1.0f - t;
+
+    for(int i = 0; i < n; i++) blended[i] = s*start[i] + t*end[i];
+}
+
+#ifdef GEOMORPH_X86
+
+// 4 floats at a time, the rest as BlendScalar. the same operations, so the results are the same
+TARGET_SSE2 static void BlendSSE2(int n, const float *start, const float *end, float t, float *blended)
+{
+    __m128 s = _mm_set1_ps(1.0f - t);
+    __m128 u = _mm_set1_ps(t);
+
+    int i = 0;
+    for(; i + 4 <= n; i += 4){
+        __m128 a = _mm_loadu_ps(start + i);
+        __m128 b = _mm_loadu_ps(end + i);
+
+        _mm_storeu_ps(blended + i, _mm_add_ps(_mm_mul_ps(s, a), _mm_mul_ps(u, b)));
+    }
+
+    BlendScalar(n - i, start + i, end + i, t, blended + i);
+}
+
+#endif // GEOMORPH_X86
+
+
+void BlendGeomorph(Geomorph &morph, float t)
+{
+    int n = (int)morph.start.size();
+
+    morph.blended.resize(n);
+    if(n == 0) return;
+
+#ifdef GEOMORPH_X86
+    if(GetQuadricKernel() != QUADRIC_KERNEL_SCALAR){
+        BlendSSE2(n, &morph.start[0], &morph.end[0], t, &morph.blended[0]);
+        return;
+    }
+#endif
+    BlendScalar(n, &morph.start[0], &morph.end[0], t, &morph.blended[0]);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// the vertices of a transition
+/////////////////////////////////////////////////////////////////////////////
+
+static void CopyVertexData(Mesh &mesh, int v, float *data)
+{
+    for(int k = 0; k < 3; k++){
+        data[k]   = (float)mesh.VertexCoord(v)[k];
+        data[3+k] = (float)mesh.VertexNormal(v)[k];
+    }
+}
+
+// the vertex gets an entry the first time it is seen, with its current position and normal as the start
+static void AddMorphVertex(Mesh &mesh, int v, vector<int> &slot, Geomorph &morph)
+{
+    if(slot[v] != NIL) return;
+
+    slot[v] = (int)morph.vertex.size();
+    morph.vertex.push_back(v);
+
+    morph.start.resize(morph.start.size() + 6);
+    CopyVertexData(mesh, v, &morph.start[6*slot[v]]);
+}
+
+
+bool Simplification::BeginGeomorph(int n_target_faces, Geomorph &morph)
+{
+    if(isSelective){
+        cerr << "BeginGeomorph: end the selective refinement first" << endl;
+        return false;
+    }
+
+    if(history.IsRecording() == false){
+        cerr << "BeginGeomorph: the collapses are not recorded" << endl;
+        return false;
+    }
+
+    vector<int> &heVertex     = mesh->halfedges.vertex;
+    vector<int> &edgeHalfEdge = mesh->edges.halfedge;
+
+    int current = history.Cursor();
+
+    // a target below the recorded levels is made first
+    if(history.FindCursor(n_target_faces) == history.Size() && history.FacesAt(history.Size()) > n_target_faces){
+        int n_dropped = history.NumberOfDropped();
+
+        SeekFaceCount(n_target_faces);
+
+        // the oldest records may have been dropped meanwhile
+        current -= history.NumberOfDropped() - n_dropped;
+        if(current < 0) current = 0;
+
+        SeekRecord(current);
+    }
+
+    int target = history.FindCursor(n_target_faces);
+
+    morph.n_target_faces = n_target_faces;
+    morph.isCoarsening   = target > current;
+    morph.vertex.clear();
+    morph.start.clear();
+    morph.end.clear();
+
+    UpdateNormals();
+
+    if((int)morphSlot.size() != mesh->n_vertices) morphSlot.assign(mesh->n_vertices, NIL);
+    morphPairs.clear();
+
+    vector<int> faces;
+
+    if(target < current){
+        // split down to the target. a vertex that has not moved yet starts where it is, and v0 starts where
+        // v1 does, which is where the vertex they are both merged into is at the current level
+        for(int i = current - 1; i >= target; i--){
+            int hep = edgeHalfEdge[2*history.Edge(i)];
+            int v0  = heVertex[hep];
+            int v1  = heVertex[NextHalfEdge(hep)];
+
+            faces.clear();
+            CollectFacesAroundVertex(mesh->vertices.neighborHe[v1], faces);
+
+            for(unsigned int k = 0; k < faces.size(); k++){
+                for(int j = 0; j < 3; j++) AddMorphVertex(*mesh, heVertex[3*faces[k]+j], morphSlot, morph);
+            }
+            AddMorphVertex(*mesh, v1, morphSlot, morph);
+
+            morphSlot[v0] = (int)morph.vertex.size();
+            morph.vertex.push_back(v0);
+            morph.start.resize(morph.start.size() + 6);
+            copy(&morph.start[6*morphSlot[v1]], &morph.start[6*morphSlot[v1]] + 6, &morph.start[6*morphSlot[v0]]);
+
+            VertexSplit();
+        }
+
+        UpdateNormals();
+
+        morph.end.resize(morph.start.size());
+        for(int i = 0; i < morph.NumberOfVertices(); i++) CopyVertexData(*mesh, morph.vertex[i], &morph.end[6*i]);
+    }else if(target > current){
+        // collapse up to the target, to see where each vertex goes, and split back
+        for(int i = current; i < target; i++){
+            int hep = edgeHalfEdge[2*history.Edge(i)];
+            int v0  = heVertex[hep];
+            int v1  = heVertex[NextHalfEdge(hep)];
+
+            faces.clear();
+            CollectFacesAroundVertex(hep, faces);
+            CollectFacesAroundVertex(NextHalfEdge(hep), faces);
+
+            for(unsigned int k = 0; k < faces.size(); k++){
+                for(int j = 0; j < 3; j++) AddMorphVertex(*mesh, heVertex[3*faces[k]+j], morphSlot, morph);
+            }
+
+            morphPairs.push_back(v0);
+            morphPairs.push_back(v1);
+
+            EdgeCollapse();
+        }
+
+        UpdateNormals();
+
+        morph.end.resize(morph.start.size());
+        for(int i = 0; i < morph.NumberOfVertices(); i++){
+            if(mesh->vertices.isActive[morph.vertex[i]]) CopyVertexData(*mesh, morph.vertex[i], &morph.end[6*i]);
+        }
+
+        // v0 ends where v1 does. the collapses that merge v1 later come first, so v1's end is known
+        for(int i = (int)morphPairs.size()/2 - 1; i >= 0; i--){
+            const float *end1 = &morph.end[6*morphSlot[morphPairs[2*i+1]]];
+
+            copy(end1, end1 + 6, &morph.end[6*morphSlot[morphPairs[2*i]]]);
+        }
+
+        while(history.Cursor() > current) VertexSplit();
+
+        UpdateNormals();
+    }
+
+    for(int i = 0; i < morph.NumberOfVertices(); i++) morphSlot[morph.vertex[i]] = NIL;
+
+    return true;
+}
@@ -0,0 +1,28 @@
+// A geomorph: the change between two levels of detail spread over t in [0,1].
+//
+// The mesh is kept at the finer of the two levels while it is blended. Each vertex of it that moves, or whose
+// normal changes, has a start and an end: on the coarse side a vertex is where the vertex it is merged into
+// is, with that vertex's normal. The other vertices are left as they are, so blending costs only the vertices
+// that change.
+//
+//   start, end, blended   6 floats per vertex: position x y z, normal x y z
+//
+// Normals are blended linearly and not normalized, so GL_NORMALIZE should be on while they are drawn.
+
+struct Geomorph {
+    int  n_target_faces;    // the level the transition goes to
+    bool isCoarsening;      // the target is the coarser level: the mesh switches to it after the blend
+
+    vector<int>   vertex;   // ids in the mesh
+    vector<float> start;    // at t = 0, the current level
+    vector<float> end;      // at t = 1, the target level
+    vector<float> blended;  // written by BlendGeomorph
+
+    Geomorph(){ n_target_faces = 0; isCoarsening = false; }
+
+    int NumberOfVertices(){ return (int)vertex.size(); }
+};
+
+// blended = (1-t)*start + t*end, with SSE when the CPU has it (see GetQuadricKernel). t = 0 and t = 1 give
+// start and end exactly
+extern void BlendGeomorph(Geomorph &morph, float t);
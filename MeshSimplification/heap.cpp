@@ -0,0 +1,106 @@
+#include "heap.h"
+
+
+void IndexedHeap::Build(const vector<double> &cost_in)
+{
+    int n = (int)cost_in.size();
+
+    cost = cost_in;
+    heap.resize(n);
+    position.resize(n);
+
+    for(int i = 0; i < n; i++) heap[i] = position[i] = i;
+
+    // bottom-up heapify, starting from the parent of the last item. (n-2)/4 is 0 for no item too
+    if(n > 1){
+        for(int i = (n-2)/4; i >= 0; i--) SiftDown(i);
+    }
+}
+
+void IndexedHeap::Update(int item, double cost_in)
+{
+    if(position[item] == -1){
+        cost[item] = cost_in;
+        position[item] = (int)heap.size();
+        heap.push_back(item);
+
+        SiftUp(position[item]);
+    }else{
+        double oldCost = cost[item];
+        cost[item] = cost_in;
+
+        if(cost_in < oldCost) SiftUp  (position[item]);
+        else                  SiftDown(position[item]);
+    }
+}
+
+void IndexedHeap::Remove(int item)
+{
+    int i = position[item];
+    if(i == -1) return;
+
+    int last = heap.back();
+    heap.pop_back();
+    position[item] = -1;
+
+    if(last == item) return;
+
+    // move the last item into the hole, then restore the order in whichever direction is needed
+    heap[i] = last;
+    position[last] = i;
+
+    SiftUp(i);
+    SiftDown(position[last]);
+}
+
+int IndexedHeap::Pop()
+{
+    int item = heap[0];
+    Remove(item);
+
+    return item;
+}
+
+void IndexedHeap::SiftUp(int i)
+{
+    int item = heap[i];
+
+    while(i > 0){
+        int parent = (i-1) / 4;
+        if(IsLess(item, heap[parent]) == false) break;
+
+        heap[i] = heap[parent];
+        position[heap[i]] = i;
+        i = parent;
+    }
+
+    heap[i] = item;
+    position[item] = i;
+}
+
+void IndexedHeap::SiftDown(int i)
+{
+    int n    = (int)heap.size();
+    int item = heap[i];
+
+    while(true){
+        int firstChild = 4*i + 1;
+        if(firstChild >= n) break;
+
+        int lastChild = (firstChild + 4 < n) ? firstChild + 4 : n;
+
+        int smallest = firstChild;
+        for(int c = firstChild+1; c < lastChild; c++){
+            if(IsLess(heap[c], heap[smallest])) smallest = c;
+        }
+
+        if(IsLess(heap[smallest], item) == false) break;
+
+        heap[i] = heap[smallest];
+        position[heap[i]] = i;
+        i = smallest;
+    }
+
+    heap[i] = item;
+    position[item] = i;
+}
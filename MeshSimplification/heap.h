@@ -0,0 +1,35 @@
+#include <vector>
+using namespace std;
+
+// Indexed 4-ary min-heap of items 0..n-1 (edges) ordered by cost, ties broken by the smaller index.
+// "position" tells where each item is in the heap, so that the cost of an item already in the heap
+// is changed in place (decrease-key / increase-key) instead of pushing a duplicate.
+// The heap therefore never holds more entries than there are items.
+class IndexedHeap {
+    vector<int>    heap;      // items, heap[0] has the lowest cost
+    vector<int>    position;  // per item, index in "heap", or -1 if not in the heap
+    vector<double> cost;      // per item. kept after the item is removed
+
+    bool IsLess(int a, int b){ return cost[a] < cost[b] || (cost[a] == cost[b] && a < b); }
+
+    void SiftUp(int i);
+    void SiftDown(int i);
+
+public:
+    // all items in the heap at once. O(n)
+    void Build(const vector<double> &cost_in);
+
+    void Update(int item, double cost_in);  // insert, or change the cost
+    void Remove(int item);
+    int  Pop();
+
+    bool   Empty()             { return heap.empty(); }
+    int    Size()              { return (int)heap.size(); }
+    int    Top()               { return heap[0]; }
+    bool   Contains(int item)  { return position[item] != -1; }
+    double Cost(int item)      { return cost[item]; }
+
+    size_t MemoryUsage(){
+        return heap.capacity() * sizeof(int) + position.capacity() * sizeof(int) + cost.capacity() * sizeof(double);
+    }
+};
@@ -0,0 +1,158 @@
+#include "mesh.h"
+#include "history.h"
+#include <cstring>
+
+#define QUANTIZATION_BITS  21
+#define QUANTIZATION_MAX   ((1 << QUANTIZATION_BITS) - 1)
+#define QUANTIZATION_RANGE 2.0
+
+
+static unsigned int Quantize(double x)
+{
+    double t = (x + QUANTIZATION_RANGE) / (2.0 * QUANTIZATION_RANGE) * QUANTIZATION_MAX + 0.5;
+
+    if(t < 0.0)              return 0;
+    if(t > QUANTIZATION_MAX) return QUANTIZATION_MAX;
+
+    return (unsigned int)t;
+}
+
+static Real Dequantize(unsigned int q)
+{
+    return (Real)(q * (2.0 * QUANTIZATION_RANGE / QUANTIZATION_MAX) - QUANTIZATION_RANGE);
+}
+
+
+void CollapseHistory::SetLimit(int maxRecords_in, bool isQuantized_in)
+{
+    maxRecords  = maxRecords_in;
+    isQuantized = isQuantized_in;
+
+    Clear(n_initialFaces);
+}
+
+void CollapseHistory::Clear(int n_faces)
+{
+    arena.clear();
+    recordOffset.clear();
+    recordFaces.clear();
+    firstRecord    = 0;
+    cursor         = 0;
+    n_initialFaces = n_faces;
+    n_dropped      = 0;
+}
+
+void CollapseHistory::PackCoord(const Real *coord, int *words)
+{
+    if(isQuantized){
+        unsigned int x = Quantize(coord[0]);
+        unsigned int y = Quantize(coord[1]);
+        unsigned int z = Quantize(coord[2]);
+
+        // x and the low 11 bits of y, the high 10 bits of y and z
+        words[0] = (int)(x | (y << 21));
+        words[1] = (int)((y >> 11) | (z << 10));
+    }else{
+        memcpy(words, coord, 3 * sizeof(Real));
+    }
+}
+
+void CollapseHistory::UnpackCoord(const int *words, Real *coord)
+{
+    if(isQuantized){
+        unsigned int w0 = (unsigned int)words[0], w1 = (unsigned int)words[1];
+
+        coord[0] = Dequantize(w0 & QUANTIZATION_MAX);
+        coord[1] = Dequantize(((w0 >> 21) | (w1 << 11)) & QUANTIZATION_MAX);
+        coord[2] = Dequantize((w1 >> 10) & QUANTIZATION_MAX);
+    }else{
+        memcpy(coord, words, 3 * sizeof(Real));
+    }
+}
+
+void CollapseHistory::Push(const VertexSplitTarget &split, int n_active_faces)
+{
+    if(maxRecords == 0){
+        n_dropped++;
+        n_initialFaces = n_active_faces;
+        return;
+    }
+
+    if(maxRecords > 0 && Size() == maxRecords) DropOldest();
+
+    int n_ring = (int)split.halfedgesAroundV0.size();
+    int offset = (int)arena.size();
+
+    recordOffset.push_back(offset);
+    recordFaces.push_back(n_active_faces);
+    arena.resize(offset + 2 + 2*CoordWords() + n_ring);
+
+    int *record = &arena[offset];
+
+    record[0] = split.edge;
+    record[1] = (n_ring << 1) | (split.v1OriginalIsBoundary ? 1 : 0);
+
+    PackCoord(split.v1OrginalCoord,   &record[2]);
+    PackCoord(split.v1CollapsedCoord, &record[2 + CoordWords()]);
+
+    if(n_ring > 0) memcpy(&record[2 + 2*CoordWords()], &split.halfedgesAroundV0[0], n_ring * sizeof(int));
+
+    cursor = Size();
+}
+
+void CollapseHistory::Get(int i, VertexSplitTarget &split)
+{
+    const int *record = &arena[recordOffset[firstRecord + i]];
+
+    int n_ring = record[1] >> 1;
+
+    split.edge = record[0];
+    split.v1OriginalIsBoundary = (record[1] & 1) != 0;
+
+    UnpackCoord(&record[2],                split.v1OrginalCoord);
+    UnpackCoord(&record[2 + CoordWords()], split.v1CollapsedCoord);
+
+    split.halfedgesAroundV0.assign(record + 2 + 2*CoordWords(), record + 2 + 2*CoordWords() + n_ring);
+}
+
+int CollapseHistory::FindCursor(int n_target_faces)
+{
+    if(n_initialFaces <= n_target_faces || Size() == 0) return 0;
+
+    // the face counts decrease with the records
+    int low = 1, high = Size();
+
+    while(low < high){
+        int middle = (low + high) / 2;
+
+        if(FacesAt(middle) <= n_target_faces) high = middle;
+        else                                  low  = middle + 1;
+    }
+
+    return low;
+}
+
+void CollapseHistory::DropOldest()
+{
+    n_initialFaces = recordFaces[firstRecord];
+
+    firstRecord++;
+    n_dropped++;
+
+    // move the records kept to the front once the dropped ones are half of the array, so that dropping is O(1) on average
+    if(firstRecord < (int)recordOffset.size() / 2) return;
+
+    int begin = recordOffset[firstRecord];
+    int n_kept = (int)recordOffset.size() - firstRecord;
+
+    arena.erase(arena.begin(), arena.begin() + begin);
+
+    for(int i = 0; i < n_kept; i++){
+        recordOffset[i] = recordOffset[firstRecord + i] - begin;
+        recordFaces[i]  = recordFaces[firstRecord + i];
+    }
+    recordOffset.resize(n_kept);
+    recordFaces.resize(n_kept);
+
+    firstRecord = 0;
+}
@@ -0,0 +1,81 @@
+// The collapse history, packed into one array of ints.
+//
+// A collapse is recorded as a VertexSplitTarget while it is applied, and packed when it is pushed:
+//
+//   edge
+//   (number of halfedges around v0) << 1 | v1 was a boundary vertex
+//   v1's coordinates before the collapse: 3 Reals, or 3 x 21 bits in 2 ints if quantized
+//   v1's coordinates after the collapse, the same way
+//   halfedges around v0
+//
+// The halfedges are 32-bit indices, so the history needs no allocation per collapse.
+// The records before the cursor are applied to the mesh. VertexSplit moves the cursor back and keeps the
+// record, so that the collapse can be redone from it.
+// With a limit on the number of records, the oldest ones are dropped: VertexSplit can then undo only the
+// latest collapses, and the progressive mesh starts from the mesh of the oldest record kept.
+// A limit of 0 keeps nothing, for runs that only decimate.
+
+// one collapse, unpacked
+struct VertexSplitTarget {
+
+    int      edge;
+    Real     v1OrginalCoord[3];
+    Real     v1CollapsedCoord[3];
+    bool     v1OriginalIsBoundary;
+    vector<int> halfedgesAroundV0;
+
+    VertexSplitTarget(){
+        edge = NIL;
+        for(int i = 0; i < 3; i++) v1OrginalCoord[i] = v1CollapsedCoord[i] = 0.0;
+        v1OriginalIsBoundary = false;
+    }
+};
+
+
+class CollapseHistory {
+    vector<int> arena;         // the records, oldest first
+    vector<int> recordOffset;  // per record, where it starts in "arena"
+    vector<int> recordFaces;   // per record, the number of active faces after it
+    int  firstRecord;          // records before it are dropped, and are removed from the arrays now and then
+    int  cursor;               // records [0, cursor) are applied
+    int  n_initialFaces;       // active faces before the oldest record kept
+    int  maxRecords;           // -1 if no limit
+    int  n_dropped;
+    bool isQuantized;
+
+    int  CoordWords(){ return isQuantized ? 2 : (int)(3 * sizeof(Real) / sizeof(int)); }
+    void PackCoord(const Real *coord, int *words);
+    void UnpackCoord(const int *words, Real *coord);
+    void DropOldest();
+
+public:
+    CollapseHistory(){ firstRecord = cursor = n_initialFaces = 0; maxRecords = -1; n_dropped = 0; isQuantized = false; }
+
+    // quantized coordinates are in [-2,2] (the mesh is normalized into [-1,1]) with a step of about 2e-6.
+    // clears the history
+    void SetLimit(int maxRecords_in, bool isQuantized_in);
+    void Clear(int n_faces);
+
+    // the records kept, applied or not. record 0 is the oldest kept
+    int  Size()            { return (int)recordOffset.size() - firstRecord; }
+    int  Cursor()          { return cursor; }
+    int  NumberOfDropped() { return n_dropped; }
+    bool IsAtEnd()         { return cursor == Size(); }
+
+    // appends a new collapse at the cursor, which must be at the end
+    void Push(const VertexSplitTarget &split, int n_active_faces);
+    void Undo()            { cursor--; }
+    void Redo()            { cursor++; }
+    void SetCursor(int n)  { cursor = n; }
+    bool IsRecording()     { return maxRecords != 0; }
+
+    int  Edge(int i)       { return arena[recordOffset[firstRecord + i]]; }
+    void Get(int i, VertexSplitTarget &split);
+
+    // active faces with the records [0, n) applied
+    int  FacesAt(int n)    { return (n == 0) ? n_initialFaces : recordFaces[firstRecord + n - 1]; }
+    // the fewest applied records that leave at most "n_target_faces" faces, or Size() if none does
+    int  FindCursor(int n_target_faces);
+
+    size_t MemoryUsage(){ return VectorBytes(arena) + VectorBytes(recordOffset) + VectorBytes(recordFaces); }
+};
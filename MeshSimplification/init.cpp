@@ -1,5 +1,6 @@
 
 #include "mesh.h"
+#include <GL/glut.h>
 
 void GLInit()
 {
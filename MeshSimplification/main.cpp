@@ -1,12 +1,29 @@
 
 #include "mesh.h"
 #include "simplification.h"
-#include <windows.h> 
+#include "progressive.h"
+#include "render.h"
+#include "fileio.h"
+#include <cmath>
+#include <GL/glut.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
 
 
 Mesh mesh;
 Simplification simplification;
 
+// the mesh as drawn. only the faces changed by each frame's collapses and splits are updated and uploaded
+RenderBuffer renderBuffer;
+vector<int>  changedFaces;
+
+// a .pm file is shown with "progressiveMesh" instead of being simplified
+ProgressiveMesh progressiveMesh;
+bool isProgressiveMesh = false;
+char pmFilename[1024];
+
 GLfloat startx, starty;
 GLfloat model_angle1 = 0.0, model_angle2 = 0.0, scale = 1.0, eye[3] = { 0.0, 0.0, 10.0 };
 GLfloat window_width = 800, window_height = 800;
@@ -15,9 +32,19 @@ int Key;
 int toggle = 0;
 bool left_click = 0, right_click = 0;
 
-bool doEdgeCollapse = false, doVertexSplit = false, doLOD = false;
+bool doEdgeCollapse = false, doVertexSplit = false, doLOD = false, doWrite = false;
 int  step = 0;
 
+// key 'v' refines the mesh where the view needs it. 'z' and 'x' then double or halve the tolerance
+bool   isViewDependent = false;
+double pixelTolerance  = 1.0;
+
+// otherwise 'z' and 'x' blend to the next level over GEOMORPH_FRAMES frames
+#define GEOMORPH_FRAMES 12
+Geomorph geomorph;
+bool isMorphing = false;
+int  morphFrame = 0;
+
 
 void mouse(int button, int state, int x, int y)
 {
@@ -69,18 +96,27 @@ void keyboard( unsigned char c, int x, int y )
         doEdgeCollapse = true;  break;
     case 's':        
         doVertexSplit  = true;  break;
+    case 'v':
+        if(!isProgressiveMesh) isViewDependent = !isViewDependent;
+        break;
     case 'z':
-        if(step < 200){
+        if(isViewDependent){
+            pixelTolerance *= 2.0;
+        }else if(step < 200){
             step++; 
             doLOD = true;
         }
             break;
     case 'x':  
-        if(step > 0){
+        if(isViewDependent){
+            pixelTolerance *= 0.5;
+        }else if(step > 0){
             step--;
             doLOD = true;
         }
         break;
+    case 'w':
+        doWrite = true;  break;
     case 't':
         if(toggle) toggle = 0;
         else       toggle = 1;
@@ -91,6 +127,16 @@ void keyboard( unsigned char c, int x, int y )
 }
 
 
+// redraws while a geomorph is shown, about 60 times a second
+void morphTimer(int value)
+{
+    if(isMorphing){
+        glutPostRedisplay();
+        glutTimerFunc(16, morphTimer, 0);
+    }
+}
+
+
 void display()
 {
     glClearColor( 1.0, 1.0, 1.0, 0.0 );
@@ -104,6 +150,65 @@ void display()
     glRotatef(model_angle1, 0, 1, 0);
     glRotatef(model_angle2, 1, 0, 0);
 
+    if(isProgressiveMesh){
+        if(doEdgeCollapse){
+            progressiveMesh.SetNumberOfSplits(progressiveMesh.n_splits-1);
+            doEdgeCollapse = false;
+        }
+
+        if(doVertexSplit){
+            progressiveMesh.SetNumberOfSplits(progressiveMesh.n_splits+1);
+            doVertexSplit = false;
+        }
+
+        if(doLOD){
+            progressiveMesh.SetNumberOfFaces((int)(progressiveMesh.corner.size()/3*pow(0.95, step)));
+            doLOD = false;
+        }
+
+        doWrite = false;
+
+        progressiveMesh.Display(toggle);
+
+        glutSwapBuffers();
+        return;
+    }
+
+    // a geomorph ends at its last frame, or first if something else changes the level
+    if(isMorphing && (morphFrame == GEOMORPH_FRAMES || doEdgeCollapse || doVertexSplit || doLOD || doWrite || isViewDependent)){
+        simplification.EndGeomorph(geomorph);
+        isMorphing = false;
+    }
+
+    if(isViewDependent != simplification.IsSelective()){
+        if(isViewDependent) simplification.StartSelectiveRefinement();
+        else                simplification.EndSelectiveRefinement();
+    }
+
+    if(isViewDependent){
+        // the orthographic view is taken as seen from the eye of gluLookAt, with the field of view that
+        // shows the same size at the origin. the eye and the direction are brought back into the mesh
+        // by the transposed modelview, which is a rotation times a scale
+        GLdouble m[16];
+        glGetDoublev(GL_MODELVIEW_MATRIX, m);
+
+        double scale2 = m[0]*m[0] + m[1]*m[1] + m[2]*m[2];
+
+        ViewParameters view;
+        for(int i = 0; i < 3; i++){
+            view.eye[i]       = -(m[4*i]*m[12] + m[4*i+1]*m[13] + m[4*i+2]*m[14]) / scale2;
+            view.direction[i] = -m[4*i+2] / sqrt(scale2);
+        }
+        view.fieldOfView  = 2.0 * atan(1.1 / (10.0 * sqrt(scale2)));
+        view.aspect       = window_width / window_height;
+        view.screenHeight = (int)window_height;
+        view.tolerance    = pixelTolerance;
+
+        int n_changes = simplification.RefineForView(view);
+
+        if(n_changes > 0) cerr << "view-dependent: " << n_changes << " changes, " << simplification.NumberOfActiveFaces() << " faces" << endl;
+    }
+
     if(doEdgeCollapse){
         simplification.EdgeCollapse();
         doEdgeCollapse = false;
@@ -115,11 +220,31 @@ void display()
     }
 
     if(doLOD){
-        simplification.ControlLevelOfDetail(step);
+        if(simplification.ControlLevelOfDetail(step, geomorph)){
+            isMorphing = true;
+            morphFrame = 0;
+            glutTimerFunc(16, morphTimer, 0);
+        }
         doLOD = false;
     }
 
-    mesh.Display(toggle);
+    if(doWrite){
+        simplification.WriteProgressiveMesh(pmFilename);
+        doWrite = false;
+    }
+
+    if(simplification.TakeChangedFaces(changedFaces)) renderBuffer.Update(mesh, changedFaces);
+    else                                              renderBuffer.Build(mesh);
+
+    // over the positions and normals of the mesh
+    if(isMorphing){
+        morphFrame++;
+        BlendGeomorph(geomorph, (float)morphFrame / GEOMORPH_FRAMES);
+
+        if(geomorph.NumberOfVertices() > 0) renderBuffer.WriteVertices(geomorph.NumberOfVertices(), &geomorph.vertex[0], &geomorph.blended[0]);
+    }
+
+    renderBuffer.Display(toggle);
 
     glutSwapBuffers();
 }
@@ -127,12 +252,35 @@ void display()
 
 int main(int argc, char *argv[])
 {
-    if( argc != 2 || mesh.ConstructMeshDataStructure(argv[1]) == false ){
-        cerr << "usage: meshSimplification.exe *.off\n";
-        exit(0);
-    }
+    const char *extension = (argc == 2) ? strrchr(argv[1], '.') : NULL;
 
-    simplification.InitSimplification(&mesh);
+    if(extension != NULL && HasExtension(extension, ".pm")){
+        // the base mesh is shown first. the full mesh is at step 0
+        if( progressiveMesh.Read(argv[1]) == false ) exit(0);
+
+        isProgressiveMesh = true;
+        step = 200;
+        while(step > 0 && progressiveMesh.corner.size()/3*pow(0.95, step-1) <= progressiveMesh.n_faces) step--;
+    }else{
+        if( argc != 2 || mesh.ConstructMeshDataStructure(argv[1]) == false ){
+            cerr << "usage: meshSimplification.exe *.off | *.ply | *.obj | *.stl | *.pm\n";
+            exit(0);
+        }
+
+        // the LOD keys jump between levels from about 8 copies of the mesh
+        simplification.SetCheckpointInterval(mesh.n_vertices / 8 + 1);
+        simplification.TrackChanges(true);
+        simplification.DeferNormals(true);   // recomputed once per frame, when the changes are taken
+        simplification.InitSimplification(&mesh);
+        renderBuffer.Build(mesh);
+
+        // key 'w' writes the current mesh and its history to the input file name with ".pm"
+        strncpy(pmFilename, argv[1], sizeof(pmFilename) - 4);
+        pmFilename[sizeof(pmFilename) - 4] = '\0';
+        char *dot = strrchr(pmFilename, '.');
+        if(dot != NULL) *dot = '\0';
+        strcat(pmFilename, ".pm");
+    }
 
     glutInit(&argc, argv);
     glutInitDisplayMode(GLUT_RGB | GLUT_DOUBLE | GLUT_DEPTH | GLUT_STENCIL);
@@ -1,4 +1,3 @@
-
 #include <iostream>
 #include <fstream>
 #include <vector>
@@ -6,92 +5,58 @@
 #include <queue>
 #include <deque>
 #include <stack>
-#include <GL/glut.h>
 using namespace std;
 
-struct HalfEdge;
-struct Vertex;
-struct Face;
-struct Edge;
-
-typedef list<Vertex>::iterator  VertexIter;
-typedef list<Face>::iterator    FaceIter;
-typedef list<Edge>::iterator    EdgeIter;
+// index used for "no element", e.g. the mate of a boundary halfedge
+#define NIL -1
 
+// Halfedges are not stored as objects. The i-th halfedge of face f has index 3*f+i,
+// so that "next", "prev" and "face" are implied by the index itself.
+inline int NextHalfEdge(int he){ return (he % 3 == 2) ? he - 2 : he + 1; }
+inline int PrevHalfEdge(int he){ return (he % 3 == 0) ? he + 2 : he - 1; }
+inline int FaceOfHalfEdge(int he){ return he / 3; }
 
-struct HalfEdge {
-    HalfEdge *next, *prev;
-    HalfEdge *mate;
 
-    VertexIter vertex;
-    FaceIter   face;
-    EdgeIter   edge;
+// All elements are kept in contiguous arrays (structure of arrays) and refer to each other by 32-bit indices.
+// Flags are stored as "char" rather than "bool" so that different elements never share a byte.
 
-    HalfEdge(){
-        next = prev = NULL;
-        mate = NULL;
-    }
-};
+// Precision of the stored coordinates, normals and face areas. With MESH_SINGLE_PRECISION they are floats, which
+// is enough once the model is normalized into [-1,1]. Quadrics, optimal coordinates and the arithmetic on them
+// are double in either case
+#ifdef MESH_SINGLE_PRECISION
+typedef float  Real;
+#else
+typedef double Real;
+#endif
 
-struct Edge {
-    HalfEdge *halfedge[2]; // if boundary edge, halfedge[1] == NULL
-    int id;
+inline void CopyToDouble(const Real *a, double *b){ b[0] = a[0]; b[1] = a[1]; b[2] = a[2]; }
 
-    int ect_id; // id of corresponding "EdgeCollapseTarget"
+// bytes allocated by an array, for the memory reports
+template <class T> inline size_t VectorBytes(const vector<T> &a){ return a.capacity() * sizeof(T); }
 
-    bool isActive;
-
-    Edge(){}
-    Edge(HalfEdge *he0, HalfEdge *he1, int n){
-        halfedge[0] = he0; 
-        halfedge[1] = he1;
-        id = n;
-        isActive = true;
-    };
+struct VertexArray {
+    vector<Real>   coord;       // 3 per vertex
+    vector<Real>   normal;      // 3 per vertex
+    vector<int>    neighborHe;  // one of the halfedges incident to the vertex
+    vector<char>   isBoundary;
+    vector<char>   isActive;
 };
 
-
-struct Vertex {
-    double coord[3];
-    double normal[3];
-    int id;
-    // pointer to one of the halfedges incident to this vertex
-    HalfEdge *neighborHe;
-
-    bool isBoundary;
-    bool isActive;
-
-    double Q[10];
-
-    Vertex(){};
-    Vertex(double *coord_in, int n){
-        for(int i=0; i<3; i++) coord[i] = coord_in[i];
-        id = n;
-        neighborHe = NULL;
-        isBoundary = false;
-        isActive = true;
-    }
+struct HalfEdgeArray {
+    vector<int> vertex;         // origin of the halfedge. this is also the index buffer of the triangles
+    vector<int> mate;           // NIL on boundary
+    vector<int> edge;
 };
 
+struct FaceArray {
+    vector<Real>   normal;      // 3 per face
+    vector<Real>   area;
+    vector<char>   isActive;
+};
 
-struct Face {
-    //VertexIter vertex[3];
-    HalfEdge   halfedge[3]; // circular list ex) halfedge[0].next == halfedge[1]
-
-    double normal[3];
-    double area;
-    int id;
-
-    bool isActive;
-
-    Face(){}
-    Face(VertexIter v0, VertexIter v1, VertexIter v2, int n){
-        halfedge[0].vertex = v0;
-        halfedge[1].vertex = v1;
-        halfedge[2].vertex = v2;
-        id = n;
-        isActive = true;
-    }
+struct EdgeArray {
+    vector<int>  halfedge;      // 2 per edge. if boundary edge, halfedge[2*e+1] == NIL
+    vector<char> isActive;
 };
 
 
@@ -99,27 +64,74 @@ class Mesh {
 protected:
 
     bool ReadOFFFile(char *filename);
+    bool ReadPLYFile(char *filename);
+    bool ReadOBJFile(char *filename);
+    bool ReadSTLFile(char *filename);
+    void MergeIdenticalVertices(vector<float> &corners);
+    void NormalizeCoordinates();
+    void WeldVertices();
+    void RemoveDegenerateFaces(int &n_degenerate, int &n_duplicate);
+    void ClusterVertices();
     void AddEdgeInfo();
-    void MakeCircularList(FaceIter &fi);
+    bool WriteOFFFile(char *filename);
+    bool WritePLYFile(char *filename);
 
 public:
-    
-    list<Vertex> vertices;
-    list<Face>   faces;
-    list<Edge>   edges;
+
+    VertexArray   vertices;
+    HalfEdgeArray halfedges;
+    FaceArray     faces;
+    EdgeArray     edges;
 
     int n_vertices, n_faces, n_edges;
 
+    // coordinates are normalized when read. original = normalized / normalizationScale + normalizationCenter
+    double normalizationCenter[3], normalizationScale;
+
+    // progress and counts are printed while reading. errors are printed either way.
+    // a Mesh shares nothing with other instances, so several can be read and simplified on different threads
+    bool isVerbose;
+
+    // set before ConstructMeshDataStructure to weld vertices closer than this fraction of the largest side of the
+    // bounding box, and remove the faces that become degenerate or duplicate (0: coincident vertices only).
+    // negative, the default, for no welding. what was removed is counted below
+    double weldEpsilon;
+    int    n_weldRemovedVertices, n_weldRemovedFaces;
+
+    // set before ConstructMeshDataStructure to bring a mesh of more faces down to about this many by vertex
+    // clustering (see cluster.cpp), after welding and before the connectivity is built. negative, the default,
+    // for none. what was removed is counted below
+    int    clusterFaces;
+    int    n_clusterRemovedVertices, n_clusterRemovedFaces;
+
 
     Mesh(){
         n_vertices = n_faces = n_edges = 0;
+        isVerbose  = true;
+
+        weldEpsilon = -1.0;
+        n_weldRemovedVertices = n_weldRemovedFaces = 0;
+
+        clusterFaces = -1;
+        n_clusterRemovedVertices = n_clusterRemovedFaces = 0;
+
+        normalizationCenter[0] = normalizationCenter[1] = normalizationCenter[2] = 0.0;
+        normalizationScale = 1.0;
     }
 
+    Real* VertexCoord(int v)  { return &vertices.coord[3*v]; }
+    Real* VertexNormal(int v) { return &vertices.normal[3*v]; }
+    Real* FaceNormal(int f)   { return &faces.normal[3*f]; }
+
     bool ConstructMeshDataStructure(char *filename);
-    void AssignFaceNormal(FaceIter &fi);
-    void AssignVertexNormal(VertexIter &vi);
+    bool ConstructMeshDataStructure(int n_vertices_in, const double *coord, int n_faces_in, const int *corner);
+    bool WriteMeshFile(char *filename);
+    void AssignFaceNormal(int f);
+    void AssignVertexNormal(int v);
     void Display(int mode);
 
+    size_t MemoryUsage();       // bytes of the element arrays
+
     //void Picking(int& x, int& y);
 };
 
@@ -132,7 +144,8 @@ extern void GetEdgeVector(double *v1, double *v2, double *edge_vector);
 extern void GetArea(double *normal, double &area);
 extern double GetDistance(double *a, double *b);
 extern double GetLength(double *a);
-extern void Swap(double &a, double &b);
-extern bool SolveLinearSystem(double (*matrix)[4], double *rhs, double *solution);
+extern double GetWallClockTime();
+extern void SleepMilliseconds(int milliseconds);
+extern long long GetAllocationCount();  // calls of operator new so far if built with MESH_COUNT_ALLOCATIONS, otherwise -1
 
 #define EPSILON 1.0e-6
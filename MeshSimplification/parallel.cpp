@@ -0,0 +1,57 @@
+#include "parallel.h"
+
+#define RADIX_BITS 11
+#define RADIX_SIZE (1 << RADIX_BITS)
+
+
+void RadixSort(vector<unsigned long long> &keys, vector<int> &values, int keyBits)
+{
+    int n = (int)keys.size();
+    int n_threads = omp_get_max_threads();
+
+    vector<unsigned long long> keysTmp(n);
+    vector<int>                valuesTmp(n);
+
+    // histogram[t*RADIX_SIZE + d]: number of keys with digit "d" in the part of thread "t",
+    // turned into the position of the first such key in the output by the prefix sum
+    vector<int> histogram(n_threads*RADIX_SIZE);
+
+    for(int shift = 0; shift < keyBits; shift += RADIX_BITS){
+
+        #pragma omp parallel num_threads(n_threads)
+        {
+            int begin, end;
+            GetThreadRange(n, begin, end);
+
+            int *count = &histogram[omp_get_thread_num()*RADIX_SIZE];
+
+            for(int d = 0; d < RADIX_SIZE; d++) count[d] = 0;
+            for(int i = begin; i < end; i++) count[(keys[i] >> shift) & (RADIX_SIZE-1)]++;
+
+            #pragma omp barrier
+            #pragma omp single
+            {
+                int nt = omp_get_num_threads();
+                int offset = 0;
+
+                for(int d = 0; d < RADIX_SIZE; d++){
+                    for(int t = 0; t < nt; t++){
+                        int c = histogram[t*RADIX_SIZE + d];
+                        histogram[t*RADIX_SIZE + d] = offset;
+                        offset += c;
+                    }
+                }
+            }
+
+            for(int i = begin; i < end; i++){
+                int pos = count[(keys[i] >> shift) & (RADIX_SIZE-1)]++;
+
+                keysTmp[pos]   = keys[i];
+                valuesTmp[pos] = values[i];
+            }
+        }
+
+        keys.swap(keysTmp);
+        values.swap(valuesTmp);
+    }
+}
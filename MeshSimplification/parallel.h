@@ -0,0 +1,31 @@
+#include <vector>
+using namespace std;
+
+// OpenMP is optional. without it the parallel regions run on a single thread.
+#ifdef _OPENMP
+#include <omp.h>
+#else
+inline int omp_get_thread_num()  { return 0; }
+inline int omp_get_num_threads() { return 1; }
+inline int omp_get_max_threads() { return 1; }
+
+typedef int omp_lock_t;
+inline void omp_init_lock(omp_lock_t *)    {}
+inline void omp_destroy_lock(omp_lock_t *) {}
+inline void omp_set_lock(omp_lock_t *)     {}
+inline void omp_unset_lock(omp_lock_t *)   {}
+#endif
+
+// range [begin, end) of "n" items handled by the calling thread of a parallel region
+inline void GetThreadRange(int n, int &begin, int &end)
+{
+    int t  = omp_get_thread_num();
+    int nt = omp_get_num_threads();
+
+    begin = (int)((long long)n *  t    / nt);
+    end   = (int)((long long)n * (t+1) / nt);
+}
+
+// stable LSD radix sort of "values" by "keys". both arrays are permuted.
+// only the lowest "keyBits" bits of the keys are considered
+extern void RadixSort(vector<unsigned long long> &keys, vector<int> &values, int keyBits);
@@ -0,0 +1,409 @@
+#include "mesh.h"
+#include "simplification.h"
+#include "parallel.h"
+#include "progressive.h"
+#include "fileio.h"
+#include "stats.h"
+#include <cstdio>
+#include <cmath>
+
+
+/////////////////////////////////////////////////////////////////////////////
+// writer
+/////////////////////////////////////////////////////////////////////////////
+
+static void WriteInt(FILE *fp, int value)
+{
+    fwrite(&value, sizeof(int), 1, fp);
+}
+
+static void WriteFloat3(FILE *fp, const Real *value)
+{
+    float v[3] = { (float)value[0], (float)value[1], (float)value[2] };
+    fwrite(v, sizeof(float), 3, fp);
+}
+
+bool Simplification::WriteProgressiveMesh(const char *filename)
+{
+    if(isSelective){
+        cerr << "WriteProgressiveMesh: end the selective refinement first" << endl;
+        return false;
+    }
+
+    STAT_TIMER(PHASE_WRITE);
+
+    vector<int> &heVertex     = mesh->halfedges.vertex;
+    vector<int> &heMate       = mesh->halfedges.mate;
+    vector<int> &edgeHalfEdge = mesh->edges.halfedge;
+
+    FILE *fp = fopen(filename, "wb");
+
+    if(fp == NULL){
+        cerr << "cannot open " << filename << endl;
+        return false;
+    }
+
+    // ids in the file. the current mesh is the base mesh, numbered in index order.
+    // every vertex split then adds one vertex and one or two faces, numbered in the order of the splits
+    vector<int> vertexId(mesh->n_vertices, NIL);
+    vector<int> faceId(mesh->n_faces, NIL);
+
+    int n_baseVertices = 0, n_baseFaces = 0;
+
+    for(int v = 0; v < mesh->n_vertices; v++) if(mesh->vertices.isActive[v]) vertexId[v] = n_baseVertices++;
+    for(int f = 0; f < mesh->n_faces;    f++) if(mesh->faces.isActive[f])    faceId[f]   = n_baseFaces++;
+
+    // the splits are the collapses applied to the mesh now. the finest mesh is the input,
+    // unless the oldest collapses were dropped from the history
+    int n_splits      = history.Cursor();
+    int n_finestFaces = history.FacesAt(0);
+
+    fwrite(PM_MAGIC, 1, 4, fp);
+    WriteInt(fp, n_baseVertices);
+    WriteInt(fp, n_baseFaces);
+    WriteInt(fp, n_splits);
+    WriteInt(fp, n_baseVertices + n_splits);
+    WriteInt(fp, n_finestFaces);
+
+    for(int v = 0; v < mesh->n_vertices; v++){
+        if(mesh->vertices.isActive[v]) WriteFloat3(fp, mesh->VertexCoord(v));
+    }
+
+    for(int f = 0; f < mesh->n_faces; f++){
+        if(mesh->faces.isActive[f]){
+            for(int i = 0; i < 3; i++) WriteInt(fp, vertexId[heVertex[3*f+i]]);
+        }
+    }
+
+    // The split records are the collapse history from the most recent collapse backwards.
+    // Halfedges of collapsed faces are not modified while the faces are inactive, so the
+    // connectivity each split restores can be read from the mesh as it is now
+    int n_vertices = n_baseVertices, n_faces = n_baseFaces;
+
+    for(int k = n_splits - 1; k >= 0; k--){
+        VertexSplitTarget &vst = collapseRecord;
+        history.Get(k, vst);
+
+        int hepCollapsed = edgeHalfEdge[2*vst.edge];
+        int hepMate      = heMate[hepCollapsed];
+
+        int v0 = heVertex[hepCollapsed];
+        int v1 = heVertex[NextHalfEdge(hepCollapsed)];
+
+        vertexId[v0] = n_vertices++;
+
+        int newFaces[2] = { FaceOfHalfEdge(hepCollapsed), (hepMate != NIL) ? FaceOfHalfEdge(hepMate) : NIL };
+        int n_newFaces  = (hepMate != NIL) ? 2 : 1;
+
+        for(int i = 0; i < n_newFaces; i++) faceId[newFaces[i]] = n_faces++;
+
+        WriteInt(fp, vertexId[v1]);
+        WriteFloat3(fp, mesh->VertexCoord(v0));
+        WriteFloat3(fp, vst.v1OrginalCoord);
+
+        WriteInt(fp, n_newFaces);
+        for(int i = 0; i < n_newFaces; i++){
+            for(int j = 0; j < 3; j++) WriteInt(fp, vertexId[heVertex[3*newFaces[i]+j]]);
+        }
+
+        WriteInt(fp, (int)vst.halfedgesAroundV0.size());
+        for(unsigned int i = 0; i < vst.halfedgesAroundV0.size(); i++){
+            int hep = vst.halfedgesAroundV0[i];
+
+            WriteInt(fp, 3*faceId[FaceOfHalfEdge(hep)] + hep % 3);
+        }
+    }
+
+    bool isWritten = (ferror(fp) == 0);
+    fclose(fp);
+
+    if(isWritten == false){
+        cerr << "cannot write " << filename << endl;
+        return false;
+    }
+
+    cerr << "progressive mesh written: " << n_baseVertices << " base vertices, " << n_splits << " vertex splits\n";
+
+    return true;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// reader
+/////////////////////////////////////////////////////////////////////////////
+
+bool ProgressiveMesh::Read(const char *filename)
+{
+    MappedFile file;
+
+    if( file.Open(filename) == false ){
+        cerr << "file cannot be read.\n";
+        return false;
+    }
+
+    const int *p   = (const int*)(file.data + 4);
+    const int *end = (const int*)(file.data + (file.size & ~(size_t)3));
+
+    if(file.size < 24 || memcmp(file.data, PM_MAGIC, 4) != 0){
+        cerr << "not a progressive mesh file.\n";
+        return false;
+    }
+
+    n_baseVertices = p[0];
+    n_baseFaces    = p[1];
+    n_records      = p[2];
+
+    int n_allVertices = p[3], n_allFaces = p[4];
+    p += 5;
+
+    if(n_baseVertices < 0 || n_baseFaces < 0 || n_records < 0 ||
+       n_allVertices != n_baseVertices + n_records || n_allFaces < n_baseFaces ||
+       end - p < 3*(long long)n_baseVertices + 3*(long long)n_baseFaces){
+        cerr << "broken progressive mesh header.\n";
+        return false;
+    }
+
+    coord.resize(3*n_allVertices);
+    normal.resize(3*n_allVertices);
+    corner.resize(3*n_allFaces);
+
+    if(n_baseVertices > 0) memcpy(&coord[0],  p, 3*n_baseVertices*sizeof(float));
+    p += 3*n_baseVertices;
+
+    if(n_baseFaces > 0) memcpy(&corner[0], p, 3*n_baseFaces*sizeof(int));
+    p += 3*n_baseFaces;
+
+    for(int i = 0; i < 3*n_baseFaces; i++){
+        if(corner[i] < 0 || corner[i] >= n_baseVertices){
+            cerr << "vertex index out of range.\n";
+            return false;
+        }
+    }
+
+    // copy the records, checking that every id refers to a vertex or face that exists when the record is applied
+    records.clear();
+    recordBegin.resize(n_records+1);
+    recordCoord.resize(6*n_records);
+    coarseCoord.resize(3*n_records);
+
+    int n_currentVertices = n_baseVertices, n_currentFaces = n_baseFaces;
+
+    for(int k = 0; k < n_records; k++){
+        recordBegin[k] = (int)records.size();
+
+        if(end - p < 8){
+            cerr << "unexpected end of file.\n";
+            return false;
+        }
+
+        int vs = p[0];
+        memcpy(&recordCoord[6*k], p+1, 6*sizeof(float));
+        int n_newFaces = p[7];
+        p += 8;
+
+        if(vs < 0 || vs >= n_currentVertices || n_newFaces < 1 || n_newFaces > 2 || end - p < 3*n_newFaces + 1){
+            cerr << "broken vertex split record " << k << endl;
+            return false;
+        }
+
+        n_currentVertices++;
+
+        records.push_back(vs);
+        records.push_back(n_newFaces);
+
+        for(int i = 0; i < 3*n_newFaces; i++){
+            if(p[i] < 0 || p[i] >= n_currentVertices){
+                cerr << "broken vertex split record " << k << endl;
+                return false;
+            }
+            records.push_back(p[i]);
+        }
+        p += 3*n_newFaces;
+
+        n_currentFaces += n_newFaces;
+
+        int n_moved = *p++;
+
+        if(n_moved < 0 || end - p < n_moved){
+            cerr << "broken vertex split record " << k << endl;
+            return false;
+        }
+
+        records.push_back(n_moved);
+
+        for(int i = 0; i < n_moved; i++){
+            if(p[i] < 0 || p[i] >= 3*n_currentFaces){
+                cerr << "broken vertex split record " << k << endl;
+                return false;
+            }
+            records.push_back(p[i]);
+        }
+        p += n_moved;
+    }
+
+    recordBegin[n_records] = (int)records.size();
+
+    if(n_currentFaces != n_allFaces){
+        cerr << "broken progressive mesh header.\n";
+        return false;
+    }
+
+    n_vertices = n_baseVertices;
+    n_faces    = n_baseFaces;
+    n_splits   = 0;
+
+    ComputeVertexNormals();
+
+    cerr << "# of base vertices  " << n_baseVertices << endl;
+    cerr << "# of base faces     " << n_baseFaces    << endl;
+    cerr << "# of vertex splits  " << n_records      << endl;
+
+    return true;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// level of detail
+/////////////////////////////////////////////////////////////////////////////
+
+bool ProgressiveMesh::Refine()
+{
+    if(n_splits == n_records) return false;
+
+    const int   *r      = &records[recordBegin[n_splits]];
+    const float *coords = &recordCoord[6*n_splits];
+
+    int vs = r[0];
+    int vt = n_vertices++;
+
+    for(int i = 0; i < 3; i++){
+        coarseCoord[3*n_splits+i] = coord[3*vs+i];
+        coord[3*vt+i] = coords[i];
+        coord[3*vs+i] = coords[3+i];
+    }
+
+    int n_newFaces = r[1];
+    r += 2;
+
+    for(int i = 0; i < 3*n_newFaces; i++) corner[3*n_faces+i] = r[i];
+    n_faces += n_newFaces;
+    r += 3*n_newFaces;
+
+    int n_moved = *r++;
+    for(int i = 0; i < n_moved; i++) corner[r[i]] = vt;
+
+    n_splits++;
+
+    return true;
+}
+
+bool ProgressiveMesh::Coarsen()
+{
+    if(n_splits == 0) return false;
+
+    n_splits--;
+
+    const int *r = &records[recordBegin[n_splits]];
+
+    int vs = r[0];
+    n_vertices--;
+
+    for(int i = 0; i < 3; i++) coord[3*vs+i] = coarseCoord[3*n_splits+i];
+
+    int n_newFaces = r[1];
+    r += 2 + 3*n_newFaces;
+
+    n_faces -= n_newFaces;
+
+    int n_moved = *r++;
+    for(int i = 0; i < n_moved; i++) corner[r[i]] = vs;
+
+    return true;
+}
+
+void ProgressiveMesh::SetNumberOfSplits(int n)
+{
+    if(n < 0)         n = 0;
+    if(n > n_records) n = n_records;
+
+    while(n_splits < n) Refine();
+    while(n_splits > n) Coarsen();
+
+    ComputeVertexNormals();
+}
+
+void ProgressiveMesh::SetNumberOfFaces(int n_target_faces)
+{
+    while(n_faces < n_target_faces){
+        if(Refine() == false) break;
+    }
+
+    while(n_faces > n_target_faces && n_splits > 0){
+        // do not go below the target
+        int n_newFaces = records[recordBegin[n_splits-1] + 1];
+        if(n_faces - n_newFaces < n_target_faces) break;
+
+        Coarsen();
+    }
+
+    ComputeVertexNormals();
+}
+
+void ProgressiveMesh::ComputeVertexNormals()
+{
+    for(int i = 0; i < 3*n_vertices; i++) normal[i] = 0.0f;
+
+    // area weighted sum of face normals
+    for(int f = 0; f < n_faces; f++){
+        const float *a = &coord[3*corner[3*f  ]];
+        const float *b = &coord[3*corner[3*f+1]];
+        const float *c = &coord[3*corner[3*f+2]];
+
+        float ab[3] = { b[0]-a[0], b[1]-a[1], b[2]-a[2] };
+        float ac[3] = { c[0]-a[0], c[1]-a[1], c[2]-a[2] };
+
+        float n[3] = { ab[1]*ac[2] - ab[2]*ac[1],
+                       ab[2]*ac[0] - ab[0]*ac[2],
+                       ab[0]*ac[1] - ab[1]*ac[0] };
+
+        for(int i = 0; i < 3; i++){
+            float *vn = &normal[3*corner[3*f+i]];
+            vn[0] += n[0];  vn[1] += n[1];  vn[2] += n[2];
+        }
+    }
+
+    for(int v = 0; v < n_vertices; v++){
+        float *vn = &normal[3*v];
+        float length = sqrt(vn[0]*vn[0] + vn[1]*vn[1] + vn[2]*vn[2]);
+
+        if(length > 0.0f){
+            vn[0] /= length;  vn[1] /= length;  vn[2] /= length;
+        }
+    }
+}
+
+bool Simplification::WriteCollapseLog(const char *filename)
+{
+    if(isSelective){
+        cerr << "WriteCollapseLog: end the selective refinement first" << endl;
+        return false;
+    }
+
+    FILE *fp = fopen(filename, "w");
+
+    if(fp == NULL){
+        cerr << "cannot open " << filename << endl;
+        return false;
+    }
+
+    for(int i = 0; i < history.Cursor(); i++){
+        int e   = history.Edge(i);
+        int hep = mesh->edges.halfedge[2*e];
+
+        fprintf(fp, "%d %d %d\n", e, mesh->halfedges.vertex[hep], mesh->halfedges.vertex[NextHalfEdge(hep)]);
+    }
+
+    fclose(fp);
+
+    return true;
+}
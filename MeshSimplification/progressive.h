@@ -0,0 +1,53 @@
+#include <vector>
+using namespace std;
+
+// Progressive mesh (.pm) file, written by Simplification::WriteProgressiveMesh.
+// All values are 32-bit and in the byte order of the machine that wrote the file (little endian on x86).
+//
+//   "PM01"
+//   int   n_baseVertices, n_baseFaces, n_records, n_vertices, n_faces   (the last two are of the finest mesh)
+//   float coord[3*n_baseVertices]
+//   int   corner[3*n_baseFaces]                vertices of each face
+//   n_records vertex split records, coarse to fine:
+//     int   vs                                 vertex to be split
+//     float vtCoord[3]                         coordinate of the new vertex vt, whose id is the current # of vertices
+//     float vsCoord[3]                         new coordinate of vs
+//     int   n_newFaces                         1 (on boundary) or 2
+//     int   newCorner[3*n_newFaces]            vertices of the new faces, appended to the faces
+//     int   n_moved
+//     int   moved[n_moved]                     corners (3*face+i) that change from vs to vt
+//
+// Records refer to vertices and faces only by their ids, so a prefix of them can be applied to
+// the base mesh without any connectivity information.
+
+#define PM_MAGIC "PM01"
+
+class ProgressiveMesh {
+    vector<int>   records;      // int fields of all records, except the coordinates
+    vector<int>   recordBegin;  // the k-th record starts at records[recordBegin[k]]
+    vector<float> recordCoord;  // 6 per record: vtCoord and vsCoord
+    vector<float> coarseCoord;  // 3 per record: coordinate of vs before the split, to undo it
+
+public:
+    vector<float> coord;        // 3 per vertex, allocated for the finest mesh
+    vector<float> normal;       // 3 per vertex
+    vector<int>   corner;       // 3 per face,   allocated for the finest mesh
+
+    int n_baseVertices, n_baseFaces, n_records;
+    int n_vertices, n_faces, n_splits; // current level
+
+    ProgressiveMesh(){
+        n_baseVertices = n_baseFaces = n_records = 0;
+        n_vertices = n_faces = n_splits = 0;
+    }
+
+    bool Read(const char *filename);
+
+    bool Refine();   // apply the next vertex split
+    bool Coarsen();  // undo the last vertex split
+    void SetNumberOfSplits(int n);
+    void SetNumberOfFaces(int n_target_faces);
+
+    void ComputeVertexNormals();
+    void Display(int mode);
+};
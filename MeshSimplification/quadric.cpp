@@ -0,0 +1,335 @@
+#include "mesh.h"
+#include "quadric.h"
+#include <cmath>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define QUADRIC_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// gcc and clang compile a function with AVX instructions only if it is marked for that target
+#if defined(QUADRIC_X86) && defined(__GNUC__)
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX  __attribute__((target("avx")))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX
+#endif
+
+
+/////////////////////////////////////////////////////////////////////////////
+// scalar kernels. the SIMD kernels perform exactly the same operations in the same order
+/////////////////////////////////////////////////////////////////////////////
+
+static void AddQuadricScalar(double *sum, const double *q)
+{
+    for(int i = 0; i < QUADRIC_SIZE; i++) sum[i] += q[i];
+}
+
+double EvaluateQuadric(const double *s, const double *x)
+{
+    double t0 = s[0]*x[0] + s[1]*x[1] + s[2]*x[2] + s[3];
+    double t1 = s[1]*x[0] + s[4]*x[1] + s[5]*x[2] + s[6];
+    double t2 = s[2]*x[0] + s[5]*x[1] + s[7]*x[2] + s[8];
+    double t3 = s[3]*x[0] + s[6]*x[1] + s[8]*x[2] + s[9];
+
+    return x[0]*t0 + x[1]*t1 + x[2]*t2 + t3;
+}
+
+// singular case: the best of the two ends and the midpoint
+static void ComputeFallbackCollapse(const double *s, const QuadricCollapse &collapse, double *optimalCoord, double &cost)
+{
+    double candidate[3][3];
+
+    for(int i = 0; i < 3; i++){
+        candidate[0][i] = collapse.coord1[i];
+        candidate[1][i] = collapse.coord0[i];
+        candidate[2][i] = ((double)collapse.coord0[i] + collapse.coord1[i]) * 0.5;
+    }
+
+    int best = 0;
+    cost = EvaluateQuadric(s, candidate[0]);
+
+    for(int k = 1; k < 3; k++){
+        double c = EvaluateQuadric(s, candidate[k]);
+        if(c < cost){
+            cost = c;
+            best = k;
+        }
+    }
+
+    for(int i = 0; i < 3; i++) optimalCoord[i] = candidate[best][i];
+}
+
+static void ComputeQuadricCollapseScalar(const QuadricCollapse &collapse, double *optimalCoord, double &cost)
+{
+    double s[QUADRIC_SIZE];
+    for(int i = 0; i < QUADRIC_SIZE; i++) s[i] = collapse.q0[i] + collapse.q1[i];
+
+    // cofactors of the symmetric 3x3 part
+    double c00 = s[4]*s[7] - s[5]*s[5];
+    double c01 = s[2]*s[5] - s[1]*s[7];
+    double c02 = s[1]*s[5] - s[2]*s[4];
+    double c11 = s[0]*s[7] - s[2]*s[2];
+    double c12 = s[1]*s[2] - s[0]*s[5];
+    double c22 = s[0]*s[4] - s[1]*s[1];
+
+    double det   = s[0]*c00 + s[1]*c01 + s[2]*c02;
+    double trace = s[0] + s[4] + s[7];
+
+    // also catches NaN
+    if( !(fabs(det) > QUADRIC_SINGULAR_EPSILON * trace*trace*trace) ){
+        ComputeFallbackCollapse(s, collapse, optimalCoord, cost);
+        return;
+    }
+
+    double r = -1.0 / det;
+
+    optimalCoord[0] = (c00*s[3] + c01*s[6] + c02*s[8]) * r;
+    optimalCoord[1] = (c01*s[3] + c11*s[6] + c12*s[8]) * r;
+    optimalCoord[2] = (c02*s[3] + c12*s[6] + c22*s[8]) * r;
+
+    cost = EvaluateQuadric(s, optimalCoord);
+}
+
+static void ComputeQuadricCollapsesScalar(int n, const QuadricCollapse *collapse, double *optimalCoord, double *cost)
+{
+    for(int i = 0; i < n; i++) ComputeQuadricCollapseScalar(collapse[i], &optimalCoord[3*i], cost[i]);
+}
+
+
+#ifdef QUADRIC_X86
+
+/////////////////////////////////////////////////////////////////////////////
+// SSE2: two collapses at a time
+/////////////////////////////////////////////////////////////////////////////
+
+TARGET_SSE2 static void AddQuadricSSE2(double *sum, const double *q)
+{
+    for(int i = 0; i < QUADRIC_SIZE; i += 2){
+        _mm_storeu_pd(sum+i, _mm_add_pd(_mm_loadu_pd(sum+i), _mm_loadu_pd(q+i)));
+    }
+}
+
+TARGET_SSE2 static void ComputeQuadricCollapsesSSE2(int n, const QuadricCollapse *collapse, double *optimalCoord, double *cost)
+{
+    int i = 0;
+
+    for(; i + 2 <= n; i += 2){
+        const QuadricCollapse &a = collapse[i], &b = collapse[i+1];
+
+        // one lane per collapse
+        __m128d s[QUADRIC_SIZE];
+        for(int k = 0; k < QUADRIC_SIZE; k++){
+            s[k] = _mm_add_pd(_mm_set_pd(b.q0[k], a.q0[k]), _mm_set_pd(b.q1[k], a.q1[k]));
+        }
+
+        __m128d c00 = _mm_sub_pd(_mm_mul_pd(s[4], s[7]), _mm_mul_pd(s[5], s[5]));
+        __m128d c01 = _mm_sub_pd(_mm_mul_pd(s[2], s[5]), _mm_mul_pd(s[1], s[7]));
+        __m128d c02 = _mm_sub_pd(_mm_mul_pd(s[1], s[5]), _mm_mul_pd(s[2], s[4]));
+        __m128d c11 = _mm_sub_pd(_mm_mul_pd(s[0], s[7]), _mm_mul_pd(s[2], s[2]));
+        __m128d c12 = _mm_sub_pd(_mm_mul_pd(s[1], s[2]), _mm_mul_pd(s[0], s[5]));
+        __m128d c22 = _mm_sub_pd(_mm_mul_pd(s[0], s[4]), _mm_mul_pd(s[1], s[1]));
+
+        __m128d det   = _mm_add_pd(_mm_add_pd(_mm_mul_pd(s[0], c00), _mm_mul_pd(s[1], c01)), _mm_mul_pd(s[2], c02));
+        __m128d trace = _mm_add_pd(_mm_add_pd(s[0], s[4]), s[7]);
+
+        __m128d absDet    = _mm_andnot_pd(_mm_set1_pd(-0.0), det);
+        __m128d threshold = _mm_mul_pd(_mm_mul_pd(_mm_mul_pd(_mm_set1_pd(QUADRIC_SINGULAR_EPSILON), trace), trace), trace);
+        int isRegular     = _mm_movemask_pd(_mm_cmpgt_pd(absDet, threshold));
+
+        __m128d r = _mm_div_pd(_mm_set1_pd(-1.0), det);
+
+        __m128d x0 = _mm_mul_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(c00, s[3]), _mm_mul_pd(c01, s[6])), _mm_mul_pd(c02, s[8])), r);
+        __m128d x1 = _mm_mul_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(c01, s[3]), _mm_mul_pd(c11, s[6])), _mm_mul_pd(c12, s[8])), r);
+        __m128d x2 = _mm_mul_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(c02, s[3]), _mm_mul_pd(c12, s[6])), _mm_mul_pd(c22, s[8])), r);
+
+        __m128d t0 = _mm_add_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(s[0], x0), _mm_mul_pd(s[1], x1)), _mm_mul_pd(s[2], x2)), s[3]);
+        __m128d t1 = _mm_add_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(s[1], x0), _mm_mul_pd(s[4], x1)), _mm_mul_pd(s[5], x2)), s[6]);
+        __m128d t2 = _mm_add_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(s[2], x0), _mm_mul_pd(s[5], x1)), _mm_mul_pd(s[7], x2)), s[8]);
+        __m128d t3 = _mm_add_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(s[3], x0), _mm_mul_pd(s[6], x1)), _mm_mul_pd(s[8], x2)), s[9]);
+
+        __m128d c = _mm_add_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(x0, t0), _mm_mul_pd(x1, t1)), _mm_mul_pd(x2, t2)), t3);
+
+        double lane[4][2];
+        _mm_storeu_pd(lane[0], x0);
+        _mm_storeu_pd(lane[1], x1);
+        _mm_storeu_pd(lane[2], x2);
+        _mm_storeu_pd(lane[3], c);
+
+        for(int j = 0; j < 2; j++){
+            if(isRegular & (1 << j)){
+                for(int k = 0; k < 3; k++) optimalCoord[3*(i+j)+k] = lane[k][j];
+                cost[i+j] = lane[3][j];
+            }else{
+                ComputeQuadricCollapseScalar(collapse[i+j], &optimalCoord[3*(i+j)], cost[i+j]);
+            }
+        }
+    }
+
+    ComputeQuadricCollapsesScalar(n - i, collapse + i, optimalCoord + 3*i, cost + i);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// AVX: four collapses at a time
+/////////////////////////////////////////////////////////////////////////////
+
+TARGET_AVX static void AddQuadricAVX(double *sum, const double *q)
+{
+    _mm256_storeu_pd(sum,   _mm256_add_pd(_mm256_loadu_pd(sum),   _mm256_loadu_pd(q)));
+    _mm256_storeu_pd(sum+4, _mm256_add_pd(_mm256_loadu_pd(sum+4), _mm256_loadu_pd(q+4)));
+    _mm_storeu_pd   (sum+8, _mm_add_pd   (_mm_loadu_pd   (sum+8), _mm_loadu_pd   (q+8)));
+}
+
+TARGET_AVX static void ComputeQuadricCollapsesAVX(int n, const QuadricCollapse *collapse, double *optimalCoord, double *cost)
+{
+    int i = 0;
+
+    for(; i + 4 <= n; i += 4){
+        const QuadricCollapse *c4 = collapse + i;
+
+        // one lane per collapse
+        __m256d s[QUADRIC_SIZE];
+        for(int k = 0; k < QUADRIC_SIZE; k++){
+            s[k] = _mm256_add_pd(_mm256_set_pd(c4[3].q0[k], c4[2].q0[k], c4[1].q0[k], c4[0].q0[k]),
+                                 _mm256_set_pd(c4[3].q1[k], c4[2].q1[k], c4[1].q1[k], c4[0].q1[k]));
+        }
+
+        __m256d c00 = _mm256_sub_pd(_mm256_mul_pd(s[4], s[7]), _mm256_mul_pd(s[5], s[5]));
+        __m256d c01 = _mm256_sub_pd(_mm256_mul_pd(s[2], s[5]), _mm256_mul_pd(s[1], s[7]));
+        __m256d c02 = _mm256_sub_pd(_mm256_mul_pd(s[1], s[5]), _mm256_mul_pd(s[2], s[4]));
+        __m256d c11 = _mm256_sub_pd(_mm256_mul_pd(s[0], s[7]), _mm256_mul_pd(s[2], s[2]));
+        __m256d c12 = _mm256_sub_pd(_mm256_mul_pd(s[1], s[2]), _mm256_mul_pd(s[0], s[5]));
+        __m256d c22 = _mm256_sub_pd(_mm256_mul_pd(s[0], s[4]), _mm256_mul_pd(s[1], s[1]));
+
+        __m256d det   = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(s[0], c00), _mm256_mul_pd(s[1], c01)), _mm256_mul_pd(s[2], c02));
+        __m256d trace = _mm256_add_pd(_mm256_add_pd(s[0], s[4]), s[7]);
+
+        __m256d absDet    = _mm256_andnot_pd(_mm256_set1_pd(-0.0), det);
+        __m256d threshold = _mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(_mm256_set1_pd(QUADRIC_SINGULAR_EPSILON), trace), trace), trace);
+        int isRegular     = _mm256_movemask_pd(_mm256_cmp_pd(absDet, threshold, _CMP_GT_OQ));
+
+        __m256d r = _mm256_div_pd(_mm256_set1_pd(-1.0), det);
+
+        __m256d x0 = _mm256_mul_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(c00, s[3]), _mm256_mul_pd(c01, s[6])), _mm256_mul_pd(c02, s[8])), r);
+        __m256d x1 = _mm256_mul_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(c01, s[3]), _mm256_mul_pd(c11, s[6])), _mm256_mul_pd(c12, s[8])), r);
+        __m256d x2 = _mm256_mul_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(c02, s[3]), _mm256_mul_pd(c12, s[6])), _mm256_mul_pd(c22, s[8])), r);
+
+        __m256d t0 = _mm256_add_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(s[0], x0), _mm256_mul_pd(s[1], x1)), _mm256_mul_pd(s[2], x2)), s[3]);
+        __m256d t1 = _mm256_add_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(s[1], x0), _mm256_mul_pd(s[4], x1)), _mm256_mul_pd(s[5], x2)), s[6]);
+        __m256d t2 = _mm256_add_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(s[2], x0), _mm256_mul_pd(s[5], x1)), _mm256_mul_pd(s[7], x2)), s[8]);
+        __m256d t3 = _mm256_add_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(s[3], x0), _mm256_mul_pd(s[6], x1)), _mm256_mul_pd(s[8], x2)), s[9]);
+
+        __m256d c = _mm256_add_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(x0, t0), _mm256_mul_pd(x1, t1)), _mm256_mul_pd(x2, t2)), t3);
+
+        double lane[4][4];
+        _mm256_storeu_pd(lane[0], x0);
+        _mm256_storeu_pd(lane[1], x1);
+        _mm256_storeu_pd(lane[2], x2);
+        _mm256_storeu_pd(lane[3], c);
+
+        for(int j = 0; j < 4; j++){
+            if(isRegular & (1 << j)){
+                for(int k = 0; k < 3; k++) optimalCoord[3*(i+j)+k] = lane[k][j];
+                cost[i+j] = lane[3][j];
+            }else{
+                ComputeQuadricCollapseScalar(collapse[i+j], &optimalCoord[3*(i+j)], cost[i+j]);
+            }
+        }
+    }
+
+    ComputeQuadricCollapsesSSE2(n - i, collapse + i, optimalCoord + 3*i, cost + i);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// CPU features
+/////////////////////////////////////////////////////////////////////////////
+
+static void CPUID(int leaf, unsigned int *reg)
+{
+#ifdef _MSC_VER
+    int r[4];
+    __cpuid(r, leaf);
+    for(int i = 0; i < 4; i++) reg[i] = (unsigned int)r[i];
+#else
+    __asm__ __volatile__ ("cpuid" : "=a"(reg[0]), "=b"(reg[1]), "=c"(reg[2]), "=d"(reg[3]) : "a"(leaf), "c"(0));
+#endif
+}
+
+static int DetectQuadricKernel()
+{
+    unsigned int reg[4];
+    CPUID(0, reg);
+    if(reg[0] < 1) return QUADRIC_KERNEL_SCALAR;
+
+    CPUID(1, reg);
+
+    bool hasSSE2    = (reg[3] & (1u << 26)) != 0;
+    bool hasAVX     = (reg[2] & (1u << 28)) != 0;
+    bool hasOSXSAVE = (reg[2] & (1u << 27)) != 0;
+
+    // AVX also needs the OS to save the upper halves of the ymm registers
+    if(hasAVX && hasOSXSAVE){
+        unsigned int xcr0;
+#ifdef _MSC_VER
+        xcr0 = (unsigned int)_xgetbv(0);
+#else
+        unsigned int edx;
+        __asm__ __volatile__ ("xgetbv" : "=a"(xcr0), "=d"(edx) : "c"(0));
+#endif
+        if((xcr0 & 6) == 6) return QUADRIC_KERNEL_AVX;
+    }
+
+    return hasSSE2 ? QUADRIC_KERNEL_SSE2 : QUADRIC_KERNEL_SCALAR;
+}
+
+#else
+
+static int DetectQuadricKernel()
+{
+    return QUADRIC_KERNEL_SCALAR;
+}
+
+#endif // QUADRIC_X86
+
+
+/////////////////////////////////////////////////////////////////////////////
+// dispatch
+/////////////////////////////////////////////////////////////////////////////
+
+static int supportedQuadricKernel = DetectQuadricKernel();
+static int quadricKernel          = supportedQuadricKernel;
+
+int GetQuadricKernel()
+{
+    return quadricKernel;
+}
+
+void SetQuadricKernel(int kernel)
+{
+    quadricKernel = (kernel < supportedQuadricKernel) ? kernel : supportedQuadricKernel;
+}
+
+void AddQuadric(double *sum, const double *q)
+{
+#ifdef QUADRIC_X86
+    if(quadricKernel == QUADRIC_KERNEL_AVX)  { AddQuadricAVX (sum, q); return; }
+    if(quadricKernel == QUADRIC_KERNEL_SSE2) { AddQuadricSSE2(sum, q); return; }
+#endif
+    AddQuadricScalar(sum, q);
+}
+
+void ComputeQuadricCollapses(int n, const QuadricCollapse *collapse, double *optimalCoord, double *cost)
+{
+#ifdef QUADRIC_X86
+    if(quadricKernel == QUADRIC_KERNEL_AVX)  { ComputeQuadricCollapsesAVX (n, collapse, optimalCoord, cost); return; }
+    if(quadricKernel == QUADRIC_KERNEL_SSE2) { ComputeQuadricCollapsesSSE2(n, collapse, optimalCoord, cost); return; }
+#endif
+    ComputeQuadricCollapsesScalar(n, collapse, optimalCoord, cost);
+}
@@ -0,0 +1,36 @@
+// Quadric error metric of Garland and Heckbert.
+// A quadric is a symmetric 4x4 matrix stored as its upper triangle in 10 doubles:
+//
+//   q[0] q[1] q[2] q[3]
+//        q[4] q[5] q[6]
+//             q[7] q[8]
+//                  q[9]
+//
+// and the error of a point x is [x 1] Q [x 1]^T.
+// Vertex coordinates are "Real" (see mesh.h), everything else is double.
+
+#define QUADRIC_SIZE 10
+
+// the 3x3 part of q0+q1 is taken as singular if |det| <= QUADRIC_SINGULAR_EPSILON * trace^3
+#define QUADRIC_SINGULAR_EPSILON 1.0e-9
+
+// one edge collapse: quadrics and coordinates of the two vertices of the edge
+struct QuadricCollapse {
+    const double *q0, *q1;
+    const Real   *coord0, *coord1;
+};
+
+extern void   AddQuadric(double *sum, const double *q);            // sum += q
+extern double EvaluateQuadric(const double *q, const double *x);
+
+// For each collapse, the point that minimizes the error of q0+q1 (3 doubles per collapse in "optimalCoord")
+// and its error. The 3x3 system is solved in closed form. If it is (nearly) singular, the best of coord0,
+// coord1 and their midpoint is taken instead.
+// Every kernel gives bit-identical results, so the simplification does not depend on the CPU
+extern void   ComputeQuadricCollapses(int n, const QuadricCollapse *collapse, double *optimalCoord, double *cost);
+
+// kernels of AddQuadric and ComputeQuadricCollapses. the best one the CPU supports is chosen at startup
+enum { QUADRIC_KERNEL_SCALAR, QUADRIC_KERNEL_SSE2, QUADRIC_KERNEL_AVX };
+
+extern int  GetQuadricKernel();
+extern void SetQuadricKernel(int kernel);  // falls back to a kernel the CPU supports
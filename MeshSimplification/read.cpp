@@ -1,11 +1,60 @@
 
 
 #include "mesh.h"
+#include "parallel.h"
+#include "fileio.h"
+#include "stats.h"
+#include <algorithm>
+#include <cmath>
 #include <cstdio>
 
 bool Mesh::ConstructMeshDataStructure(char *filename)
 {
-    if( ReadOFFFile(filename) == false ) return false;
+    // choose the reader by the file extension. every reader fills "vertices.coord" and "halfedges.vertex"
+    const char *extension = strrchr(filename, '.');
+
+    bool isRead;
+
+    {
+        STAT_TIMER(PHASE_READ);
+
+        if     ( extension != NULL && HasExtension(extension, ".ply") ) isRead = ReadPLYFile(filename);
+        else if( extension != NULL && HasExtension(extension, ".obj") ) isRead = ReadOBJFile(filename);
+        else if( extension != NULL && HasExtension(extension, ".stl") ) isRead = ReadSTLFile(filename);
+        else                                                            isRead = ReadOFFFile(filename);
+    }
+
+    if( isRead == false ) return false;
+
+    NormalizeCoordinates();
+    if(weldEpsilon >= 0.0) WeldVertices();
+    if(clusterFaces >= 0 && n_faces > clusterFaces) ClusterVertices();
+    AddEdgeInfo();
+
+    return true;
+}
+
+// a mesh given as arrays rather than a file. "coord" has 3 values per vertex, "corner" 3 vertex indices per triangle
+bool Mesh::ConstructMeshDataStructure(int n_vertices_in, const double *coord, int n_faces_in, const int *corner)
+{
+    if(n_vertices_in <= 0 || n_faces_in <= 0) return false;
+
+    for(int i = 0; i < 3*n_faces_in; i++){
+        if(corner[i] < 0 || corner[i] >= n_vertices_in){
+            cerr << "vertex index out of range.\n";
+            return false;
+        }
+    }
+
+    n_vertices = n_vertices_in;
+    n_faces    = n_faces_in;
+
+    vertices.coord.assign(coord, coord + 3*n_vertices);
+    halfedges.vertex.assign(corner, corner + 3*n_faces);
+
+    NormalizeCoordinates();
+    if(weldEpsilon >= 0.0) WeldVertices();
+    if(clusterFaces >= 0 && n_faces > clusterFaces) ClusterVertices();
     AddEdgeInfo();
 
     return true;
@@ -13,61 +62,213 @@ bool Mesh::ConstructMeshDataStructure(char *filename)
 
 bool Mesh::ReadOFFFile(char *filename)
 {
-    FILE *fp;
+    double startTime = GetWallClockTime(), phaseTime = startTime;
+
+    MappedFile file;
 
-    if((fp = fopen(filename, "r")) == NULL ){
+    if( file.Open(filename) == false ){
         cerr << "file cannot be read.\n";
         return false;
     }
 
-    char buf[512];
+    const char *p   = file.data;
+    const char *end = file.data + file.size;
 
-    // discard the first line
-    fgets(buf, 512, fp);
+    if(isVerbose) fprintf(stderr, "  %-22s %8.3f sec\n", "mapping file", GetWallClockTime() - phaseTime);
+    phaseTime = GetWallClockTime();
 
-    // obtain the number of vertices and faces
-    fgets(buf, 512, fp);
-    sscanf(buf, "%d%d", &n_vertices, &n_faces);
+    int n_faces_in;
 
-    vector<VertexIter> vertex_iterator;
-    int v_id = 0, f_id = 0;
+    if( ParseOFFHeader(p, end, n_vertices, n_faces_in) == false ) return false;
 
-    for(int i = 0; i < n_vertices; i++){
-        double coord_in[3];
+    const char *body = p;
 
-        fgets(buf, 512, fp);
-        sscanf(buf, "%lf%lf%lf", &coord_in[0], &coord_in[1], &coord_in[2]);
+    /////////////////////////////////////////////////////////////////////////////
+    // split the rest of the file into line-aligned chunks and
+    // count the records (i.e. lines that are neither blank nor comment) of each chunk
+    /////////////////////////////////////////////////////////////////////////////
+    vector<const char*> chunkBegin;
+    SplitIntoLineChunks(body, end, 4*omp_get_max_threads(), chunkBegin);
 
-        vertices.push_back( Vertex(coord_in, v_id++) );
-        vertex_iterator.push_back( --(vertices.end()) );
+    int n_chunks = (int)chunkBegin.size() - 1;
+
+    vector<int> chunkRecord(n_chunks+1, 0);
+
+    #pragma omp parallel for schedule(dynamic)
+    for(int c = 0; c < n_chunks; c++){
+        int count = 0;
+
+        for(const char *line = chunkBegin[c]; line < chunkBegin[c+1]; line = SkipLine(line, end)){
+            if(IsBlankOrComment(line, end) == false) count++;
+        }
+
+        chunkRecord[c+1] = count;
     }
 
-    for(int i = 0; i < n_faces; i++){
-        int v_id[3], dummy;
+    // chunkRecord[c] becomes the index of the first record of chunk c
+    for(int c = 0; c < n_chunks; c++) chunkRecord[c+1] += chunkRecord[c];
 
-        fgets(buf, 512, fp);
-        sscanf(buf, "%d%d%d%d", &dummy, &v_id[0], &v_id[1], &v_id[2]);
+    if(chunkRecord[n_chunks] < n_vertices + n_faces_in){
+        cerr << "unexpected end of file.\n";
+        return false;
+    }
+
+    if(isVerbose) fprintf(stderr, "  %-22s %8.3f sec\n", "splitting into lines", GetWallClockTime() - phaseTime);
+    phaseTime = GetWallClockTime();
+
+    /////////////////////////////////////////////////////////////////////////////
+    // parse the records of each chunk. polygons are triangulated as fans
+    /////////////////////////////////////////////////////////////////////////////
+    vertices.coord.resize(3*n_vertices);
+
+    vector< vector<int> > chunkTriangles(n_chunks);
+    vector<int>           chunkError(n_chunks, -1); // first record that cannot be parsed
+    int n_skipped_faces = 0;
+
+    #pragma omp parallel for schedule(dynamic) reduction(+:n_skipped_faces)
+    for(int c = 0; c < n_chunks; c++){
+        int record = chunkRecord[c];
+
+        vector<int> &triangles = chunkTriangles[c];
+
+        for(const char *line = chunkBegin[c]; line < chunkBegin[c+1]; line = SkipLine(line, end)){
+
+            if(IsBlankOrComment(line, end)) continue;
+
+            const char *q = line;
+
+            if(record < n_vertices){
+                // only the first three values are used, the rest (e.g. colors) is ignored
+                double coord_in[3];
+
+                if( ParseDouble(q, end, coord_in[0]) == false ||
+                    ParseDouble(q, end, coord_in[1]) == false ||
+                    ParseDouble(q, end, coord_in[2]) == false ){
+                    chunkError[c] = record;
+                    break;
+                }
+
+                for(int i = 0; i < 3; i++) VertexCoord(record)[i] = (Real)coord_in[i];
+            }else if(record < n_vertices + n_faces_in){
+                int n, v_id[3];
+
+                if( ParseInt(q, end, n) == false ){
+                    chunkError[c] = record;
+                    break;
+                }
 
-        faces.push_back( Face(vertex_iterator[ v_id[0] ], vertex_iterator[ v_id[1] ], vertex_iterator[ v_id[2] ], f_id++) );
+                if(n < 3){
+                    n_skipped_faces++;
+                }else{
+                    bool isValid = ParseInt(q, end, v_id[0]) && ParseInt(q, end, v_id[1]);
+
+                    for(int k = 2; k < n && isValid; k++){
+                        isValid = ParseInt(q, end, v_id[2]);
+
+                        if(isValid){
+                            triangles.push_back(v_id[0]);
+                            triangles.push_back(v_id[1]);
+                            triangles.push_back(v_id[2]);
+                        }
+
+                        v_id[1] = v_id[2];
+                    }
+
+                    if( isValid == false ){
+                        chunkError[c] = record;
+                        break;
+                    }
+                }
+            }else{
+                break;
+            }
+
+            record++;
+        }
+    }
+
+    for(int c = 0; c < n_chunks; c++){
+        if(chunkError[c] < 0) continue;
+
+        if(chunkError[c] < n_vertices) cerr << "vertex " << chunkError[c] << " cannot be read.\n";
+        else                           cerr << "face "   << chunkError[c] - n_vertices << " cannot be read.\n";
+        return false;
+    }
+
+    if(n_skipped_faces > 0) cerr << "# of faces with less than 3 vertices skipped " << n_skipped_faces << endl;
+
+    if(isVerbose) fprintf(stderr, "  %-22s %8.3f sec\n", "parsing", GetWallClockTime() - phaseTime);
+    phaseTime = GetWallClockTime();
+
+    /////////////////////////////////////////////////////////////////////////////
+    // gather the triangles of all chunks
+    /////////////////////////////////////////////////////////////////////////////
+    vector<int> chunkOffset(n_chunks+1, 0);
+    for(int c = 0; c < n_chunks; c++) chunkOffset[c+1] = chunkOffset[c] + (int)chunkTriangles[c].size();
+
+    n_faces = chunkOffset[n_chunks] / 3;
+    halfedges.vertex.resize(3*n_faces);
+
+    int n_invalid_indices = 0;
+
+    #pragma omp parallel for schedule(dynamic) reduction(+:n_invalid_indices)
+    for(int c = 0; c < n_chunks; c++){
+        int *dst = halfedges.vertex.data() + chunkOffset[c];
+
+        for(unsigned int i = 0; i < chunkTriangles[c].size(); i++){
+            dst[i] = chunkTriangles[c][i];
+
+            if(dst[i] < 0 || dst[i] >= n_vertices) n_invalid_indices++;
+        }
+
+        vector<int>().swap(chunkTriangles[c]);
+    }
+
+    if(n_invalid_indices > 0){
+        cerr << "vertex index out of range.\n";
+        return false;
     }
 
-    cerr << "Reading Off file done...\n";
+    if(isVerbose) fprintf(stderr, "  %-22s %8.3f sec\n", "gathering faces", GetWallClockTime() - phaseTime);
+
+    if(isVerbose) fprintf(stderr, "Reading Off file done... %.3f sec\n", GetWallClockTime() - startTime);
 
-    fclose(fp);
 
+    if(isVerbose) cerr << "# of vertices  " << n_vertices << endl;
+    if(isVerbose) cerr << "# of faces     " << n_faces    << endl;
 
-    cerr << "# of vertices  " << n_vertices << endl;
-    cerr << "# of faces     " << n_faces    << endl;
+    return true;
+}
 
 
+void Mesh::NormalizeCoordinates()
+{
     double range_min[3] = {  1.0e6,  1.0e6,  1.0e6, };
     double range_max[3] = { -1.0e6, -1.0e6, -1.0e6, };
-    double center[3];
+    double *center = normalizationCenter;
 
-    for(VertexIter vi = vertices.begin(); vi != vertices.end(); vi++){
-        for(int i = 0; i < 3; i++){
-            if(vi->coord[i] < range_min[i])	range_min[i] = vi->coord[i];
-            if(vi->coord[i] > range_max[i])	range_max[i] = vi->coord[i];
+    #pragma omp parallel
+    {
+        double local_min[3] = {  1.0e6,  1.0e6,  1.0e6, };
+        double local_max[3] = { -1.0e6, -1.0e6, -1.0e6, };
+
+        int begin, end;
+        GetThreadRange(n_vertices, begin, end);
+
+        for(int v = begin; v < end; v++){
+            Real *coord = VertexCoord(v);
+            for(int i = 0; i < 3; i++){
+                if(coord[i] < local_min[i])	local_min[i] = coord[i];
+                if(coord[i] > local_max[i])	local_max[i] = coord[i];
+            }
+        }
+
+        #pragma omp critical
+        {
+            for(int i = 0; i < 3; i++){
+                if(local_min[i] < range_min[i]) range_min[i] = local_min[i];
+                if(local_max[i] > range_max[i]) range_max[i] = local_max[i];
+            }
         }
     }
 
@@ -83,170 +284,471 @@ bool Mesh::ReadOFFFile(char *filename)
 
     double scale_factor = 2.0/largest_range;
 
-    for(VertexIter vi = vertices.begin(); vi != vertices.end(); vi++){
+    normalizationScale = scale_factor;
+
+    #pragma omp parallel for
+    for(int v = 0; v < n_vertices; v++){
+        Real *coord = VertexCoord(v);
         for(int i = 0; i < 3; i++){
-            vi->coord[i] = (vi->coord[i] - center[i]) * scale_factor;
+            coord[i] = (Real)((coord[i] - center[i]) * scale_factor);
         }
     }
-
-
-    return true;
 }
 
 
-void Mesh::MakeCircularList(FaceIter &fi)
+/////////////////////////////////////////////////////////////////////////////
+// welding
+/////////////////////////////////////////////////////////////////////////////
+
+static inline unsigned long long HashCell(long long x, long long y, long long z)
 {
-    fi->halfedge[0].next = &(fi->halfedge[1]);
-    fi->halfedge[1].next = &(fi->halfedge[2]);
-    fi->halfedge[2].next = &(fi->halfedge[0]);
+    unsigned long long h = (unsigned long long)x;
+    h = h * 0x9E3779B97F4A7C15ULL ^ (unsigned long long)y;
+    h = h * 0x9E3779B97F4A7C15ULL ^ (unsigned long long)z;
+    h = h * 0x9E3779B97F4A7C15ULL;
 
-    fi->halfedge[0].prev = &(fi->halfedge[2]);
-    fi->halfedge[1].prev = &(fi->halfedge[0]);
-    fi->halfedge[2].prev = &(fi->halfedge[1]);
+    return h ^ (h >> 29);
 }
 
-void Mesh::AddEdgeInfo()
+// Triangle soups have a copy of each vertex per face, so that every edge is a boundary.
+// Vertices closer than "weldEpsilon" times the largest side of the bounding box are merged, then faces with a
+// repeated vertex, faces with the same vertices as an earlier one (in either orientation) and the vertices no
+// face uses are removed.
+// The vertices are hashed into a uniform grid of cells twice as large as the tolerance, so that the
+// neighbors of a vertex are in the 8 cells or fewer that its tolerance box overlaps. Each vertex goes to the first
+// vertex within the tolerance, and chains of those are followed, so the result does not depend on the threads.
+// The merged vertex keeps the coordinates of the first one
+void Mesh::WeldVertices()
 {
-    // store face iteretors incident to each vertex
-    vector< vector<FaceIter> > Ring(n_vertices);
+    STAT_TIMER(PHASE_WELD);
 
-    for(FaceIter fi = faces.begin(); fi != faces.end(); fi++){
-        // construct circular list
-        MakeCircularList(fi);
+    double startTime = GetWallClockTime();
 
-        for(int i = 0; i < 3; i++){
-            //fi->halfedge[i].vertex = fi->vertex[i];
-            fi->halfedge[i].face = fi;
-            fi->halfedge[i].vertex->neighborHe = &(fi->halfedge[i]);
+    // coordinates are normalized, the largest side is 2. with no tolerance only coincident vertices are merged,
+    // the cells then only have to be small
+    double tolerance = 2.0 * weldEpsilon;
+    double cellSize  = (tolerance > 1.0e-7) ? 2.0 * tolerance : 1.0e-7;
+
+    vector<unsigned long long> keys(n_vertices);
+    vector<int>                sortedVertices(n_vertices);
+
+    #pragma omp parallel for
+    for(int v = 0; v < n_vertices; v++){
+        const Real *coord = VertexCoord(v);
 
-            Ring[fi->halfedge[i].vertex->id].push_back(fi);
+        keys[v] = HashCell((long long)floor(coord[0] / cellSize), (long long)floor(coord[1] / cellSize),
+                           (long long)floor(coord[2] / cellSize));
+        sortedVertices[v] = v;
+    }
+
+    RadixSort(keys, sortedVertices, 64);
+
+    vector<int> representative(n_vertices);
+
+    #pragma omp parallel for schedule(dynamic, 1024)
+    for(int v = 0; v < n_vertices; v++){
+        const Real *coord = VertexCoord(v);
+        long long cellMin[3], cellMax[3];
+
+        for(int k = 0; k < 3; k++){
+            cellMin[k] = (long long)floor((coord[k] - tolerance) / cellSize);
+            cellMax[k] = (long long)floor((coord[k] + tolerance) / cellSize);
         }
+
+        int first = v;
+
+        for(long long x = cellMin[0]; x <= cellMax[0]; x++){
+            for(long long y = cellMin[1]; y <= cellMax[1]; y++){
+                for(long long z = cellMin[2]; z <= cellMax[2]; z++){
+                    unsigned long long key = HashCell(x, y, z);
+
+                    // cells whose hashes are equal are looked at together, the distance tells them apart
+                    int i = (int)(lower_bound(keys.begin(), keys.end(), key) - keys.begin());
+
+                    for(; i < n_vertices && keys[i] == key; i++){
+                        int w = sortedVertices[i];
+                        if(w >= first) continue;
+
+                        const Real *other = VertexCoord(w);
+
+                        if(fabs((double)other[0] - coord[0]) <= tolerance && fabs((double)other[1] - coord[1]) <= tolerance &&
+                           fabs((double)other[2] - coord[2]) <= tolerance){
+                            first = w;
+                        }
+                    }
+                }
+            }
+        }
+
+        representative[v] = first;
+    }
+
+    vector<unsigned long long>().swap(keys);
+    vector<int>().swap(sortedVertices);
+
+    // the first vertex of a chain points to itself, and every link points to a smaller index, so resolving
+    // in increasing order finds each target resolved already
+    int n_merged = 0;
+
+    for(int v = 0; v < n_vertices; v++){
+        if(representative[v] != v){
+            representative[v] = representative[ representative[v] ];
+            n_merged++;
+        }
+    }
+
+    vector<int> &corner = halfedges.vertex;
+
+    #pragma omp parallel for
+    for(int i = 0; i < 3*n_faces; i++) corner[i] = representative[ corner[i] ];
+
+    int n_inputVertices = n_vertices, n_inputFaces = n_faces, n_degenerate, n_duplicate;
+
+    RemoveDegenerateFaces(n_degenerate, n_duplicate);
+
+    n_weldRemovedVertices = n_inputVertices - n_vertices;
+    n_weldRemovedFaces    = n_inputFaces    - n_faces;
+
+    if(isVerbose){
+        fprintf(stderr, "welding: %d vertices merged, %d unused, %d degenerate and %d duplicate faces removed, %.3f sec\n",
+                n_merged, n_weldRemovedVertices - n_merged, n_degenerate, n_duplicate, GetWallClockTime() - startTime);
+    }
+}
+
+// Removes the faces with a repeated vertex, the faces with the same vertices as an earlier one (in either
+// orientation), and then the vertices that no face uses. Vertices and faces keep their order
+void Mesh::RemoveDegenerateFaces(int &n_degenerate, int &n_duplicate)
+{
+    /////////////////////////////////////////////////////////////////////////////
+    // faces: repeated vertices, then duplicates by their sorted vertices
+    /////////////////////////////////////////////////////////////////////////////
+    vector<int> &corner = halfedges.vertex;
+    vector<char> isKept(n_faces);
+    vector<unsigned long long> faceKeys(n_faces);
+    vector<int>                sortedFaces(n_faces);
+    int n_repeated = 0;
+
+    #pragma omp parallel for reduction(+:n_repeated)
+    for(int f = 0; f < n_faces; f++){
+        int a = corner[3*f], b = corner[3*f+1], c = corner[3*f+2];
+
+        isKept[f] = (a != b && b != c && c != a);
+        if(isKept[f] == false) n_repeated++;
+
+        // sorted, so that rotations and the opposite orientation have the same key
+        if(a > b) swap(a, b);
+        if(b > c) swap(b, c);
+        if(a > b) swap(a, b);
+
+        faceKeys[f]    = HashCell(a, b, c);
+        sortedFaces[f] = f;
     }
 
-    cerr << "halfedges are set\n";
+    RadixSort(faceKeys, sortedFaces, 64);
+
+    int n_same = 0;
+
+    // within a run of equal keys the faces are in increasing order, the sort is stable. a face is dropped if an
+    // earlier kept one has the same vertices
+    #pragma omp parallel for reduction(+:n_same)
+    for(int i = 0; i < n_faces; i++){
+        if(i > 0 && faceKeys[i] == faceKeys[i-1]) continue;
+
+        int runEnd = i + 1;
+        while(runEnd < n_faces && faceKeys[runEnd] == faceKeys[i]) runEnd++;
+        if(runEnd == i + 1) continue;
 
-    // construct mates of halfedge
-    for(unsigned int i = 0; i < Ring.size(); i++){ // for each vertex
+        for(int j = i + 1; j < runEnd; j++){
+            int f = sortedFaces[j];
+            if(isKept[f] == false) continue;
 
-        for(unsigned int j = 0; j < Ring[i].size(); j++){
+            for(int k = i; k < j; k++){
+                int g = sortedFaces[k];
+                if(isKept[g] == false) continue;
 
-            HalfEdge   *candidate_he;
-            VertexIter candidate_vertex;
+                int n_shared = 0;
+                for(int s = 0; s < 3; s++){
+                    for(int t = 0; t < 3; t++) if(corner[3*f+s] == corner[3*g+t]) n_shared++;
+                }
 
-            for(int m = 0; m < 3; m++){
-                if(Ring[i][j]->halfedge[m].vertex->id == i){
-                    candidate_he     = &(Ring[i][j]->halfedge[m]);
-                    candidate_vertex = Ring[i][j]->halfedge[m].next->vertex;
+                if(n_shared == 3){
+                    isKept[f] = false;
+                    n_same++;
                     break;
                 }
             }
+        }
+    }
 
-            for(unsigned int k = 0; k < Ring[i].size(); k++){
+    vector<unsigned long long>().swap(faceKeys);
+    vector<int>().swap(sortedFaces);
 
-                if(j==k) continue;
+    /////////////////////////////////////////////////////////////////////////////
+    // compaction. vertices are numbered in their order, faces too
+    /////////////////////////////////////////////////////////////////////////////
+    vector<int> vertexId(n_vertices, NIL);
+    int n_keptFaces = 0;
 
-                for(int m = 0; m < 3; m++){
-                    if( Ring[i][k]->halfedge[m].vertex == candidate_vertex &&
-                        Ring[i][k]->halfedge[m].next->vertex->id == i ){
-                            candidate_he->mate = &(Ring[i][k]->halfedge[m]);
-                            Ring[i][k]->halfedge[m].mate = candidate_he;
-                            break;
-                    }
-                }
+    for(int f = 0; f < n_faces; f++){
+        if(isKept[f] == false) continue;
 
-            } //  for(int k = j+1; k < Ring[i].size(); k++){
-        } // for(int j = 0; j < Ring[i].size(); j++){
+        for(int i = 0; i < 3; i++) corner[3*n_keptFaces + i] = corner[3*f + i];
+        for(int i = 0; i < 3; i++) vertexId[ corner[3*f + i] ] = 0;
+        n_keptFaces++;
     }
 
-    cerr << "halfedge mates are set\n";
+    int n_keptVertices = 0;
 
+    for(int v = 0; v < n_vertices; v++){
+        if(vertexId[v] == NIL) continue;
 
-    // add edge information
-    for(FaceIter fi = faces.begin(); fi != faces.end(); fi++){
-      
-        for(int i = 0; i < 3; i++){
-            if( fi->halfedge[i].mate == NULL ||
-                fi->halfedge[i].vertex->id < fi->halfedge[i].mate->vertex->id ){
-                edges.push_back( Edge( &(fi->halfedge[i]), fi->halfedge[i].mate, n_edges++) );
-            }
-            if( fi->halfedge[i].mate == NULL ) fi->halfedge[i].vertex->isBoundary = true;
-        } // for(int i = 0; i < 3; i++){
+        vertexId[v] = n_keptVertices;
+        for(int k = 0; k < 3; k++) vertices.coord[3*n_keptVertices + k] = vertices.coord[3*v + k];
+        n_keptVertices++;
+    }
+
+    #pragma omp parallel for
+    for(int i = 0; i < 3*n_keptFaces; i++) corner[i] = vertexId[ corner[i] ];
+
+    n_vertices = n_keptVertices;
+    n_faces    = n_keptFaces;
+
+    vertices.coord.resize(3*n_vertices);
+    halfedges.vertex.resize(3*n_faces);
+
+    n_degenerate = n_repeated;
+    n_duplicate  = n_same;
+}
+
+
+void Mesh::AddEdgeInfo()
+{
+    STAT_TIMER(PHASE_CONNECTIVITY);
+
+    vertices.normal.assign(3*n_vertices, 0.0);
+    vertices.neighborHe.assign(n_vertices, NIL);
+    vertices.isBoundary.assign(n_vertices, false);
+    vertices.isActive.assign(n_vertices, true);
 
+    faces.normal.assign(3*n_faces, 0.0);
+    faces.area.assign(n_faces, 0.0);
+    faces.isActive.assign(n_faces, true);
+
+    halfedges.mate.assign(3*n_faces, NIL);
+    halfedges.edge.assign(3*n_faces, NIL);
+
+    int n_halfedges = 3*n_faces;
+
+    for(int he = 0; he < n_halfedges; he++) vertices.neighborHe[ halfedges.vertex[he] ] = he;
+
+    // a vertex that no face uses has no normal nor quadric. it is left inactive, as if it had been collapsed,
+    // and the writers drop it
+    int n_unused_vertices = 0;
+
+    #pragma omp parallel for reduction(+:n_unused_vertices)
+    for(int v = 0; v < n_vertices; v++){
+        if(vertices.neighborHe[v] == NIL){
+            vertices.isActive[v] = false;
+            n_unused_vertices++;
+        }
+    }
+
+    if(isVerbose) cerr << "halfedges are set\n";
+
+    if(n_unused_vertices > 0) cerr << "# of vertices used by no face " << n_unused_vertices << endl;
+
+    // sort halfedges by their (undirected) pair of vertices so that the halfedges of an edge become adjacent
+    int vertexBits = 1;
+    while(vertexBits < 31 && (1 << vertexBits) < n_vertices) vertexBits++;
+
+    vector<unsigned long long> keys(n_halfedges);
+    vector<int>                sortedHalfEdges(n_halfedges);
+
+    #pragma omp parallel for
+    for(int he = 0; he < n_halfedges; he++){
+        unsigned long long a = halfedges.vertex[he];
+        unsigned long long b = halfedges.vertex[ NextHalfEdge(he) ];
+
+        keys[he] = (a < b) ? (a << vertexBits) | b : (b << vertexBits) | a;
+        sortedHalfEdges[he] = he;
+    }
+
+    RadixSort(keys, sortedHalfEdges, 2*vertexBits);
+
+    // construct mates of halfedge. an edge is paired only if it has exactly two halfedges in opposite directions
+    int n_nonmanifold_edges = 0;
+
+    #pragma omp parallel for reduction(+:n_nonmanifold_edges)
+    for(int i = 0; i < n_halfedges; i++){
+
+        // each run of equal keys is handled by the iteration at its first element
+        if(i > 0 && keys[i] == keys[i-1]) continue;
+
+        int runEnd = i + 1;
+        while(runEnd < n_halfedges && keys[runEnd] == keys[i]) runEnd++;
+
+        if(runEnd - i == 1) continue; // boundary edge
+
+        int he0 = sortedHalfEdges[i];
+        int he1 = sortedHalfEdges[i+1];
+
+        if(runEnd - i == 2 && halfedges.vertex[he0] != halfedges.vertex[he1]){
+            halfedges.mate[he0] = he1;
+            halfedges.mate[he1] = he0;
+        }else{
+            // more than two faces share the edge, or they disagree in orientation. leave them as boundary
+            n_nonmanifold_edges++;
+        }
     }
 
-    cerr << "edges are set\n";
+    keys.clear();
+    sortedHalfEdges.clear();
+
+    if(isVerbose) cerr << "halfedge mates are set\n";
 
-    // construct link from halfedge to the corresponding edge
-    for(EdgeIter ei = edges.begin(); ei != edges.end(); ei++){
-        ei->halfedge[0]->edge = ei;
-        if(ei->halfedge[1] != NULL) ei->halfedge[1]->edge = ei;
+    if(n_nonmanifold_edges > 0) cerr << "# of non-manifold edges left unpaired " << n_nonmanifold_edges << endl;
+
+
+    // add edge information and the link from halfedge to the corresponding edge.
+    // edges are numbered in the order of their first halfedge, each thread counts its edges first
+    // so that it knows where its numbering starts
+    int n_threads = omp_get_max_threads();
+    vector<int> edgeOffset(n_threads+1, 0);
+
+    #pragma omp parallel num_threads(n_threads)
+    {
+        int begin, end;
+        GetThreadRange(n_halfedges, begin, end);
+
+        int count = 0;
+        for(int he = begin; he < end; he++){
+            int mate = halfedges.mate[he];
+            if( mate == NIL || halfedges.vertex[he] < halfedges.vertex[mate] ) count++;
+        }
+        edgeOffset[omp_get_thread_num()+1] = count;
+
+        #pragma omp barrier
+        #pragma omp single
+        {
+            int nt = omp_get_num_threads();
+            for(int t = 0; t < nt; t++) edgeOffset[t+1] += edgeOffset[t];
+
+            n_edges = edgeOffset[nt];
+            edges.halfedge.resize(2*n_edges);
+            edges.isActive.assign(n_edges, true);
+        }
+
+        int e = edgeOffset[omp_get_thread_num()];
+
+        for(int he = begin; he < end; he++){
+            int mate = halfedges.mate[he];
+
+            if( mate == NIL || halfedges.vertex[he] < halfedges.vertex[mate] ){
+                edges.halfedge[2*e  ] = he;
+                edges.halfedge[2*e+1] = mate;
+
+                halfedges.edge[he] = e;
+                if(mate != NIL) halfedges.edge[mate] = e;
+
+                e++;
+            }
+            if( mate == NIL ) vertices.isBoundary[ halfedges.vertex[he] ] = true;
+        }
     }
 
-    cerr << "# of edges "  << n_edges << endl;
+    if(isVerbose) cerr << "edges are set\n";
 
-    for(FaceIter   fi = faces.begin();    fi != faces.end();    fi++) AssignFaceNormal(fi);
-    for(VertexIter vi = vertices.begin(); vi != vertices.end(); vi++) AssignVertexNormal(vi);
+    if(isVerbose) cerr << "# of edges "  << n_edges << endl;
+
+    // each normal is written by one iteration only, so the result does not depend on the number of threads
+    #pragma omp parallel for
+    for(int f = 0; f < n_faces;    f++) AssignFaceNormal(f);
+
+    #pragma omp parallel for
+    for(int v = 0; v < n_vertices; v++) if(vertices.isActive[v]) AssignVertexNormal(v);
 }
 
-void Mesh::AssignFaceNormal(FaceIter &fi)
+void Mesh::AssignFaceNormal(int f)
 {
-    double vec1[3], vec2[3];
+    double vec1[3], vec2[3], normal[3], area;
+
+    STAT_COUNT(STAT_FACE_NORMALS);
+
+    Real *coord0 = VertexCoord( halfedges.vertex[3*f  ] );
+    Real *coord1 = VertexCoord( halfedges.vertex[3*f+1] );
+    Real *coord2 = VertexCoord( halfedges.vertex[3*f+2] );
 
     for(int i = 0; i < 3; i++){
-        vec1[i] = fi->halfedge[1].vertex->coord[i] - fi->halfedge[0].vertex->coord[i];
-        vec2[i] = fi->halfedge[2].vertex->coord[i] - fi->halfedge[0].vertex->coord[i];
+        vec1[i] = (double)coord1[i] - coord0[i];
+        vec2[i] = (double)coord2[i] - coord0[i];
     }
 
-    CrossProduct(vec1, vec2, fi->normal);
-    GetArea(fi->normal, fi->area);
-    Normalize(fi->normal);
+    CrossProduct(vec1, vec2, normal);
+    GetArea(normal, area);
+    Normalize(normal);
+
+    for(int i = 0; i < 3; i++) FaceNormal(f)[i] = (Real)normal[i];
+    faces.area[f] = (Real)area;
 }
 
-void Mesh::AssignVertexNormal(VertexIter &vi)
+void Mesh::AssignVertexNormal(int v)
 {
     bool isBoundaryVertex = false;
 
-    vi->normal[0] = vi->normal[1] = vi->normal[2] = 0.0;
+    STAT_COUNT(STAT_VERTEX_NORMALS);
+
+    // summed in double, stored in "Real"
+    double normal[3] = { 0.0, 0.0, 0.0 };
     double cumulativeArea = 0.0;
 
-    // traverse faces incident to "vi" in CCW
-    HalfEdge *hep = vi->neighborHe;
+    // traverse faces incident to "v" in CCW
+    int hep = vertices.neighborHe[v];
     do{
-        FaceIter fi = hep->face;
+        int f = FaceOfHalfEdge(hep);
 
-        vi->normal[0] += fi->normal[0]*fi->area;
-        vi->normal[1] += fi->normal[1]*fi->area;
-        vi->normal[2] += fi->normal[2]*fi->area;
-        cumulativeArea += fi->area;
+        normal[0] += faces.normal[3*f  ]*faces.area[f];
+        normal[1] += faces.normal[3*f+1]*faces.area[f];
+        normal[2] += faces.normal[3*f+2]*faces.area[f];
+        cumulativeArea += faces.area[f];
 
-        hep = hep->prev->mate;
+        hep = halfedges.mate[ PrevHalfEdge(hep) ];
 
-        if(hep == NULL){
+        if(hep == NIL){
             isBoundaryVertex = true;
             break;
         }
-    }while(hep != vi->neighborHe);
+    }while(hep != vertices.neighborHe[v]);
 
-    // when we cannot traverse all incident faces since "vi" is on boundary
-    // we traverse faces incident to "vi" in CW to check all incident faces
+    // when we cannot traverse all incident faces since "v" is on boundary
+    // we traverse faces incident to "v" in CW to check all incident faces
     if(isBoundaryVertex){
-        HalfEdge *hep = vi->neighborHe->mate;
-        while(hep != NULL){
-            FaceIter fi = hep->face;
+        int hep = halfedges.mate[ vertices.neighborHe[v] ];
+        while(hep != NIL){
+            int f = FaceOfHalfEdge(hep);
 
-            vi->normal[0] += fi->normal[0]*fi->area;
-            vi->normal[1] += fi->normal[1]*fi->area;
-            vi->normal[2] += fi->normal[2]*fi->area;
-            cumulativeArea += fi->area;
+            normal[0] += faces.normal[3*f  ]*faces.area[f];
+            normal[1] += faces.normal[3*f+1]*faces.area[f];
+            normal[2] += faces.normal[3*f+2]*faces.area[f];
+            cumulativeArea += faces.area[f];
 
-            hep = hep->next->mate;
+            hep = halfedges.mate[ NextHalfEdge(hep) ];
         }
     }
 
     double invCumulativeArea = 1.0 / cumulativeArea;
 
-    vi->normal[0] *= invCumulativeArea;
-    vi->normal[1] *= invCumulativeArea;
-    vi->normal[2] *= invCumulativeArea;
+    normal[0] *= invCumulativeArea;
+    normal[1] *= invCumulativeArea;
+    normal[2] *= invCumulativeArea;
+
+    for(int i = 0; i < 3; i++) VertexNormal(v)[i] = (Real)normal[i];
 }
 
+size_t Mesh::MemoryUsage()
+{
+    return VectorBytes(vertices.coord) + VectorBytes(vertices.normal) + VectorBytes(vertices.neighborHe) +
+           VectorBytes(vertices.isBoundary) + VectorBytes(vertices.isActive) +
+           VectorBytes(halfedges.vertex) + VectorBytes(halfedges.mate) + VectorBytes(halfedges.edge) +
+           VectorBytes(faces.normal) + VectorBytes(faces.area) + VectorBytes(faces.isActive) +
+           VectorBytes(edges.halfedge) + VectorBytes(edges.isActive);
+}
@@ -0,0 +1,186 @@
+#include "mesh.h"
+#include "render.h"
+#include <algorithm>
+
+
+void RenderBuffer::Build(Mesh &mesh)
+{
+    vertices.resize(6*mesh.n_vertices);
+    indices.clear();
+    indices.reserve(3*mesh.n_faces);
+
+    faceTriangle.assign(mesh.n_faces, NIL);
+    triangleFace.clear();
+    triangleFace.reserve(mesh.n_faces);
+
+    isVertexDirty.assign(mesh.n_vertices, false);
+    isTriangleDirty.assign(mesh.n_faces, false);
+    dirtyVertices.clear();
+    dirtyTriangles.clear();
+
+    for(int v = 0; v < mesh.n_vertices; v++){
+        WriteVertex(mesh, v);
+        MarkVertex(v);
+    }
+
+    for(int f = 0; f < mesh.n_faces; f++) if(mesh.faces.isActive[f]) AddFace(mesh, f);
+
+    // the buffer objects are allocated again
+    isUploaded = false;
+}
+
+
+void RenderBuffer::Update(Mesh &mesh, const vector<int> &changedFaces)
+{
+    if(faceTriangle.size() != (size_t)mesh.n_faces){
+        Build(mesh);
+        return;
+    }
+
+    for(unsigned int i = 0; i < changedFaces.size(); i++){
+        int f = changedFaces[i];
+
+        if(mesh.faces.isActive[f]){
+            if(faceTriangle[f] == NIL) AddFace(mesh, f);
+            else                       WriteTriangle(mesh, faceTriangle[f]);
+        }else{
+            if(faceTriangle[f] != NIL) RemoveFace(f);
+        }
+
+        // the positions and normals of the corners, whether the face is still there or not
+        for(int k = 0; k < 3; k++){
+            int v = mesh.halfedges.vertex[3*f+k];
+
+            WriteVertex(mesh, v);
+            MarkVertex(v);
+        }
+    }
+}
+
+
+void RenderBuffer::WriteVertices(int n, const int *vertexIds, const float *data)
+{
+    for(int i = 0; i < n; i++){
+        int v = vertexIds[i];
+
+        copy(data + 6*i, data + 6*i + 6, &vertices[6*v]);
+        MarkVertex(v);
+    }
+}
+
+
+void RenderBuffer::WriteVertex(Mesh &mesh, int v)
+{
+    float *data = &vertices[6*v];
+
+    for(int k = 0; k < 3; k++){
+        data[k]   = (float)mesh.VertexCoord(v)[k];
+        data[3+k] = (float)mesh.VertexNormal(v)[k];
+    }
+}
+
+void RenderBuffer::WriteTriangle(Mesh &mesh, int t)
+{
+    int f = triangleFace[t];
+
+    for(int k = 0; k < 3; k++) indices[3*t+k] = (unsigned int)mesh.halfedges.vertex[3*f+k];
+
+    MarkTriangle(t);
+}
+
+void RenderBuffer::MarkVertex(int v)
+{
+    if(isVertexDirty[v]) return;
+
+    isVertexDirty[v] = true;
+    dirtyVertices.push_back(v);
+}
+
+void RenderBuffer::MarkTriangle(int t)
+{
+    if(isTriangleDirty[t]) return;
+
+    isTriangleDirty[t] = true;
+    dirtyTriangles.push_back(t);
+}
+
+
+void RenderBuffer::AddFace(Mesh &mesh, int f)
+{
+    int t = (int)triangleFace.size();
+
+    faceTriangle[f] = t;
+    triangleFace.push_back(f);
+    indices.resize(3*(t+1));
+
+    WriteTriangle(mesh, t);
+}
+
+void RenderBuffer::RemoveFace(int f)
+{
+    // the last triangle takes its place
+    int t    = faceTriangle[f];
+    int last = (int)triangleFace.size() - 1;
+
+    if(t != last){
+        int lastFace = triangleFace[last];
+
+        triangleFace[t]        = lastFace;
+        faceTriangle[lastFace] = t;
+
+        for(int k = 0; k < 3; k++) indices[3*t+k] = indices[3*last+k];
+
+        MarkTriangle(t);
+    }
+
+    faceTriangle[f] = NIL;
+    triangleFace.pop_back();
+    indices.resize(3*last);
+}
+
+
+void RenderBuffer::MergeRanges(vector<int> &dirty, int size, vector<BufferRange> &ranges)
+{
+    sort(dirty.begin(), dirty.end());
+
+    ranges.clear();
+
+    for(unsigned int i = 0; i < dirty.size() && dirty[i] < size; i++){
+        if(ranges.empty() == false && ranges.back().end == dirty[i]){
+            ranges.back().end++;
+        }else{
+            BufferRange range = { dirty[i], dirty[i] + 1 };
+            ranges.push_back(range);
+        }
+    }
+}
+
+const vector<BufferRange> &RenderBuffer::DirtyVertexRanges()
+{
+    MergeRanges(dirtyVertices, (int)vertices.size() / 6, vertexRanges);
+    return vertexRanges;
+}
+
+const vector<BufferRange> &RenderBuffer::DirtyTriangleRanges()
+{
+    MergeRanges(dirtyTriangles, NumberOfTriangles(), triangleRanges);
+    return triangleRanges;
+}
+
+void RenderBuffer::ClearDirtyRanges()
+{
+    for(unsigned int i = 0; i < dirtyVertices.size();  i++) isVertexDirty[dirtyVertices[i]]    = false;
+    for(unsigned int i = 0; i < dirtyTriangles.size(); i++) isTriangleDirty[dirtyTriangles[i]] = false;
+
+    dirtyVertices.clear();
+    dirtyTriangles.clear();
+    vertexRanges.clear();
+    triangleRanges.clear();
+}
+
+
+size_t RenderBuffer::MemoryUsage()
+{
+    return VectorBytes(vertices) + VectorBytes(indices) + VectorBytes(faceTriangle) + VectorBytes(triangleFace) +
+           VectorBytes(isVertexDirty) + VectorBytes(dirtyVertices) + VectorBytes(isTriangleDirty) + VectorBytes(dirtyTriangles);
+}
@@ -0,0 +1,68 @@
+// Buffers to draw the active faces of a mesh with glDrawElements, kept up to date face by face.
+//
+// "vertices" has one entry per vertex of the mesh, active or not, so that vertex ids are the indices:
+//
+//   position x y z, normal x y z     6 floats, 24 bytes per vertex
+//
+// "indices" holds the three vertices of each active face, packed. A face that becomes inactive is replaced by
+// the last triangle, and a face that becomes active is appended, so only the triangles touched change.
+// Update records what it changed as ranges, which the display uploads before it draws. Nothing here needs
+// a GL context, so the buffers can be checked without a window.
+
+// [begin, end), in vertices or in triangles
+struct BufferRange {
+    int begin, end;
+};
+
+class RenderBuffer {
+    vector<int>  faceTriangle;    // per face of the mesh, its triangle in "indices", or NIL
+    vector<int>  triangleFace;    // per triangle, its face
+
+    vector<char> isVertexDirty;   // per vertex
+    vector<int>  dirtyVertices;
+    vector<char> isTriangleDirty; // per triangle, including the ones removed since the last upload
+    vector<int>  dirtyTriangles;
+
+    vector<BufferRange> vertexRanges, triangleRanges;
+
+    void WriteVertex(Mesh &mesh, int v);
+    void WriteTriangle(Mesh &mesh, int t);
+    void MarkVertex(int v);
+    void MarkTriangle(int t);
+    void AddFace(Mesh &mesh, int f);
+    void RemoveFace(int f);
+    static void MergeRanges(vector<int> &dirty, int size, vector<BufferRange> &ranges);
+
+public:
+    vector<float>        vertices;  // 6 per vertex of the mesh
+    vector<unsigned int> indices;   // 3 per active face
+
+    // GL buffer objects of the display, 0 if none yet
+    unsigned int vertexBufferId, indexBufferId;
+    bool         isUploaded;        // the buffer objects hold all of "vertices" and "indices" as of the last upload
+
+    RenderBuffer(){ vertexBufferId = indexBufferId = 0; isUploaded = false; }
+
+    // every vertex and active face, and everything dirty
+    void Build(Mesh &mesh);
+    // after faces changed their activity or their corners, or the positions or normals of their vertices.
+    // a face may be listed more than once
+    void Update(Mesh &mesh, const vector<int> &changedFaces);
+    // positions and normals other than the mesh's, 6 floats per vertex listed, such as a blended geomorph.
+    // they stay until the next Update or Build writes those vertices
+    void WriteVertices(int n, const int *vertexIds, const float *data);
+
+    int NumberOfTriangles()   { return (int)indices.size() / 3; }
+    int MaxNumberOfTriangles(){ return (int)faceTriangle.size(); }  // the faces of the mesh
+
+    // what changed since the last ClearDirtyRanges, sorted, each range as long as possible.
+    // the triangle ranges end at the current number of triangles
+    const vector<BufferRange> &DirtyVertexRanges();
+    const vector<BufferRange> &DirtyTriangleRanges();
+    void ClearDirtyRanges();
+
+    size_t MemoryUsage();
+
+    // upload the dirty ranges and draw (display.cpp). "mode" 1 also draws the edges, as Mesh::Display
+    void Display(int mode);
+};
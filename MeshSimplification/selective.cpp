@@ -0,0 +1,377 @@
+#include "mesh.h"
+#include "simplification.h"
+#include "parallel.h"
+#include "stats.h"
+#include <cmath>
+
+
+/////////////////////////////////////////////////////////////////////////////
+// vertex hierarchy
+/////////////////////////////////////////////////////////////////////////////
+
+// from a point to a vertex (Real) or to the center of an error bound (float)
+template <class T> static double Distance(const double *a, const T *b)
+{
+    double dx = a[0] - b[0], dy = a[1] - b[1], dz = a[2] - b[2];
+
+    return sqrt(dx*dx + dy*dy + dz*dz);
+}
+
+
+void Simplification::CollectFacesAroundVertex(int hep, vector<int> &faces)
+{
+    vector<int> &heMate = mesh->halfedges.mate;
+
+    int startHalfEdge;
+
+    if(mesh->vertices.isBoundary[mesh->halfedges.vertex[hep]] == false) startHalfEdge = hep;
+    else                                                                startHalfEdge = FindBoundaryEdgeIncidentToVertexInCW(hep);
+
+    hep = startHalfEdge;
+    do{
+        faces.push_back(FaceOfHalfEdge(hep));
+
+        hep = heMate[PrevHalfEdge(hep)];
+    }while(hep != startHalfEdge && hep != NIL);
+}
+
+
+void Simplification::BuildVertexHierarchy()
+{
+    STAT_TIMER(PHASE_HIERARCHY);
+
+    int n_records = history.Size();
+    int n_applied = history.Cursor();
+
+    vector<int> &heVertex     = mesh->halfedges.vertex;
+    vector<int> &edgeHalfEdge = mesh->edges.halfedge;
+
+    // the face normals are read along the way, so they are kept up to date
+    bool wasDeferringNormals = isDeferringNormals;
+    DeferNormals(false);
+
+    // replay the history from its first record, and note which record changed each face last
+    SeekRecord(0);
+
+    vector<int>    lastWriter(mesh->n_faces, NIL);
+    vector<double> vertexRadius(mesh->n_vertices, 0.0);     // of the vertices merged into the vertex
+    vector<double> vertexDeviation(mesh->n_vertices, 0.0);  // of the surface around the vertex
+    vector<int>    faces;
+
+    requiredBegin.assign(1, 0);
+    required.clear();
+    errorBound.resize(5*n_records);
+
+    for(int i = 0; i < n_records; i++){
+        int hep = edgeHalfEdge[2*history.Edge(i)];
+        int v0  = heVertex[hep];
+        int v1  = heVertex[NextHalfEdge(hep)];
+
+        // the collapse changes the faces around v0 and v1, so it follows the records that changed them
+        faces.clear();
+        CollectFacesAroundVertex(hep, faces);
+        CollectFacesAroundVertex(NextHalfEdge(hep), faces);
+
+        for(unsigned int k = 0; k < faces.size(); k++){
+            int writer = lastWriter[faces[k]];
+            if(writer == NIL) continue;
+
+            bool isNew = true;
+            for(unsigned int j = requiredBegin[i]; j < required.size(); j++) if(required[j] == writer){ isNew = false; break; }
+
+            if(isNew) required.push_back(writer);
+        }
+        requiredBegin.push_back((int)required.size());
+
+        history.Get(i, collapseRecord);
+
+        double center[3];
+        CopyToDouble(collapseRecord.v1CollapsedCoord, center);
+
+        // how far the collapse moves the surface: from where v1 goes to the planes of the faces around v0
+        // and v1, and the moves of v0 and v1 on a boundary, which the planes do not bound. added to the
+        // deviation of the collapses that moved v0 and v1 before
+        double deviation = 0.0;
+
+        for(unsigned int k = 0; k < faces.size(); k++){
+            const Real *n = mesh->FaceNormal(faces[k]);
+            const Real *p = mesh->VertexCoord(heVertex[3*faces[k]]);
+
+            double d = fabs(n[0]*(center[0] - p[0]) + n[1]*(center[1] - p[1]) + n[2]*(center[2] - p[2]));
+            if(d > deviation) deviation = d;
+        }
+
+        double d0 = Distance(center, mesh->VertexCoord(v0));
+        double d1 = Distance(center, mesh->VertexCoord(v1));
+
+        if(mesh->vertices.isBoundary[v0] || mesh->vertices.isBoundary[v1]){
+            if(d0 > deviation) deviation = d0;
+            if(d1 > deviation) deviation = d1;
+        }
+
+        deviation += (vertexDeviation[v0] > vertexDeviation[v1]) ? vertexDeviation[v0] : vertexDeviation[v1];
+
+        // the sphere around where v1 goes holds the vertices merged into v1
+        double radius = (d0 + vertexRadius[v0] > d1 + vertexRadius[v1]) ? d0 + vertexRadius[v0] : d1 + vertexRadius[v1];
+
+        vertexDeviation[v1] = deviation;
+        vertexRadius[v1]    = radius;
+
+        // the bound also holds the bounds of the records it requires
+        for(int j = requiredBegin[i]; j < requiredBegin[i+1]; j++){
+            const float *other = &errorBound[5*required[j]];
+
+            double r = Distance(center, other) + other[3];
+            if(r > radius)           radius    = r;
+            if(other[4] > deviation) deviation = other[4];
+        }
+
+        // rounded up, so that the bounds stay nested in floats
+        for(int k = 0; k < 3; k++) errorBound[5*i+k] = (float)center[k];
+        errorBound[5*i+3] = (float)(radius    * (1.0 + 1e-6));
+        errorBound[5*i+4] = (float)(deviation * (1.0 + 1e-6));
+
+        RedoCollapse(i);
+        history.Redo();
+        TakeCheckpointIfDue();
+
+        for(unsigned int k = 0; k < faces.size(); k++) lastWriter[faces[k]] = i;
+    }
+
+    // the other way round
+    dependentBegin.assign(n_records + 1, 0);
+    dependents.resize(required.size());
+
+    for(unsigned int j = 0; j < required.size(); j++) dependentBegin[required[j] + 1]++;
+    for(int i = 0; i < n_records; i++) dependentBegin[i+1] += dependentBegin[i];
+
+    vector<int> position(dependentBegin.begin(), dependentBegin.end() - 1);
+
+    for(int i = 0; i < n_records; i++){
+        for(int j = requiredBegin[i]; j < requiredBegin[i+1]; j++) dependents[ position[required[j]]++ ] = i;
+    }
+
+    n_hierarchyRecords = n_records;
+    n_hierarchyDropped = history.NumberOfDropped();
+
+    SeekRecord(n_applied);
+
+    DeferNormals(wasDeferringNormals);
+}
+
+
+void Simplification::ClearVertexHierarchy()
+{
+    isSelective = false;
+    n_hierarchyRecords = n_hierarchyDropped = 0;
+
+    requiredBegin.clear();   required.clear();
+    dependentBegin.clear();  dependents.clear();
+    errorBound.clear();
+    isApplied.clear();
+    n_appliedDependents.clear();  n_missingRequired.clear();
+    splitFront.clear();  collapseFront.clear();  frontPosition.clear();
+}
+
+
+size_t Simplification::HierarchyMemoryUsage()
+{
+    return VectorBytes(requiredBegin) + VectorBytes(required) + VectorBytes(dependentBegin) + VectorBytes(dependents) +
+           VectorBytes(errorBound) + VectorBytes(isApplied) + VectorBytes(n_appliedDependents) +
+           VectorBytes(n_missingRequired) + VectorBytes(splitFront) + VectorBytes(collapseFront) + VectorBytes(frontPosition);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// fronts
+/////////////////////////////////////////////////////////////////////////////
+
+void Simplification::AddToFront(vector<int> &front, int record)
+{
+    frontPosition[record] = (int)front.size();
+    front.push_back(record);
+}
+
+void Simplification::RemoveFromFront(vector<int> &front, int record)
+{
+    // the last one takes its place
+    int last = front.back();
+
+    front[frontPosition[record]] = last;
+    frontPosition[last] = frontPosition[record];
+
+    front.pop_back();
+    frontPosition[record] = NIL;
+}
+
+
+void Simplification::SelectiveCollapse(int record)
+{
+    RedoCollapse(record);
+
+    isApplied[record] = true;
+    RemoveFromFront(collapseFront, record);
+
+    // no record that requires it is applied yet
+    AddToFront(splitFront, record);
+
+    for(int j = requiredBegin[record]; j < requiredBegin[record+1]; j++){
+        int r = required[j];
+
+        if(n_appliedDependents[r]++ == 0) RemoveFromFront(splitFront, r);
+    }
+
+    for(int j = dependentBegin[record]; j < dependentBegin[record+1]; j++){
+        int d = dependents[j];
+
+        if(--n_missingRequired[d] == 0) AddToFront(collapseFront, d);
+    }
+}
+
+
+void Simplification::SelectiveSplit(int record)
+{
+    UndoCollapse(record);
+
+    isApplied[record] = false;
+    RemoveFromFront(splitFront, record);
+
+    // every record it requires is applied
+    AddToFront(collapseFront, record);
+
+    for(int j = requiredBegin[record]; j < requiredBegin[record+1]; j++){
+        int r = required[j];
+
+        if(--n_appliedDependents[r] == 0) AddToFront(splitFront, r);
+    }
+
+    for(int j = dependentBegin[record]; j < dependentBegin[record+1]; j++){
+        int d = dependents[j];
+
+        if(n_missingRequired[d]++ == 0) RemoveFromFront(collapseFront, d);
+    }
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// selective refinement
+/////////////////////////////////////////////////////////////////////////////
+
+void Simplification::StartSelectiveRefinement()
+{
+    if(isSelective) return;
+
+    if(n_hierarchyRecords != history.Size() || n_hierarchyDropped != history.NumberOfDropped() || requiredBegin.empty())
+        BuildVertexHierarchy();
+
+    int n_records = history.Size();
+
+    isApplied.assign(n_records, false);
+    n_appliedDependents.assign(n_records, 0);
+    n_missingRequired.assign(n_records, 0);
+    frontPosition.assign(n_records, NIL);
+
+    // the fronts never hold more than every record, so that a frame does not allocate
+    splitFront.clear();     splitFront.reserve(n_records);
+    collapseFront.clear();  collapseFront.reserve(n_records);
+
+    for(int i = 0; i < history.Cursor(); i++) isApplied[i] = true;
+
+    for(int i = 0; i < n_records; i++){
+        for(int j = requiredBegin[i]; j < requiredBegin[i+1]; j++){
+            if(isApplied[i])                    n_appliedDependents[required[j]]++;
+            if(isApplied[required[j]] == false) n_missingRequired[i]++;
+        }
+    }
+
+    for(int i = 0; i < n_records; i++){
+        if(isApplied[i]  && n_appliedDependents[i] == 0) AddToFront(splitFront, i);
+        if(!isApplied[i] && n_missingRequired[i]   == 0) AddToFront(collapseFront, i);
+    }
+
+    isSelective = true;
+}
+
+
+int Simplification::RefineForView(const ViewParameters &view)
+{
+    if(isSelective == false) StartSelectiveRefinement();
+
+    STAT_TIMER(PHASE_REFINE_FOR_VIEW);
+
+    // the pixels of a length "l" seen at distance "d" are l/d * pixelsPerRadian. the view is taken as the
+    // cone around the direction that holds the window's corners
+    double tanHalf         = tan(view.fieldOfView / 2.0);
+    double pixelsPerRadian = view.screenHeight / (2.0 * tanHalf);
+    double halfAngle       = atan(tanHalf * sqrt(1.0 + view.aspect * view.aspect));
+    double sinHalf         = sin(halfAngle), cosHalf = cos(halfAngle);
+
+    int n_changes = 0;
+
+    for(int pass = 0; pass < 2; pass++){
+        bool isSplitPass = (pass == 0);
+
+        // every record of the front is evaluated, whether or not its status flips. records the changes add to
+        // the front are appended, and are visited in the same pass
+        vector<int> &front = isSplitPass ? splitFront : collapseFront;
+
+        unsigned int k = 0;
+        while(k < front.size()){
+            int record = front[k];
+            const float *bound = &errorBound[5*record];
+
+            double d[3] = { bound[0] - view.eye[0], bound[1] - view.eye[1], bound[2] - view.eye[2] };
+            double r    = bound[3];
+
+            double distance = sqrt(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]);
+            double along    = d[0]*view.direction[0] + d[1]*view.direction[1] + d[2]*view.direction[2];
+            double across   = sqrt(fabs(distance*distance - along*along));
+
+            // the deviation seen from the nearest point of the sphere
+            double error;
+            if(distance <= r)                           error = DBL_MAX;  // the eye is in the sphere
+            else if(across*cosHalf - along*sinHalf > r) error = 0.0;      // out of the view
+            else                                        error = bound[4] / (distance - r) * pixelsPerRadian;
+
+            // a split or a collapse moves another record to position k
+            if(isSplitPass && error > view.tolerance){
+                SelectiveSplit(record);
+                n_changes++;
+            }else if(!isSplitPass && error <= view.tolerance){
+                SelectiveCollapse(record);
+                n_changes++;
+            }else{
+                k++;
+            }
+        }
+    }
+
+    UpdateNormals();
+
+    return n_changes;
+}
+
+
+void Simplification::EndSelectiveRefinement()
+{
+    if(isSelective == false) return;
+
+    int n_records = history.Size();
+    int n_applied = 0;
+
+    for(int i = 0; i < n_records; i++) if(isApplied[i]) n_applied++;
+
+    // to the first "n_applied" records: the records after them are split from the last, which their
+    // dependents precede, and the ones before them are applied from the first
+    for(int i = n_records - 1; i >= n_applied; i--) if(isApplied[i])         UndoCollapse(i);
+    for(int i = 0; i < n_applied; i++)              if(isApplied[i] == false) RedoCollapse(i);
+
+    history.SetCursor(n_applied);
+    UpdateNormals();
+
+    isApplied.clear();
+    n_appliedDependents.clear();  n_missingRequired.clear();
+    splitFront.clear();  collapseFront.clear();  frontPosition.clear();
+
+    isSelective = false;
+}
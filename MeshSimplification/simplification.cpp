@@ -1,400 +1,891 @@
-
 #include "mesh.h"
 #include "simplification.h"
+#include "parallel.h"
+#include "quadric.h"
+#include "stats.h"
+#include <cmath>
+#include <cstdlib>
 
 #define BOUNDARY_COST 1.0
 
+// collapses per batch of ParallelEdgeCollapse
+#define PARALLEL_BATCH_SIZE            4096
+#define PARALLEL_BATCH_SIZE_PER_THREAD 1024
+#define PARALLEL_FACES_PER_COLLAPSE    64
+
+// initial capacity of the per-collapse buffers, in halfedges or edges around a vertex
+#define RING_RESERVE 32
 
-bool operator>(const EdgeCollapseTarget &a, const EdgeCollapseTarget &b){
-    return a.cost > b.cost;
-}
 
+// appends "from" to "to" and empties it, keeping the buffers of both
+static void MoveToList(vector<int> &from, vector<int> &to)
+{
+    to.insert(to.end(), from.begin(), from.end());
+    from.clear();
+}
 
 
-void Simplification::InitSimplification(Mesh *mesh_in)
+void Simplification::InitSimplification(Mesh *mesh_in, const vector<char> *isLocked_in)
 {
+    STAT_TIMER(PHASE_INIT);
+
     mesh = mesh_in;
 
+    if(isLocked_in != NULL) isLocked = *isLocked_in;
+    else                    isLocked.clear();
+
     n_active_faces = mesh->n_faces;
+    history.Clear(mesh->n_faces);
+    checkpoints.clear();
+    ClearVertexHierarchy();
+
+    Q.assign(10*mesh->n_vertices, 0.0);
+    optimalCoord.assign(3*mesh->n_edges, 0.0);
+    isSuspended.assign(mesh->n_edges, false);
+
+    regionStamp.assign(mesh->n_vertices, 0);
+    ResizePerThreadLists();
+    ReserveBatchSlots(0);
+    for(unsigned int i = 0; i < changedFaces.size(); i++) changedFaces[i].clear();
+    isMeshReplaced = false;
+
+    isFaceNormalDirty.clear();
+    isVertexNormalDirty.clear();
+    DeferNormals(isDeferringNormals);
+
+    ringEdges.reserve(RING_RESERVE);
+    ringCost.reserve(RING_RESERVE);
+    suspendedEdges.reserve(4*RING_RESERVE);  // from the two-ring of the vertex
+    collapseRecord.halfedgesAroundV0.reserve(RING_RESERVE);
+    regionVertices.reserve(2*RING_RESERVE);
+    currentBatch = 0;
 
     AssignInitialQ();
 
-    for(EdgeIter ei = mesh->edges.begin(); ei != mesh->edges.end(); ei++)
-        ComputeOptimalCoordAndCost(ei);
+    // every edge writes only its own cost and optimal coordinate. the heap is built once at the end
+    vector<int>    edgeList(mesh->n_edges);
+    vector<double> cost(mesh->n_edges);
+
+    for(int e = 0; e < mesh->n_edges; e++) edgeList[e] = e;
+
+    const int blockSize = 1024;
+    int n_blocks = (mesh->n_edges + blockSize - 1) / blockSize;
+
+    #pragma omp parallel for schedule(dynamic, 16)
+    for(int b = 0; b < n_blocks; b++){
+        int begin = b*blockSize;
+        int size  = (mesh->n_edges - begin < blockSize) ? mesh->n_edges - begin : blockSize;
+
+        ComputeOptimalCoordAndCost(size, &edgeList[begin], &cost[begin]);
+    }
+
+    heap.Build(cost);
+
+    // an edge keeps its two ends until it is collapsed, so a locked edge stays locked
+    if(isLocked.empty() == false){
+        for(int e = 0; e < mesh->n_edges; e++) if(IsLockedEdge(e)) heap.Remove(e);
+    }
+
+    STAT_MAX(STAT_PEAK_HEAP_SIZE, heap.Size());
+
+    TakeCheckpointIfDue();
+}
+
+size_t Simplification::MemoryUsage()
+{
+    return VectorBytes(Q) + VectorBytes(optimalCoord) + heap.MemoryUsage() + VectorBytes(isSuspended) +
+           VectorBytes(isLocked) + VectorBytes(regionStamp) + history.MemoryUsage() + CheckpointMemoryUsage() +
+           HierarchyMemoryUsage() + VectorBytes(isFaceNormalDirty) + VectorBytes(isVertexNormalDirty) +
+           VectorBytes(morphSlot);
 }
 
 
 void Simplification::AssignInitialQ()
 {
-    for(VertexIter vi = mesh->vertices.begin(); vi != mesh->vertices.end(); vi++){
+    vector<int> &heVertex = mesh->halfedges.vertex;
+    vector<int> &heMate   = mesh->halfedges.mate;
+
+    // Q of each vertex is summed by one iteration in a fixed order, so the result does not depend on the number of threads
+    #pragma omp parallel for schedule(dynamic, 1024)
+    for(int v = 0; v < mesh->n_vertices; v++){
 
-        for(int i = 0; i < 10; i++) vi->Q[i] = 0.0;
+        for(int i = 0; i < 10; i++) Q[10*v+i] = 0.0;
 
-        HalfEdge *startHalfEdge, *endHalfEdge;
+        // used by no face (see Mesh::AddEdgeInfo)
+        if(mesh->vertices.isActive[v] == false) continue;
 
-        if(vi->isBoundary == false) startHalfEdge = vi->neighborHe;
-        else                        startHalfEdge = FindBoundaryEdgeIncidentToVertexInCW(vi->neighborHe);
+        int startHalfEdge, endHalfEdge = NIL;
 
-        HalfEdge *hep = startHalfEdge;
+        if(mesh->vertices.isBoundary[v] == false) startHalfEdge = mesh->vertices.neighborHe[v];
+        else                                      startHalfEdge = FindBoundaryEdgeIncidentToVertexInCW(mesh->vertices.neighborHe[v]);
+
+        int hep = startHalfEdge;
         do{
-            CumulateQ(vi, hep->face->normal, -DotProduct(hep->face->normal, hep->face->halfedge[0].vertex->coord));
+            double faceNormal[3], faceCoord[3];
+            CopyToDouble(mesh->FaceNormal(FaceOfHalfEdge(hep)), faceNormal);
+            CopyToDouble(mesh->VertexCoord(heVertex[3*FaceOfHalfEdge(hep)]), faceCoord);
+
+            CumulateQ(v, faceNormal, -DotProduct(faceNormal, faceCoord));
 
-            if(vi->isBoundary && hep->prev->mate == NULL){
-                endHalfEdge = hep->prev;
+            if(mesh->vertices.isBoundary[v] && heMate[PrevHalfEdge(hep)] == NIL){
+                endHalfEdge = PrevHalfEdge(hep);
                 break;
             }
 
-            hep = hep->prev->mate;
-        }while(hep != startHalfEdge && hep != NULL);
+            hep = heMate[PrevHalfEdge(hep)];
+        }while(hep != startHalfEdge && hep != NIL);
 
 
-        if(vi->isBoundary){
-            // add pseudo face information to vi->Q
+        if(mesh->vertices.isBoundary[v]){
+            // add pseudo face information to Q of v
 
-            double boundaryVector[3], pseudoNormal[3];
+            double boundaryVector[3], pseudoNormal[3], faceNormal[3];
+            double startCoord[3], startNext[3], endCoord[3], endNext[3];
 
-            for(int i = 0; i < 3; i++) boundaryVector[i] = startHalfEdge->next->vertex->coord[i] - startHalfEdge->vertex->coord[i]; 
+            CopyToDouble(mesh->VertexCoord(heVertex[startHalfEdge]),               startCoord);
+            CopyToDouble(mesh->VertexCoord(heVertex[NextHalfEdge(startHalfEdge)]), startNext);
 
-            CrossProduct(boundaryVector, startHalfEdge->face->normal, pseudoNormal);
+            for(int i = 0; i < 3; i++) boundaryVector[i] = startNext[i] - startCoord[i];
+
+            CopyToDouble(mesh->FaceNormal(FaceOfHalfEdge(startHalfEdge)), faceNormal);
+            CrossProduct(boundaryVector, faceNormal, pseudoNormal);
             Normalize(pseudoNormal);
 
-            CumulateQ(vi, pseudoNormal, -DotProduct(pseudoNormal, startHalfEdge->vertex->coord));
+            CumulateQ(v, pseudoNormal, -DotProduct(pseudoNormal, startCoord));
+
+            CopyToDouble(mesh->VertexCoord(heVertex[endHalfEdge]),               endCoord);
+            CopyToDouble(mesh->VertexCoord(heVertex[NextHalfEdge(endHalfEdge)]), endNext);
 
-            for(int i = 0; i < 3; i++) boundaryVector[i] = endHalfEdge->next->vertex->coord[i] - endHalfEdge->vertex->coord[i]; 
+            for(int i = 0; i < 3; i++) boundaryVector[i] = endNext[i] - endCoord[i];
 
-            CrossProduct(boundaryVector, endHalfEdge->face->normal, pseudoNormal);
+            CopyToDouble(mesh->FaceNormal(FaceOfHalfEdge(endHalfEdge)), faceNormal);
+            CrossProduct(boundaryVector, faceNormal, pseudoNormal);
             Normalize(pseudoNormal);
 
-            CumulateQ(vi, pseudoNormal, -DotProduct(pseudoNormal, endHalfEdge->vertex->coord));
+            CumulateQ(v, pseudoNormal, -DotProduct(pseudoNormal, endCoord));
         }
 
-    } // for(VertexIter vi = vertices.begin(); vi != vertices.end(); vi++){
+    } // for(int v = 0; v < mesh->n_vertices; v++){
 
 }
 
-void Simplification::CumulateQ(VertexIter &vi, double *normal, double d)
+void Simplification::CumulateQ(int v, double *normal, double d)
 {
     double a = normal[0];
     double b = normal[1];
     double c = normal[2];
 
-    vi->Q[0] += a*a; 
-    vi->Q[1] += a*b; 
-    vi->Q[2] += a*c;   
-    vi->Q[3] += a*d;
-    vi->Q[4] += b*b; 
-    vi->Q[5] += b*c;  
-    vi->Q[6] += b*d;
-    vi->Q[7] += c*c; 
-    vi->Q[8] += c*d;
-    vi->Q[9] += d*d;
+    double *q = &Q[10*v];
+
+    q[0] += a*a;
+    q[1] += a*b;
+    q[2] += a*c;
+    q[3] += a*d;
+    q[4] += b*b;
+    q[5] += b*c;
+    q[6] += b*d;
+    q[7] += c*c;
+    q[8] += c*d;
+    q[9] += d*d;
 }
 
-void Simplification::ComputeOptimalCoordAndCost(EdgeIter &ei)
+// compute the optimal coordinates of the vertex after collapsing each edge in "edgeList", store them in
+// "optimalCoord", and the costs in "cost". the edges are handed to the quadric kernels in small blocks
+void Simplification::ComputeOptimalCoordAndCost(int n, const int *edgeList, double *cost)
 {
-    VertexIter v0 = ei->halfedge[0]->vertex;
-    VertexIter v1 = ei->halfedge[0]->next->vertex;
-
-    double newQ[4][4];
+    const int blockSize = 64;
 
-    newQ[0][0]              = v0->Q[0] + v1->Q[0];
-    newQ[0][1] = newQ[1][0] = v0->Q[1] + v1->Q[1];
-    newQ[0][2] = newQ[2][0] = v0->Q[2] + v1->Q[2];
-    newQ[0][3] = newQ[3][0] = v0->Q[3] + v1->Q[3];
-    newQ[1][1]              = v0->Q[4] + v1->Q[4];
-    newQ[1][2] = newQ[2][1] = v0->Q[5] + v1->Q[5];
-    newQ[1][3] = newQ[3][1] = v0->Q[6] + v1->Q[6];
-    newQ[2][2]              = v0->Q[7] + v1->Q[7];
-    newQ[2][3] = newQ[3][2] = v0->Q[8] + v1->Q[8];
-    newQ[3][3]              = v0->Q[9] + v1->Q[9];
+    QuadricCollapse collapse[blockSize];
+    double coord[3*blockSize];
 
-    double matrix[4][4], rhs[4] = { 0.0, 0.0, 0.0, 1.0 }, solution[4];
+    STAT_ADD(STAT_COST_EVALUATIONS, n);
 
-    for(int i = 0; i < 3; i++) for(int j = 0; j < 4; j++) matrix[i][j] = newQ[i][j];
-    matrix[3][0] = matrix[3][1] = matrix[3][2] = 0.0;
-    matrix[3][3] = 1.0;
+    for(int begin = 0; begin < n; begin += blockSize){
+        int size = (n - begin < blockSize) ? n - begin : blockSize;
 
-    double cost;
-    double optimalCoord[3];
+        for(int i = 0; i < size; i++){
+            int e  = edgeList[begin+i];
+            int v0 = mesh->halfedges.vertex[ mesh->edges.halfedge[2*e] ];
+            int v1 = mesh->halfedges.vertex[ NextHalfEdge(mesh->edges.halfedge[2*e]) ];
 
-    if( SolveLinearSystem(matrix, rhs, solution) ){
-        double temp[4];
-        for(int i = 0; i < 4; i++) temp[i] = DotProduct4D(newQ[i], solution);
-
-        cost = DotProduct4D(solution, temp);
-        for(int i = 0; i < 3; i++) optimalCoord[i] = solution[i];
-    }else{ // matrix is singular. solution is not unique.
-        cost = 0.0;
-        if(v0->isBoundary) for(int i = 0; i < 3; i++) optimalCoord[i] = v0->coord[i];
-        else               for(int i = 0; i < 3; i++) optimalCoord[i] = v1->coord[i];
-    }
+            collapse[i].q0     = &Q[10*v0];
+            collapse[i].q1     = &Q[10*v1];
+            collapse[i].coord0 = mesh->VertexCoord(v0);
+            collapse[i].coord1 = mesh->VertexCoord(v1);
+        }
 
-    // if "ei" is boundary, increase cost
-    if(v0->isBoundary || v1->isBoundary) cost += BOUNDARY_COST;
+        ComputeQuadricCollapses(size, collapse, coord, cost + begin);
 
+        for(int i = 0; i < size; i++){
+            int e  = edgeList[begin+i];
+            int v0 = mesh->halfedges.vertex[ mesh->edges.halfedge[2*e] ];
+            int v1 = mesh->halfedges.vertex[ NextHalfEdge(mesh->edges.halfedge[2*e]) ];
 
-    heap.push( EdgeCollapseTarget(ei, cost, optimalCoord, ect_id_base) );
-    ei->ect_id = ect_id_base;
+            for(int j = 0; j < 3; j++) optimalCoord[3*e+j] = coord[3*i+j];
 
-    ect_id_base++;
+            // if "e" is boundary, increase cost
+            if(mesh->vertices.isBoundary[v0] || mesh->vertices.isBoundary[v1]) cost[begin+i] += BOUNDARY_COST;
+        }
+    }
 }
 
 
-bool Simplification::EdgeCollapse()
+bool Simplification::EdgeCollapse(double maxCost)
 {
+    if(isSelective){
+        cerr << "EdgeCollapse: end the selective refinement first" << endl;
+        return false;
+    }
+
     if(n_active_faces < 3) return false;
 
-    // if "readdedEdgeCollapseTarget" is not empty, this must have the highest priority to collapse
-    if( readdedEdgeCollapseTarget.empty() == false ){
-        RemoveEdge(readdedEdgeCollapseTarget.top().ei, readdedEdgeCollapseTarget.top().optimalCoord, false);
+    // collapses undone by VertexSplit must be redone first, in their order
+    if( history.IsAtEnd() == false ){
+        RedoCollapse(history.Cursor());
 
-        readdedEdgeCollapseTarget.pop();
+        history.Redo();
+        TakeCheckpointIfDue();
         return true;
     }
 
 
-    list<EdgeCollapseTarget>::iterator ecti = suspendedEdgeCollapseTarget.begin();
-    while( ecti != suspendedEdgeCollapseTarget.end() ){
+    while(heap.Empty() == false){
+        int e = heap.Top();
 
-        if(ecti->ei->isActive == false || ecti->id != ecti->ei->ect_id){
-            // obsolete. delete this
-            ecti = suspendedEdgeCollapseTarget.erase(ecti);
-        }else{
-            if( IsFinWillNotBeCreated(ecti->ei) ){
-                RemoveEdge(ecti->ei, ecti->optimalCoord, true);
-                ecti = suspendedEdgeCollapseTarget.erase(ecti);
+        // every edge left costs more than "maxCost"
+        if(mesh->edges.isActive[e] == true && heap.Cost(e) > maxCost) return false;
+
+        heap.Pop();
+        STAT_COUNT(STAT_HEAP_POPS);
+
+        // edges removed by earlier collapses stay in the heap until they come to the top
+        if(mesh->edges.isActive[e] == true){
+
+            if( IsFinWillNotBeCreated(e) ){
+                RemoveEdge(e, &optimalCoord[3*e], true);
                 return true;
-            }else{
-                ecti++;
             }
+            else{
+                // taken out of the heap until a collapse nearby changes its neighborhood
+                isSuspended[e] = true;
+                STAT_COUNT(STAT_FIN_REJECTIONS);
+            }
+
+        }else{
+            STAT_COUNT(STAT_STALE_HEAP_POPS);
         }
 
     }
 
-    EdgeCollapseTarget ect;
+    return false;
+}
 
-    while(heap.empty() == false){
-        ect = heap.top();
-        heap.pop(); 
 
-        // ect.ei is an edge that is up-to-date
-        if(ect.ei->isActive == true && ect.id == ect.ei->ect_id){
-               
-            if( IsFinWillNotBeCreated(ect.ei) ){    
-                RemoveEdge(ect.ei, ect.optimalCoord, true); 
-                return true;
+void Simplification::ParallelEdgeCollapse(int n_target_faces, double maxCost, bool isDeterministic)
+{
+    if(isSelective){
+        cerr << "ParallelEdgeCollapse: end the selective refinement first" << endl;
+        return;
+    }
+
+    // collapses undone by VertexSplit are redone first, one by one in their order
+    while(history.IsAtEnd() == false && n_active_faces > n_target_faces) EdgeCollapse(maxCost);
+
+    // with a fixed batch size, the batches and therefore the result do not depend on the number of threads
+    int batchSize = isDeterministic ? PARALLEL_BATCH_SIZE : PARALLEL_BATCH_SIZE_PER_THREAD * omp_get_max_threads();
+
+    // keep at least one face, like EdgeCollapse
+    int n_faces_to_keep = (n_target_faces > 1) ? n_target_faces : 1;
+
+    while(n_active_faces > n_faces_to_keep){
+        STAT_TIMER(PHASE_PARALLEL_BATCH);
+
+        // on a small mesh most regions of a large batch would overlap. the mesh alone decides this limit
+        int size = n_active_faces / PARALLEL_FACES_PER_COLLAPSE;
+        if(size > batchSize) size = batchSize;
+        if(size < 1)         size = 1;
+
+        // the batches only shrink, so the buffers grow on the first one only
+        ReserveBatchSlots(size);
+
+        if(SelectIndependentCollapses(size, n_active_faces - n_faces_to_keep, maxCost) == 0) break;
+
+        ApplyIndependentCollapses();
+    }
+
+    // the last few faces, when the next collapse of the batch would have removed one face too many
+    while(n_active_faces > n_target_faces) if(EdgeCollapse(maxCost) == false) break;
+
+    UpdateNormals();
+}
+
+
+int Simplification::SelectIndependentCollapses(int batchSize, int n_removable_faces, double maxCost)
+{
+    ///////////////////////////////////////////////////////////////
+    // Take edges from the heap in the order of cost, and keep those whose region (v0, v1 and the vertices
+    // around them) shares no vertex with the region of an edge taken before. A collapse changes only faces
+    // incident to v0 or v1, and reads only faces incident to the vertices of its region, so the collapses
+    // of a batch do not see each other and can be applied in any order, at the same time.
+    // Edges that overlap are put back into the heap for a later batch
+    ///////////////////////////////////////////////////////////////
+
+    batchEdges.clear();
+    deferredEdges.clear();
+
+    currentBatch++;
+
+    int n_examined = 0;
+
+    while(heap.Empty() == false && (int)batchEdges.size() < batchSize && n_examined < 4*batchSize){
+        int e = heap.Top();
+
+        // edges removed by earlier collapses stay in the heap until they come to the top
+        if(mesh->edges.isActive[e] == false){
+            heap.Pop();
+            STAT_COUNT(STAT_HEAP_POPS);
+            STAT_COUNT(STAT_STALE_HEAP_POPS);
+            continue;
+        }
+
+        if(heap.Cost(e) > maxCost) break;
+
+        int n_faces = (mesh->halfedges.mate[ mesh->edges.halfedge[2*e] ] != NIL) ? 2 : 1;
+        if(n_faces > n_removable_faces) break;
+
+        heap.Pop();
+        STAT_COUNT(STAT_HEAP_POPS);
+        n_examined++;
+
+        CollectCollapseRegion(e, regionVertices);
+
+        bool isOverlapping = false;
+        for(unsigned int i = 0; i < regionVertices.size(); i++){
+            if(regionStamp[regionVertices[i]] == currentBatch){
+                isOverlapping = true;
+                break;
             }
-            else{            
-                suspendedEdgeCollapseTarget.push_back(ect); 
+        }
+
+        if(isOverlapping){
+            deferredEdges.push_back(e);
+            continue;
+        }
+
+        if( IsFinWillNotBeCreated(e) == false ){
+            // taken out of the heap until a collapse nearby changes its neighborhood
+            isSuspended[e] = true;
+            STAT_COUNT(STAT_FIN_REJECTIONS);
+            continue;
+        }
+
+        for(unsigned int i = 0; i < regionVertices.size(); i++) regionStamp[regionVertices[i]] = currentBatch;
+
+        batchEdges.push_back(e);
+        n_removable_faces -= n_faces;
+    }
+
+    for(unsigned int i = 0; i < deferredEdges.size(); i++) heap.Update(deferredEdges[i], heap.Cost(deferredEdges[i]));
+    STAT_MAX(STAT_PEAK_HEAP_SIZE, heap.Size());
+
+    return (int)batchEdges.size();
+}
+
+
+void Simplification::CollectCollapseRegion(int e, vector<int> &region)
+{
+    vector<int> &heVertex = mesh->halfedges.vertex;
+    vector<int> &heMate   = mesh->halfedges.mate;
+
+    region.clear();
+
+    int hepCollapse = mesh->edges.halfedge[2*e];
+
+    for(int k = 0; k < 2; k++){
+        int hepStart = (k == 0) ? hepCollapse : NextHalfEdge(hepCollapse);
+        int v        = heVertex[hepStart];
+
+        region.push_back(v);
+
+        int startHalfEdge;
+
+        if(mesh->vertices.isBoundary[v] == false) startHalfEdge = hepStart;
+        else                                      startHalfEdge = FindBoundaryEdgeIncidentToVertexInCW(hepStart);
+
+        int hep = startHalfEdge;
+        do{
+            region.push_back(heVertex[NextHalfEdge(hep)]);
+
+            if(heMate[PrevHalfEdge(hep)] == NIL){
+                region.push_back(heVertex[PrevHalfEdge(hep)]);
+                break;
             }
-                  
+
+            hep = heMate[PrevHalfEdge(hep)];
+        }while(hep != startHalfEdge);
+    }
+}
+
+
+void Simplification::ApplyIndependentCollapses()
+{
+    int n = (int)batchEdges.size();
+
+    ReserveBatchSlots(n);
+    ResizePerThreadLists();
+    isInParallelBatch = true;
+
+    // topology, Q, normals, the new costs around v1 and the suspended edges nearby.
+    // every collapse writes only inside its own region, and reads only there
+    #pragma omp parallel for schedule(dynamic, 16)
+    for(int i = 0; i < n; i++){
+        int e  = batchEdges[i];
+        int v1 = mesh->halfedges.vertex[ NextHalfEdge(mesh->edges.halfedge[2*e]) ];
+
+        threadSlot[omp_get_thread_num()] = i;
+        batchRemovedFaces[i] = ApplyEdgeCollapse(e, &optimalCoord[3*e], true, batchSplits[i], batchRings[i]);
+
+        batchRingCosts[i].resize(batchRings[i].size());
+        batchSuspended[i].clear();
+
+        if(batchRings[i].empty() == false){
+            ComputeOptimalCoordAndCost((int)batchRings[i].size(), &batchRings[i][0], &batchRingCosts[i][0]);
+            CollectSuspendedEdges(v1, batchSuspended[i]);
         }
+    }
+
+    isInParallelBatch = false;
+
+    // history and heap, in the order of the batch
+    for(int i = 0; i < n; i++){
+        n_active_faces -= batchRemovedFaces[i];
+
+        history.Push( batchSplits[i], n_active_faces );
+
+        for(unsigned int j = 0; j < batchRings[i].size();     j++) UpdateEdgeCost(batchRings[i][j], batchRingCosts[i][j]);
+        for(unsigned int j = 0; j < batchSuspended[i].size(); j++) ReadmitSuspendedEdge(batchSuspended[i][j]);
+
+        MoveToList(changedFaces[1+i],       changedFaces[0]);
+        MoveToList(dirtyFaceNormals[1+i],   dirtyFaceNormals[0]);
+        MoveToList(dirtyVertexNormals[1+i], dirtyVertexNormals[0]);
+    }
+
+    // the mesh is at the end of the batch only now
+    TakeCheckpointIfDue();
+}
+
+
+void Simplification::ResizePerThreadLists()
+{
+    // the number of threads may have been raised since the last batch
+    int n_threads = omp_get_max_threads();
+    int n_old     = (int)incidentFaces.size();
 
+    if(n_old >= n_threads) return;
+
+    incidentFaces.resize(n_threads);
+    threadSlot.resize(n_threads);
+
+    for(int i = n_old; i < n_threads; i++) incidentFaces[i].reserve(2*RING_RESERVE);
+}
+
+// room for a batch of "n" collapses. the slots only grow, so that their buffers are kept from batch to batch
+void Simplification::ReserveBatchSlots(int n)
+{
+    batchEdges.reserve(n);
+    deferredEdges.reserve(4*n);  // SelectIndependentCollapses examines at most 4 edges per collapse
+
+    int n_old = (int)batchSplits.size();
+
+    if(n_old >= n && changedFaces.empty() == false) return;
+
+    batchSplits.resize(n);
+    batchRings.resize(n);
+    batchRingCosts.resize(n);
+    batchRemovedFaces.resize(n);
+    batchSuspended.resize(n);
+
+    // the first lists are those of the serial collapses
+    changedFaces.resize(1 + n);
+    dirtyFaceNormals.resize(1 + n);
+    dirtyVertexNormals.resize(1 + n);
+
+    // room for the rings of most vertices, so that a slot rarely grows later
+    for(int i = n_old; i < n; i++){
+        batchSplits[i].halfedgesAroundV0.reserve(RING_RESERVE);
+        batchRings[i].reserve(RING_RESERVE);
+        batchRingCosts[i].reserve(RING_RESERVE);
+        batchSuspended[i].reserve(4*RING_RESERVE);
+
+        changedFaces[1+i].reserve(2*RING_RESERVE);
+        dirtyFaceNormals[1+i].reserve(RING_RESERVE);
+        dirtyVertexNormals[1+i].reserve(RING_RESERVE);
     }
+}
 
+// omp_get_thread_num() outside of the batches is the number of the caller in its own team, e.g. a worker of
+// MeshBatch, which may be beyond the lists
+int Simplification::PerThreadList()
+{
+    return isInParallelBatch ? omp_get_thread_num() : 0;
+}
 
-    return false;
+int Simplification::ChangeList()
+{
+    return isInParallelBatch ? 1 + threadSlot[omp_get_thread_num()] : 0;
+}
+
+
+void Simplification::RemoveEdge(int e, double *optimalCoord, bool isFirstCollapse)
+{
+    int v1 = mesh->halfedges.vertex[ NextHalfEdge(mesh->edges.halfedge[2*e]) ];
+
+    n_active_faces -= ApplyEdgeCollapse(e, optimalCoord, isFirstCollapse, collapseRecord, ringEdges);
+
+    if(isFirstCollapse){
+        history.Push( collapseRecord, n_active_faces );
+        TakeCheckpointIfDue();
+    }
+
+    // "ringEdges" is empty if no face is left around v1
+    if(isFirstCollapse && ringEdges.empty() == false){
+        // update cost and optimal vertex coordinate of incident edges, all in one batch
+        ringCost.resize(ringEdges.size());
+        ComputeOptimalCoordAndCost((int)ringEdges.size(), &ringEdges[0], &ringCost[0]);
+
+        for(unsigned int i = 0; i < ringEdges.size(); i++) UpdateEdgeCost(ringEdges[i], ringCost[i]);
+
+        CollectSuspendedEdges(v1, suspendedEdges);
+        for(unsigned int i = 0; i < suspendedEdges.size(); i++) ReadmitSuspendedEdge(suspendedEdges[i]);
+    }
 }
 
 
-void Simplification::RemoveEdge(EdgeIter &ei, double *optimalCoord, bool isFirstCollapse)
+int Simplification::ApplyEdgeCollapse(int e, double *optimalCoord, bool isFirstCollapse, VertexSplitTarget &split, vector<int> &ring)
 {
-    HalfEdge *hepCollapse = ei->halfedge[0];
+    vector<int> &heVertex     = mesh->halfedges.vertex;
+    vector<int> &heMate       = mesh->halfedges.mate;
+    vector<int> &heEdge       = mesh->halfedges.edge;
+    vector<int> &edgeHalfEdge = mesh->edges.halfedge;
+
+    int hepCollapse = edgeHalfEdge[2*e];
+    int hepNext     = NextHalfEdge(hepCollapse);
+    int hepPrev     = PrevHalfEdge(hepCollapse);
+    int hepMate     = heMate[hepCollapse];
+
+    int v0 = heVertex[hepCollapse];
+    int v1 = heVertex[hepNext];
+
+    STAT_COUNT(STAT_COLLAPSES);
+
+    ring.clear();
 
-    VertexIter v0 = hepCollapse->vertex;
-    VertexIter v1 = hepCollapse->next->vertex;
-   
     // inactivate removed faces
-    hepCollapse->face->isActive = false;
-    n_active_faces--;
+    int n_removed_faces = 1;
+    mesh->faces.isActive[FaceOfHalfEdge(hepCollapse)] = false;
 
 
-    if(hepCollapse->mate != NULL){
-        hepCollapse->mate->face->isActive = false;
-        n_active_faces--;
+    if(hepMate != NIL){
+        mesh->faces.isActive[FaceOfHalfEdge(hepMate)] = false;
+        n_removed_faces++;
     }
-    
-    vertexSplitTarget.push( VertexSplitTarget() ); 
 
-    vertexSplitTarget.top().ei = ei;
-    for(int i = 0; i < 3; i++) vertexSplitTarget.top().v1OrginalCoord[i] = v1->coord[i];
-    vertexSplitTarget.top().v1OriginalIsBoundary = v1->isBoundary;
+    mesh->vertices.isActive[v0] = false;
 
+    split.edge = e;
+    for(int i = 0; i < 3; i++) split.v1OrginalCoord[i]   = mesh->VertexCoord(v1)[i];
+    for(int i = 0; i < 3; i++) split.v1CollapsedCoord[i] = (Real)optimalCoord[i];
+    split.v1OriginalIsBoundary = mesh->vertices.isBoundary[v1] != false;
+    split.halfedgesAroundV0.clear();
 
-    HalfEdge *startHalfEdge;
 
-    vector<FaceIter> facesOriginallyIncidentToV0OrV1; 
+    int startHalfEdge;
 
-    if(v0->isBoundary == false) startHalfEdge = hepCollapse;
-    else                        startHalfEdge = FindBoundaryEdgeIncidentToVertexInCW(hepCollapse);
+    vector<int> &facesOriginallyIncidentToV0OrV1 = incidentFaces[PerThreadList()];
+    facesOriginallyIncidentToV0OrV1.clear();
 
-    HalfEdge *hep = startHalfEdge;
+    if(mesh->vertices.isBoundary[v0] == false) startHalfEdge = hepCollapse;
+    else                                       startHalfEdge = FindBoundaryEdgeIncidentToVertexInCW(hepCollapse);
+
+    int hep = startHalfEdge;
     do{
-        facesOriginallyIncidentToV0OrV1.push_back(hep->face);
+        facesOriginallyIncidentToV0OrV1.push_back(FaceOfHalfEdge(hep));
 
-        hep = hep->prev->mate;
-    }while(hep != startHalfEdge && hep != NULL);
+        hep = heMate[PrevHalfEdge(hep)];
+    }while(hep != startHalfEdge && hep != NIL);
 
-    if(v1->isBoundary == false) startHalfEdge = hepCollapse->next;
-    else                        startHalfEdge = FindBoundaryEdgeIncidentToVertexInCW(hepCollapse->next);
+    if(mesh->vertices.isBoundary[v1] == false) startHalfEdge = hepNext;
+    else                                       startHalfEdge = FindBoundaryEdgeIncidentToVertexInCW(hepNext);
 
     hep = startHalfEdge;
     do{
-        facesOriginallyIncidentToV0OrV1.push_back(hep->face);
+        facesOriginallyIncidentToV0OrV1.push_back(FaceOfHalfEdge(hep));
+
+        hep = heMate[PrevHalfEdge(hep)];
+    }while(hep != startHalfEdge && hep != NIL);
 
-        hep = hep->prev->mate;
-    }while(hep != startHalfEdge && hep != NULL);
+    if(isTrackingChanges){
+        vector<int> &changed = changedFaces[ChangeList()];
+        changed.insert(changed.end(), facesOriginallyIncidentToV0OrV1.begin(), facesOriginallyIncidentToV0OrV1.end());
+    }
 
 
-    if(v0->isBoundary == false) startHalfEdge = hepCollapse;
-    else                        startHalfEdge = FindBoundaryEdgeIncidentToVertexInCW(hepCollapse);
+    if(mesh->vertices.isBoundary[v0] == false) startHalfEdge = hepCollapse;
+    else                                       startHalfEdge = FindBoundaryEdgeIncidentToVertexInCW(hepCollapse);
 
     // replace v0 of halfedges with v1
     hep = startHalfEdge;
     do{
-        if(hep->face->isActive){
-             hep->vertex = v1;
+        if(mesh->faces.isActive[FaceOfHalfEdge(hep)]){
+             heVertex[hep] = v1;
 
-             vertexSplitTarget.top().halfedgesAroundV0.push_back(hep);
+             split.halfedgesAroundV0.push_back(hep);
         }
 
-        hep = hep->prev->mate;
-    }while(hep != startHalfEdge && hep != NULL);
+        hep = heMate[PrevHalfEdge(hep)];
+    }while(hep != startHalfEdge && hep != NIL);
 
 #ifdef DEBUG
     cerr << "e ";
 #endif
 
     // move v1 to optimalCoord
-    for(int i = 0; i < 3; i++)  v1->coord[i] = optimalCoord[i];
+    for(int i = 0; i < 3; i++)  mesh->VertexCoord(v1)[i] = (Real)optimalCoord[i];
 
 
     if(isFirstCollapse){
         // add v0's "Q" to v1's "Q"
-        for(int i = 0; i < 10; i++) v1->Q[i] += v0->Q[i];
+        AddQuadric(&Q[10*v1], &Q[10*v0]);
     }
 
     /////////////////////////////////////////////////////////////////////////////
     // reassign mates of halfedges and corresponding edge information as well
     /////////////////////////////////////////////////////////////////////////////
-    hepCollapse->edge->isActive = false;
+    mesh->edges.isActive[e] = false;
 
-    if(hepCollapse->next->mate != NULL) hepCollapse->next->mate->mate = hepCollapse->prev->mate;
-    if(hepCollapse->prev->mate != NULL) hepCollapse->prev->mate->mate = hepCollapse->next->mate;
+    if(heMate[hepNext] != NIL) heMate[heMate[hepNext]] = heMate[hepPrev];
+    if(heMate[hepPrev] != NIL) heMate[heMate[hepPrev]] = heMate[hepNext];
 
-    hepCollapse->prev->edge->isActive = false;
+    mesh->edges.isActive[heEdge[hepPrev]] = false;
 
-    if(hepCollapse->next->edge->halfedge[0] == hepCollapse->next) 
-        hepCollapse->next->edge->halfedge[0] = hepCollapse->prev->mate;
-    else                                         
-        hepCollapse->next->edge->halfedge[1] = hepCollapse->prev->mate;
+    int nextEdge = heEdge[hepNext];
 
-    // edge->halfedge[0] should not be NULL
-    if(hepCollapse->next->edge->halfedge[0] == NULL){
-        if(hepCollapse->next->edge->halfedge[1] != NULL){
+    if(edgeHalfEdge[2*nextEdge] == hepNext)
+        edgeHalfEdge[2*nextEdge]   = heMate[hepPrev];
+    else
+        edgeHalfEdge[2*nextEdge+1] = heMate[hepPrev];
+
+    // edge->halfedge[0] should not be NIL
+    if(edgeHalfEdge[2*nextEdge] == NIL){
+        if(edgeHalfEdge[2*nextEdge+1] != NIL){
             // swap
-            hepCollapse->next->edge->halfedge[0] = hepCollapse->next->edge->halfedge[1];
-            hepCollapse->next->edge->halfedge[1] = NULL;
-        }else{ // hepCollapse->next->edge->halfedge[0] == NULL and hepCollapse->next->edge->halfedge[1] == NULL
+            edgeHalfEdge[2*nextEdge]   = edgeHalfEdge[2*nextEdge+1];
+            edgeHalfEdge[2*nextEdge+1] = NIL;
+        }else{ // edgeHalfEdge[2*nextEdge] == NIL and edgeHalfEdge[2*nextEdge+1] == NIL
             // edge becomes degenerate
-            hepCollapse->next->edge->isActive = false;
+            mesh->edges.isActive[nextEdge] = false;
         }
     }
 
-    if(hepCollapse->prev->mate != NULL) hepCollapse->prev->mate->edge = hepCollapse->next->edge;
+    if(heMate[hepPrev] != NIL) heEdge[heMate[hepPrev]] = nextEdge;
+
+
+    int mateEdge = NIL;
 
+    if(hepMate != NIL){ // when "e" is not a boundary edge
+        int mateNext = NextHalfEdge(hepMate);
+        int matePrev = PrevHalfEdge(hepMate);
 
-    if(hepCollapse->mate != NULL){ // when "ect->ei" is not a boundary edge
-        if(hepCollapse->mate->next->mate != NULL) hepCollapse->mate->next->mate->mate = hepCollapse->mate->prev->mate;
-        if(hepCollapse->mate->prev->mate != NULL) hepCollapse->mate->prev->mate->mate = hepCollapse->mate->next->mate;
+        if(heMate[mateNext] != NIL) heMate[heMate[mateNext]] = heMate[matePrev];
+        if(heMate[matePrev] != NIL) heMate[heMate[matePrev]] = heMate[mateNext];
 
-        hepCollapse->mate->next->edge->isActive = false;
+        mesh->edges.isActive[heEdge[mateNext]] = false;
 
-        if(hepCollapse->mate->prev->edge->halfedge[0] == hepCollapse->mate->prev) 
-            hepCollapse->mate->prev->edge->halfedge[0] = hepCollapse->mate->next->mate;
-        else                                                      
-            hepCollapse->mate->prev->edge->halfedge[1] = hepCollapse->mate->next->mate;
+        mateEdge = heEdge[matePrev];
 
-        // edge->halfedge[0] should not be NULL
-        if(hepCollapse->mate->prev->edge->halfedge[0] == NULL){
-            if(hepCollapse->mate->prev->edge->halfedge[1] != NULL){
+        if(edgeHalfEdge[2*mateEdge] == matePrev)
+            edgeHalfEdge[2*mateEdge]   = heMate[mateNext];
+        else
+            edgeHalfEdge[2*mateEdge+1] = heMate[mateNext];
+
+        // edge->halfedge[0] should not be NIL
+        if(edgeHalfEdge[2*mateEdge] == NIL){
+            if(edgeHalfEdge[2*mateEdge+1] != NIL){
                 // swap
-                hepCollapse->mate->prev->edge->halfedge[0] = hepCollapse->mate->prev->edge->halfedge[1];
-                hepCollapse->mate->prev->edge->halfedge[1] = NULL;
-            }else{ // hepCollapse->mate->prev->edge->halfedge[0] == NULL and hepCollapse->mate->prev->edge->halfedge[1] == NULL
+                edgeHalfEdge[2*mateEdge]   = edgeHalfEdge[2*mateEdge+1];
+                edgeHalfEdge[2*mateEdge+1] = NIL;
+            }else{ // edgeHalfEdge[2*mateEdge] == NIL and edgeHalfEdge[2*mateEdge+1] == NIL
                 // edge becomes degenerate
-                hepCollapse->mate->prev->edge->isActive = false;
+                mesh->edges.isActive[mateEdge] = false;
             }
         }
 
-        if(hepCollapse->mate->next->mate != NULL) hepCollapse->mate->next->mate->edge = hepCollapse->mate->prev->edge;
-    
+        if(heMate[mateNext] != NIL) heEdge[heMate[mateNext]] = mateEdge;
+
     }
 
-   if( hepCollapse->next->edge->isActive == false && 
-       (hepCollapse->mate == NULL || hepCollapse->mate->prev->edge->isActive == false) ){
+   if( mesh->edges.isActive[nextEdge] == false &&
+       (hepMate == NIL || mesh->edges.isActive[mateEdge] == false) ){
        // face disappeared after edge collapsing
-       return;
+       return n_removed_faces;
    }
 
 
 
-    if(v0->isBoundary) v1->isBoundary = true;
+    if(mesh->vertices.isBoundary[v0]) mesh->vertices.isBoundary[v1] = true;
 
     FindNeighborHalfEdge(v1, facesOriginallyIncidentToV0OrV1);
 
-    if(v1->isBoundary == false) startHalfEdge = v1->neighborHe;
-    else                        startHalfEdge = FindBoundaryEdgeIncidentToVertexInCW(v1->neighborHe);
+    if(mesh->vertices.isBoundary[v1] == false) startHalfEdge = mesh->vertices.neighborHe[v1];
+    else                                       startHalfEdge = FindBoundaryEdgeIncidentToVertexInCW(mesh->vertices.neighborHe[v1]);
 
-    // update cost and optimal vertex coordinate of incident edges, and normals of incident faces, and incident vertices' neighborHe;
+    // update normals of incident faces and incident vertices' neighborHe, and collect incident edges
     hep = startHalfEdge;
     do{
 
-       if(isFirstCollapse) ComputeOptimalCoordAndCost(hep->edge);
+        ring.push_back(heEdge[hep]);
 
-        mesh->AssignFaceNormal(hep->face);
+        UpdateFaceNormal(FaceOfHalfEdge(hep));
 
-        hep->next->vertex->neighborHe = hep->next;
+        mesh->vertices.neighborHe[heVertex[NextHalfEdge(hep)]] = NextHalfEdge(hep);
 
-        if(hep->prev->mate == NULL){
-            if(isFirstCollapse) ComputeOptimalCoordAndCost(hep->prev->edge);    
-            hep->prev->vertex->neighborHe = hep->prev;
-            break;   
+        if(heMate[PrevHalfEdge(hep)] == NIL){
+            ring.push_back(heEdge[PrevHalfEdge(hep)]);
+            mesh->vertices.neighborHe[heVertex[PrevHalfEdge(hep)]] = PrevHalfEdge(hep);
+            break;
         }
 
-        hep = hep->prev->mate;
-    }while(hep != startHalfEdge && hep != NULL);
+        hep = heMate[PrevHalfEdge(hep)];
+    }while(hep != startHalfEdge && hep != NIL);
 
 
     // Finally, update vertex normals as well
-    mesh->AssignVertexNormal(v1);
+    UpdateVertexNormal(v1);
 
     hep = startHalfEdge;
     do{
-        mesh->AssignVertexNormal(hep->next->vertex);
+        UpdateVertexNormal(heVertex[NextHalfEdge(hep)]);
 
-        if(hep->prev->mate == NULL){ 
-            mesh->AssignVertexNormal(hep->prev->vertex);
-            break;   
+        if(heMate[PrevHalfEdge(hep)] == NIL){
+            UpdateVertexNormal(heVertex[PrevHalfEdge(hep)]);
+            break;
         }
 
-        hep = hep->prev->mate;
+        hep = heMate[PrevHalfEdge(hep)];
     }while(hep != startHalfEdge);
 
+    return n_removed_faces;
+}
+
+
+void Simplification::UpdateEdgeCost(int e, double cost)
+{
+    if(IsLockedEdge(e)) return;
+
+    heap.Update(e, cost);
+    isSuspended[e] = false;
+    STAT_MAX(STAT_PEAK_HEAP_SIZE, heap.Size());
+}
+
+
+bool Simplification::IsLockedEdge(int e)
+{
+    if(isLocked.empty()) return false;
+
+    int he = mesh->edges.halfedge[2*e];
+
+    return isLocked[ mesh->halfedges.vertex[he] ] || isLocked[ mesh->halfedges.vertex[NextHalfEdge(he)] ];
 }
 
-HalfEdge* Simplification::FindBoundaryEdgeIncidentToVertexInCW(HalfEdge *baseHalfEdge)
+
+void Simplification::ReadmitSuspendedEdge(int e)
+{
+    // an edge may be collected twice, or have its cost updated since
+    if(isSuspended[e]){
+        isSuspended[e] = false;
+        heap.Update(e, heap.Cost(e));
+        STAT_COUNT(STAT_READMISSIONS);
+        STAT_MAX(STAT_PEAK_HEAP_SIZE, heap.Size());
+    }
+}
+
+
+void Simplification::CollectSuspendedEdges(int v1, vector<int> &suspended)
 {
     ///////////////////////////////////////////////////////////////
-    // Find boundary edges incident to "baseHalfEdge->vertex" 
+    // A collapse into "v1" changes the neighbors of v1 and of the vertices around v1, and nothing else.
+    // Whether an edge creates a fin depends only on the neighbors of its two ends, so a suspended edge
+    // can only become collapsible if one of its ends is one of these vertices.
+    // Edges incident to v1 had their cost recomputed already. Put suspended edges incident to the
+    // vertices around v1 back into the heap with their cost (ReadmitSuspendedEdge). They are checked again
+    // when they are popped
     ///////////////////////////////////////////////////////////////
 
+    vector<int> &heVertex = mesh->halfedges.vertex;
+    vector<int> &heMate   = mesh->halfedges.mate;
+    vector<int> &heEdge   = mesh->halfedges.edge;
+
+    suspended.clear();
+
+    int startHalfEdge;
+
+    if(mesh->vertices.isBoundary[v1] == false) startHalfEdge = mesh->vertices.neighborHe[v1];
+    else                                       startHalfEdge = FindBoundaryEdgeIncidentToVertexInCW(mesh->vertices.neighborHe[v1]);
+
+    int hep = startHalfEdge;
+    do{
+        for(int k = 0; k < 2; k++){
+            // the vertex at the end of "hep", and on boundary, also the vertex at the start of the last edge
+            int hepAround;
+
+            if     (k == 0)                            hepAround = NextHalfEdge(hep);
+            else if(heMate[PrevHalfEdge(hep)] == NIL) hepAround = PrevHalfEdge(hep);
+            else                                       break;
+
+            int w = heVertex[hepAround];
+
+            int startHalfEdgeW;
+
+            if(mesh->vertices.isBoundary[w] == false) startHalfEdgeW = mesh->vertices.neighborHe[w];
+            else                                      startHalfEdgeW = FindBoundaryEdgeIncidentToVertexInCW(mesh->vertices.neighborHe[w]);
+
+            int hepW = startHalfEdgeW;
+            do{
+                int e = heEdge[hepW];
+                if(isSuspended[e] && mesh->edges.isActive[e]) suspended.push_back(e);
+                STAT_COUNT(STAT_SUSPENDED_SCANS);
+
+                if(heMate[PrevHalfEdge(hepW)] == NIL){
+                    e = heEdge[PrevHalfEdge(hepW)];
+                    if(isSuspended[e] && mesh->edges.isActive[e]) suspended.push_back(e);
+                    break;
+                }
+
+                hepW = heMate[PrevHalfEdge(hepW)];
+            }while(hepW != startHalfEdgeW);
+        }
+
+        if(heMate[PrevHalfEdge(hep)] == NIL) break;
+
+        hep = heMate[PrevHalfEdge(hep)];
+    }while(hep != startHalfEdge);
+}
+
+
+int Simplification::FindBoundaryEdgeIncidentToVertexInCW(int baseHalfEdge)
+{
+    ///////////////////////////////////////////////////////////////
+    // Find boundary edges incident to the origin of "baseHalfEdge"
+    ///////////////////////////////////////////////////////////////
+
+    vector<int> &heMate = mesh->halfedges.mate;
+
     // find a boundary edge by checking incident edges in CW if it exists
-    HalfEdge *hep = baseHalfEdge;
+    int hep = baseHalfEdge;
     do{
-        if(hep->mate == NULL) return hep;
+        if(heMate[hep] == NIL) return hep;
 
-        hep = hep->mate->next;
+        hep = NextHalfEdge(heMate[hep]);
     }while(hep != baseHalfEdge);
 
     // this should not happen
@@ -402,15 +893,17 @@ HalfEdge* Simplification::FindBoundaryEdgeIncidentToVertexInCW(HalfEdge *baseHal
 }
 
 
-void Simplification::FindNeighborHalfEdge(VertexIter &v1, vector<FaceIter> &facesOriginallyIncidentToV0OrV1)
+void Simplification::FindNeighborHalfEdge(int v1, vector<int> &facesOriginallyIncidentToV0OrV1)
 {
     // choose neighborHe of v1 from a face that is still active
 
     for(unsigned int i = 0; i < facesOriginallyIncidentToV0OrV1.size(); i++){
-        if(facesOriginallyIncidentToV0OrV1[i]->isActive == true){
+        int f = facesOriginallyIncidentToV0OrV1[i];
+
+        if(mesh->faces.isActive[f] == true){
             for(int j = 0; j < 3; j++){
-                if(facesOriginallyIncidentToV0OrV1[i]->halfedge[j].vertex == v1) {
-                    v1->neighborHe = &(facesOriginallyIncidentToV0OrV1[i]->halfedge[j]);
+                if(mesh->halfedges.vertex[3*f+j] == v1) {
+                    mesh->vertices.neighborHe[v1] = 3*f+j;
                     break;
                 }
             }
@@ -421,59 +914,104 @@ void Simplification::FindNeighborHalfEdge(VertexIter &v1, vector<FaceIter> &face
 
 
 
-bool Simplification::IsFinWillNotBeCreated(EdgeIter &ei)
+bool Simplification::IsFinWillNotBeCreated(int e)
 {
-    HalfEdge *hepCollapse = ei->halfedge[0];
+    vector<int> &heVertex = mesh->halfedges.vertex;
+    vector<int> &heMate   = mesh->halfedges.mate;
+
+    int hepCollapse = mesh->edges.halfedge[2*e];
+    int hepMate     = heMate[hepCollapse];
+
+    int v0 = heVertex[hepCollapse];
+    int v1 = heVertex[NextHalfEdge(hepCollapse)];
+
+    // the vertex opposite to the edge in a removed face must keep another face, or it is left active without
+    // any, and the walks around it follow stale mates. small parts of a mesh, as left by vertex clustering,
+    // come to this
+    int removedFace0 = FaceOfHalfEdge(hepCollapse);
+    int removedFace1 = (hepMate != NIL) ? FaceOfHalfEdge(hepMate) : NIL;
+
+    for(int k = 0; k < 2; k++){
+        int hepW = (k == 0) ? PrevHalfEdge(hepCollapse) : ((hepMate != NIL) ? PrevHalfEdge(hepMate) : NIL);
+        if(hepW == NIL) continue;
+
+        int startHalfEdgeW;
 
-    VertexIter v0 = hepCollapse->vertex;
-    VertexIter v1 = hepCollapse->next->vertex;
+        if(mesh->vertices.isBoundary[heVertex[hepW]] == false) startHalfEdgeW = hepW;
+        else                                                   startHalfEdgeW = FindBoundaryEdgeIncidentToVertexInCW(hepW);
 
-    HalfEdge *startHalfEdgeV0, *startHalfEdgeV1;
+        bool hasOtherFace = false;
+
+        int hep = startHalfEdgeW;
+        do{
+            int f = FaceOfHalfEdge(hep);
+
+            if(f != removedFace0 && f != removedFace1){
+                hasOtherFace = true;
+                break;
+            }
+
+            hep = heMate[PrevHalfEdge(hep)];
+        }while(hep != startHalfEdgeW && hep != NIL);
+
+        if(hasOtherFace == false) return false;
+    }
+
+    int startHalfEdgeV0, startHalfEdgeV1;
 
     // change neighborHE to make sure that it is outside of collapsed face
-    if(v0->isBoundary == false) startHalfEdgeV0 = hepCollapse;
-    else                        startHalfEdgeV0 = FindBoundaryEdgeIncidentToVertexInCW(hepCollapse);
+    if(mesh->vertices.isBoundary[v0] == false) startHalfEdgeV0 = hepCollapse;
+    else                                       startHalfEdgeV0 = FindBoundaryEdgeIncidentToVertexInCW(hepCollapse);
 
 
-    if(v1->isBoundary == false) startHalfEdgeV1 = hepCollapse->next;
-    else                        startHalfEdgeV1 = FindBoundaryEdgeIncidentToVertexInCW(hepCollapse->next);
+    if(mesh->vertices.isBoundary[v1] == false) startHalfEdgeV1 = NextHalfEdge(hepCollapse);
+    else                                       startHalfEdgeV1 = FindBoundaryEdgeIncidentToVertexInCW(NextHalfEdge(hepCollapse));
 
-    HalfEdge *hepV0 = startHalfEdgeV0;
+    int oppositeVertex     = heVertex[PrevHalfEdge(hepCollapse)];
+    int mateOppositeVertex = (hepMate != NIL) ? heVertex[PrevHalfEdge(hepMate)] : NIL;
+
+    int hepV0 = startHalfEdgeV0;
     do{
-        HalfEdge *hepV1 = startHalfEdgeV1;
+        int nextV0 = heVertex[NextHalfEdge(hepV0)];
+        int prevV0 = heVertex[PrevHalfEdge(hepV0)];
+
+        int hepV1 = startHalfEdgeV1;
         do{
-            if(hepV0->next->vertex == hepV1->next->vertex ||
-               (hepV1->prev->mate == NULL && hepV0->next->vertex == hepV1->prev->vertex) ){
-                VertexIter commonVertex = hepV0->next->vertex;
-                
-                if( commonVertex != hepCollapse->prev->vertex && 
-                    (hepCollapse->mate != NULL && commonVertex != hepCollapse->mate->prev->vertex) ){
+            int nextV1 = heVertex[NextHalfEdge(hepV1)];
+            int prevV1 = heVertex[PrevHalfEdge(hepV1)];
+
+            if(nextV0 == nextV1 ||
+               (heMate[PrevHalfEdge(hepV1)] == NIL && nextV0 == prevV1) ){
+                int commonVertex = nextV0;
+
+                if( commonVertex != oppositeVertex &&
+                    (hepMate != NIL && commonVertex != mateOppositeVertex) ){
 
                     return false;
                 }
             }
 
-            if(hepV0->prev->mate == NULL){
+            if(heMate[PrevHalfEdge(hepV0)] == NIL){
 
-                if(hepV0->prev->vertex == hepV1->next->vertex ||
-                    (hepV1->prev->mate == NULL && hepV0->prev->vertex == hepV1->prev->vertex) ){
-                        VertexIter commonVertex = hepV0->prev->vertex;
+                if(prevV0 == nextV1 ||
+                    (heMate[PrevHalfEdge(hepV1)] == NIL && prevV0 == prevV1) ){
+                        int commonVertex = prevV0;
 
-                        if( commonVertex != hepCollapse->prev->vertex && 
-                            (hepCollapse->mate != NULL && commonVertex != hepCollapse->mate->prev->vertex) ){
+                        if( commonVertex != oppositeVertex &&
+                            (hepMate != NIL && commonVertex != mateOppositeVertex) ){
                                 return false;
                         }
                 }
 
-            } // if(hepV0->prev->mate == NULL){
+            } // if(heMate[PrevHalfEdge(hepV0)] == NIL){
+
+            hepV1 = heMate[PrevHalfEdge(hepV1)];
+        }while(hepV1 != startHalfEdgeV1 && hepV1 != NIL);
 
-            hepV1 = hepV1->prev->mate;
-        }while(hepV1 != startHalfEdgeV1 && hepV1 != NULL);
+        hepV0 = heMate[PrevHalfEdge(hepV0)];
+    }while(hepV0 != startHalfEdgeV0 && hepV0 != NIL);
 
-        hepV0 = hepV0->prev->mate;
-    }while(hepV0 != startHalfEdgeV0 && hepV0 != NULL);
 
-        
     return true;
 }
 
@@ -482,115 +1020,252 @@ bool Simplification::IsFinWillNotBeCreated(EdgeIter &ei)
 
 void Simplification::VertexSplit()
 {
-    if(vertexSplitTarget.empty() == false){
+    if(isSelective){
+        cerr << "VertexSplit: end the selective refinement first" << endl;
+        return;
+    }
+
+    if(history.Cursor() > 0){
+        // the record stays in the history, and EdgeCollapse redoes it next
+        UndoCollapse(history.Cursor() - 1);
+
+        history.Undo();
+    }
+}
+
+
+void Simplification::UpdateFaceNormal(int f)
+{
+    if(isDeferringNormals == false){
+        mesh->AssignFaceNormal(f);
+        return;
+    }
+
+    // a collapse of a parallel batch marks only inside its own region
+    if(isFaceNormalDirty[f] == false){
+        isFaceNormalDirty[f] = true;
+        dirtyFaceNormals[ChangeList()].push_back(f);
+    }
+}
+
+void Simplification::UpdateVertexNormal(int v)
+{
+    if(isDeferringNormals == false){
+        mesh->AssignVertexNormal(v);
+        return;
+    }
 
-        HalfEdge *hepCollapsed = vertexSplitTarget.top().ei->halfedge[0];
+    if(isVertexNormalDirty[v] == false){
+        isVertexNormalDirty[v] = true;
+        dirtyVertexNormals[ChangeList()].push_back(v);
+    }
+}
 
 
-        VertexIter v0 = hepCollapsed->vertex; 
-        VertexIter v1 = hepCollapsed->next->vertex; 
+void Simplification::DeferNormals(bool isDeferring)
+{
+    if(isDeferring == false) UpdateNormals();
 
+    isDeferringNormals = isDeferring;
 
-        // re-add EdgeCollapseTarget in the stack before rechange "v1"
-        readdedEdgeCollapseTarget.push( EdgeCollapseTarget(vertexSplitTarget.top().ei, -1, v1->coord, -1) );
+    if(isDeferring && mesh != NULL && isFaceNormalDirty.empty()){
+        isFaceNormalDirty.assign(mesh->n_faces, false);
+        isVertexNormalDirty.assign(mesh->n_vertices, false);
 
+        dirtyFaceNormals[0].reserve(mesh->n_faces);
+        dirtyVertexNormals[0].reserve(mesh->n_vertices);
+    }
+}
 
-        for(int i = 0; i < 3; i++) v1->coord[i] = vertexSplitTarget.top().v1OrginalCoord[i];
-        v1->isBoundary = vertexSplitTarget.top().v1OriginalIsBoundary;
 
-        hepCollapsed->edge->isActive = true;
+void Simplification::UpdateNormals()
+{
+    if(isDeferringNormals == false || mesh == NULL) return;
 
-        FaceIter f0 = hepCollapsed->face;
+    STAT_TIMER(PHASE_UPDATE_NORMALS);
 
-        f0->isActive = true;
-        n_active_faces++;
+    // the faces first, since a vertex normal is summed from the face normals and areas.
+    // each normal is written by one iteration only. outside of the batches, all are in the first lists
+    vector<int> &faces = dirtyFaceNormals[0];
+    int n = (int)faces.size();
 
-        if(hepCollapsed->next->mate != NULL) hepCollapsed->next->mate->mate = hepCollapsed->next;
-        if(hepCollapsed->prev->mate != NULL) hepCollapsed->prev->mate->mate = hepCollapsed->prev;
+    #pragma omp parallel for
+    for(int i = 0; i < n; i++){
+        int f = faces[i];
 
-        hepCollapsed->prev->edge->isActive = true;
+        isFaceNormalDirty[f] = false;
+        if(mesh->faces.isActive[f]) mesh->AssignFaceNormal(f);
+    }
 
-        if(hepCollapsed->next->edge->halfedge[0] == hepCollapsed->next->mate) 
-            hepCollapsed->next->edge->halfedge[1] = hepCollapsed->next;
-        else                 
-            hepCollapsed->next->edge->halfedge[0] = hepCollapsed->next;
-  
+    faces.clear();
 
-        for(int i = 0; i < 3; i++){
-            f0->halfedge[i].vertex->neighborHe = &(f0->halfedge[i]);
-        }
+    vector<int> &vertices = dirtyVertexNormals[0];
+    n = (int)vertices.size();
 
-        if(hepCollapsed->mate != NULL){
-            FaceIter f1 = hepCollapsed->mate->face;
+    #pragma omp parallel for
+    for(int i = 0; i < n; i++){
+        int v = vertices[i];
 
-            f1->isActive = true;
-            n_active_faces++;
+        isVertexNormalDirty[v] = false;
+        if(mesh->vertices.isActive[v]) mesh->AssignVertexNormal(v);
+    }
 
-            if(hepCollapsed->mate->next->mate != NULL) hepCollapsed->mate->next->mate->mate = hepCollapsed->mate->next;
-            if(hepCollapsed->mate->prev->mate != NULL) hepCollapsed->mate->prev->mate->mate = hepCollapsed->mate->prev;
+    vertices.clear();
+}
 
-            hepCollapsed->mate->prev->edge->isActive = true;
 
-            if(hepCollapsed->mate->prev->edge->halfedge[0] == hepCollapsed->mate->prev->mate) 
-                hepCollapsed->mate->prev->edge->halfedge[1] = hepCollapsed->mate->prev;
-            else                 
-                hepCollapsed->mate->prev->edge->halfedge[0] = hepCollapsed->mate->prev;
+void Simplification::ClearDirtyNormals()
+{
+    for(unsigned int i = 0; i < dirtyFaceNormals.size(); i++){
+        for(unsigned int j = 0; j < dirtyFaceNormals[i].size(); j++) isFaceNormalDirty[dirtyFaceNormals[i][j]] = false;
+        dirtyFaceNormals[i].clear();
+    }
 
-            for(int i = 0; i < 3; i++){
-                f1->halfedge[i].vertex->neighborHe = &(f1->halfedge[i]);
-            }
+    for(unsigned int i = 0; i < dirtyVertexNormals.size(); i++){
+        for(unsigned int j = 0; j < dirtyVertexNormals[i].size(); j++) isVertexNormalDirty[dirtyVertexNormals[i][j]] = false;
+        dirtyVertexNormals[i].clear();
+    }
+}
 
-        }
 
-        for(unsigned int i = 0; i < vertexSplitTarget.top().halfedgesAroundV0.size(); i++){
-            HalfEdge *hep = vertexSplitTarget.top().halfedgesAroundV0[i];
+void Simplification::RedoCollapse(int record)
+{
+    double coord[3];
+
+    history.Get(record, collapseRecord);
+    CopyToDouble(collapseRecord.v1CollapsedCoord, coord);
+
+    n_active_faces -= ApplyEdgeCollapse(collapseRecord.edge, coord, false, collapseRecord, ringEdges);
+}
+
+
+void Simplification::UndoCollapse(int record)
+{
+    vector<int> &heVertex     = mesh->halfedges.vertex;
+    vector<int> &heMate       = mesh->halfedges.mate;
+    vector<int> &heEdge       = mesh->halfedges.edge;
+    vector<int> &edgeHalfEdge = mesh->edges.halfedge;
+
+    history.Get(record, collapseRecord);
+    STAT_COUNT(STAT_SPLITS);
+
+    int e = collapseRecord.edge;
+
+    int hepCollapsed = edgeHalfEdge[2*e];
+    int hepNext      = NextHalfEdge(hepCollapsed);
+    int hepPrev      = PrevHalfEdge(hepCollapsed);
+    int hepMate      = heMate[hepCollapsed];
+
+
+    int v0 = heVertex[hepCollapsed];
+    int v1 = heVertex[hepNext];
+
+
+    for(int i = 0; i < 3; i++) mesh->VertexCoord(v1)[i] = collapseRecord.v1OrginalCoord[i];
+    mesh->vertices.isBoundary[v1] = collapseRecord.v1OriginalIsBoundary;
+
+    mesh->vertices.isActive[v0] = true;
+
+    mesh->edges.isActive[e] = true;
+
+    int f0 = FaceOfHalfEdge(hepCollapsed);
+
+    mesh->faces.isActive[f0] = true;
+    n_active_faces++;
+
+    if(heMate[hepNext] != NIL) heMate[heMate[hepNext]] = hepNext;
+    if(heMate[hepPrev] != NIL) heMate[heMate[hepPrev]] = hepPrev;
+
+    mesh->edges.isActive[heEdge[hepPrev]] = true;
+
+    int nextEdge = heEdge[hepNext];
+
+    if(edgeHalfEdge[2*nextEdge] == heMate[hepNext])
+        edgeHalfEdge[2*nextEdge+1] = hepNext;
+    else
+        edgeHalfEdge[2*nextEdge]   = hepNext;
 
-            hep->vertex = v0;
+
+    for(int i = 0; i < 3; i++){
+        mesh->vertices.neighborHe[heVertex[3*f0+i]] = 3*f0+i;
+    }
+
+    if(hepMate != NIL){
+        int mateNext = NextHalfEdge(hepMate);
+        int matePrev = PrevHalfEdge(hepMate);
+
+        int f1 = FaceOfHalfEdge(hepMate);
+
+        mesh->faces.isActive[f1] = true;
+        n_active_faces++;
+
+        if(heMate[mateNext] != NIL) heMate[heMate[mateNext]] = mateNext;
+        if(heMate[matePrev] != NIL) heMate[heMate[matePrev]] = matePrev;
+
+        int mateEdge = heEdge[matePrev];
+
+        mesh->edges.isActive[mateEdge] = true;
+
+        if(edgeHalfEdge[2*mateEdge] == heMate[matePrev])
+            edgeHalfEdge[2*mateEdge+1] = matePrev;
+        else
+            edgeHalfEdge[2*mateEdge]   = matePrev;
+
+        for(int i = 0; i < 3; i++){
+            mesh->vertices.neighborHe[heVertex[3*f1+i]] = 3*f1+i;
         }
 
+    }
 
-        // update normal vectors
-        for(int i = 0; i < 2; i++){
-            VertexIter v_target;
+    for(unsigned int i = 0; i < collapseRecord.halfedgesAroundV0.size(); i++){
+        int hep = collapseRecord.halfedgesAroundV0[i];
 
-            if(i == 0) v_target = v0;
-            else       v_target = v1;
+        heVertex[hep] = v0;
+    }
 
-            HalfEdge *startHalfEdge;
 
-            if(v_target->isBoundary == false) startHalfEdge = v_target->neighborHe;
-            else                              startHalfEdge = FindBoundaryEdgeIncidentToVertexInCW(v_target->neighborHe);
+    // update normal vectors
+    for(int i = 0; i < 2; i++){
+        int v_target;
 
-            // update cost and optimal vertex coordinate of incident edges, and normals of incident faces, and incident vertices' neighborHe;
-            HalfEdge *hep = startHalfEdge;
-            do{
-                mesh->AssignFaceNormal(hep->face);
+        if(i == 0) v_target = v0;
+        else       v_target = v1;
 
-                hep = hep->prev->mate;
-            }while(hep != startHalfEdge && hep != NULL);
+        int startHalfEdge;
 
-            mesh->AssignVertexNormal(v_target);
+        if(mesh->vertices.isBoundary[v_target] == false) startHalfEdge = mesh->vertices.neighborHe[v_target];
+        else                                             startHalfEdge = FindBoundaryEdgeIncidentToVertexInCW(mesh->vertices.neighborHe[v_target]);
 
-            hep = startHalfEdge;
-            do{
-                mesh->AssignVertexNormal(hep->next->vertex);
+        // update cost and optimal vertex coordinate of incident edges, and normals of incident faces, and incident vertices' neighborHe;
+        int hep = startHalfEdge;
+        do{
+            UpdateFaceNormal(FaceOfHalfEdge(hep));
 
-                if(hep->prev->mate == NULL){ 
-                    mesh->AssignVertexNormal(hep->prev->vertex);
-                    break;   
-                }
+            hep = heMate[PrevHalfEdge(hep)];
+        }while(hep != startHalfEdge && hep != NIL);
 
-                hep = hep->prev->mate;
-            }while(hep != startHalfEdge);
+        UpdateVertexNormal(v_target);
 
-        } // for(int i = 0; i < 2; i++){
+        hep = startHalfEdge;
+        do{
+            UpdateVertexNormal(heVertex[NextHalfEdge(hep)]);
 
+            if(heMate[PrevHalfEdge(hep)] == NIL){
+                UpdateVertexNormal(heVertex[PrevHalfEdge(hep)]);
+                break;
+            }
 
+            hep = heMate[PrevHalfEdge(hep)];
+        }while(hep != startHalfEdge);
 
-        vertexSplitTarget.pop();
-    
-    } // if(vertexSplitTarget.empty() == false){
+    } // for(int i = 0; i < 2; i++){
 
+    if(isTrackingChanges){
+        vector<int> &changed = changedFaces[ChangeList()];
+
+        CollectFacesAroundVertex(mesh->vertices.neighborHe[v0], changed);
+        CollectFacesAroundVertex(mesh->vertices.neighborHe[v1], changed);
+    }
 }
 
 
@@ -601,11 +1276,154 @@ void Simplification::ControlLevelOfDetail(int step)
 
     cerr << "step " << step << " " << n_target_faces << " " << mesh->n_faces << endl;
 
-    if(n_target_faces < n_active_faces){
-        while(n_target_faces < n_active_faces) if(EdgeCollapse() == false) break;
-    }else if(n_target_faces > n_active_faces){
-        while(n_target_faces > n_active_faces) VertexSplit();
+    SeekFaceCount(n_target_faces);
+}
+
+bool Simplification::ControlLevelOfDetail(int step, Geomorph &morph)
+{
+    int n_target_faces = mesh->n_faces*pow(0.95, step);
+
+    cerr << "step " << step << " " << n_target_faces << " " << mesh->n_faces << endl;
+
+    return BeginGeomorph(n_target_faces, morph);
+}
+
+
+void Simplification::SeekFaceCount(int n_target_faces)
+{
+    if(isSelective){
+        cerr << "SeekFaceCount: end the selective refinement first" << endl;
+        return;
     }
 
+    STAT_TIMER(PHASE_SEEK);
+
+    SeekRecord(history.FindCursor(n_target_faces));
+
+    // below the recorded levels
+    while(n_active_faces > n_target_faces) if(EdgeCollapse() == false) break;
+
+    UpdateNormals();
 }
 
+
+void Simplification::SeekRecord(int target)
+{
+    // the checkpoints of the slots around the target, if one is nearer than the current level
+    if(checkpointInterval > 0){
+        int n_dropped = history.NumberOfDropped();
+        int distance  = abs(target - history.Cursor());
+        int slot      = (n_dropped + target) / checkpointInterval;
+
+        MeshCheckpoint *nearest = NULL;
+
+        for(int k = slot - 1; k <= slot + 1; k++){
+            if(k < 0 || k >= (int)checkpoints.size()) continue;
+
+            MeshCheckpoint &checkpoint = checkpoints[k];
+
+            // checkpoints of dropped records cannot be used
+            if(checkpoint.record == NIL || checkpoint.record < n_dropped) continue;
+
+            if(abs(checkpoint.record - n_dropped - target) < distance){
+                distance = abs(checkpoint.record - n_dropped - target);
+                nearest  = &checkpoint;
+            }
+        }
+
+        if(nearest != NULL) RestoreCheckpoint(*nearest);
+    }
+
+    while(history.Cursor() > target) VertexSplit();
+    while(history.Cursor() < target) EdgeCollapse();
+}
+
+
+// assigning an empty mesh would keep the memory
+template <class T> static void FreeVector(vector<T> &a){ vector<T>().swap(a); }
+
+static void FreeMeshArrays(Mesh &mesh)
+{
+    FreeVector(mesh.vertices.coord);    FreeVector(mesh.vertices.normal);   FreeVector(mesh.vertices.neighborHe);
+    FreeVector(mesh.vertices.isBoundary);   FreeVector(mesh.vertices.isActive);
+    FreeVector(mesh.halfedges.vertex);  FreeVector(mesh.halfedges.mate);    FreeVector(mesh.halfedges.edge);
+    FreeVector(mesh.faces.normal);      FreeVector(mesh.faces.area);        FreeVector(mesh.faces.isActive);
+    FreeVector(mesh.edges.halfedge);    FreeVector(mesh.edges.isActive);
+}
+
+void Simplification::TakeCheckpointIfDue()
+{
+    if(checkpointInterval <= 0 || history.IsRecording() == false) return;
+
+    int record = history.NumberOfDropped() + history.Cursor();
+    int slot   = record / checkpointInterval;
+
+    if(slot < (int)checkpoints.size() && checkpoints[slot].record != NIL) return;
+
+    if(slot >= (int)checkpoints.size()) checkpoints.resize(slot + 1);
+
+    // free the checkpoints of dropped records
+    for(int k = 0; k < slot; k++){
+        if(checkpoints[k].record != NIL && checkpoints[k].record < history.NumberOfDropped()){
+            checkpoints[k].record = NIL;
+            FreeMeshArrays(checkpoints[k].mesh);
+        }
+    }
+
+    // the copy is restored with its normals as they are
+    UpdateNormals();
+
+    STAT_TIMER(PHASE_CHECKPOINT);
+
+    MeshCheckpoint &checkpoint = checkpoints[slot];
+
+    checkpoint.record         = record;
+    checkpoint.n_active_faces = n_active_faces;
+    checkpoint.mesh           = *mesh;
+}
+
+
+void Simplification::RestoreCheckpoint(MeshCheckpoint &checkpoint)
+{
+    // the heap, the quadrics and the suspended edges are those of the last level recorded, and
+    // collapses that are redone or undone do not change them. only the mesh depends on the level
+    STAT_TIMER(PHASE_CHECKPOINT);
+    STAT_COUNT(STAT_CHECKPOINT_RESTORES);
+
+    *mesh = checkpoint.mesh;
+    isMeshReplaced = true;
+    ClearDirtyNormals();
+
+    n_active_faces = checkpoint.n_active_faces;
+    history.SetCursor(checkpoint.record - history.NumberOfDropped());
+}
+
+
+bool Simplification::TakeChangedFaces(vector<int> &faces)
+{
+    UpdateNormals();
+
+    faces.clear();
+
+    for(unsigned int i = 0; i < changedFaces.size(); i++){
+        if(isMeshReplaced == false) faces.insert(faces.end(), changedFaces[i].begin(), changedFaces[i].end());
+        changedFaces[i].clear();
+    }
+
+    if(isMeshReplaced){
+        isMeshReplaced = false;
+        return false;
+    }
+
+    return true;
+}
+
+
+size_t Simplification::CheckpointMemoryUsage()
+{
+    size_t size = 0;
+
+    for(unsigned int k = 0; k < checkpoints.size(); k++) size += checkpoints[k].mesh.MemoryUsage();
+
+    return size;
+}
@@ -1,59 +1,226 @@
+#include "heap.h"
+#include "history.h"
+#include "geomorph.h"
+#include <cfloat>
 
-struct EdgeCollapseTarget {
-    EdgeIter ei;
-    double cost;
-    double optimalCoord[3];
-    int id;
-
-    EdgeCollapseTarget(){}
-    EdgeCollapseTarget(EdgeIter &ei_in, double cost_in, double *optimalCoord_in, int id_in) {
-        ei   = ei_in;
-        cost = cost_in;
-        for(int i = 0; i < 3; i++) optimalCoord[i] = optimalCoord_in[i];
-        id   = id_in;
-    }
-};
-
-struct VertexSplitTarget {
-
-    EdgeIter ei;
-    double   v1OrginalCoord[3];
-    bool     v1OriginalIsBoundary;
-    vector<HalfEdge*> halfedgesAroundV0;
-
-    int id;
+// a copy of the mesh at one record of the history
+struct MeshCheckpoint {
+    int  record;                // counted from the first collapse, dropped ones included. NIL if not taken
+    int  n_active_faces;
+    Mesh mesh;
 
-    VertexSplitTarget(){}
+    MeshCheckpoint(){ record = NIL; n_active_faces = 0; }
 };
 
+// a perspective camera, for the selective refinement
+struct ViewParameters {
+    double eye[3];         // in the coordinates of the mesh
+    double direction[3];   // of the view, of unit length
+    double fieldOfView;    // vertical, in radians
+    double aspect;         // width / height of the window
+    int    screenHeight;   // in pixels
+    double tolerance;      // the largest error allowed on the screen, in pixels
+};
 
 class Simplification {
     Mesh *mesh;
 
-    priority_queue <EdgeCollapseTarget, deque<EdgeCollapseTarget>, greater<EdgeCollapseTarget>> heap;
-    list<EdgeCollapseTarget> suspendedEdgeCollapseTarget;
+    vector<double> Q;             // 10 per vertex, upper triangle of the symmetric 4x4 quadric
+    vector<double> optimalCoord;  // 3 per edge, where the vertex goes if the edge is collapsed
+
+    IndexedHeap heap;             // edges by collapse cost
+    vector<char> isSuspended;     // per edge. out of the heap because collapsing it would create a fin
+    vector<char> isLocked;        // per vertex, or empty. edges incident to a locked vertex are never collapsed
 
-    stack<VertexSplitTarget>  vertexSplitTarget;
-    stack<EdgeCollapseTarget> readdedEdgeCollapseTarget;
+    CollapseHistory           history;
+    VertexSplitTarget         collapseRecord;  // the collapse being applied, undone or redone
+
+    int                    checkpointInterval;  // 0 if no checkpoints
+    deque<MeshCheckpoint>  checkpoints;         // the k-th is the first state reached at or after record k*interval
 
-    int ect_id_base;
     int n_active_faces;
 
+    // the vertex hierarchy of the selective refinement (selective.cpp). record i of the history can be
+    // applied only after the records that last changed a face around its edge, and undone only after the
+    // records that require it. its error bound is a sphere around the vertices merged by it and a deviation
+    // of the surface, and holds the bounds of the records it requires, so that a record never needs a split
+    // when a record that requires it does not
+    bool          isSelective;
+    int           n_hierarchyRecords, n_hierarchyDropped;  // the history the hierarchy was built from
+    vector<int>   requiredBegin,  required;     // per record, the records it requires, [requiredBegin[i], requiredBegin[i+1])
+    vector<int>   dependentBegin, dependents;   // per record, the records that require it
+    vector<float> errorBound;                   // 5 per record: center and radius of the sphere, deviation
+    vector<char>  isApplied;                    // per record
+    vector<int>   n_appliedDependents, n_missingRequired;
+    vector<int>   splitFront;                   // applied records that no applied record requires
+    vector<int>   collapseFront;                // records not applied, whose required records are all applied
+    vector<int>   frontPosition;                // per record, its index in the front that holds it, or NIL
+
+    // scratch of BeginGeomorph (geomorph.cpp)
+    vector<int> morphSlot;        // per vertex, its index in the geomorph, or NIL
+    vector<int> morphPairs;       // v0 and v1 of each collapse up to a coarser target
+
+    vector<int>    ringEdges;     // edges around the vertex of the last collapse, whose costs are updated together
+    vector<double> ringCost;
+    vector<int>    suspendedEdges;
+
+    // inside the parallel batches, the scratch below is per thread, and the changed faces and dirty normals go to
+    // one list per slot of the batch (1 + slot), moved to the first list in the order of the batch at its end.
+    // outside of them everything goes to the first list, whatever thread the caller is, so that several instances
+    // can be used on different threads at once
+    bool        isInParallelBatch;
+    vector<int> threadSlot;       // per thread, the slot of the batch whose collapse it applies
+
+    // scratch of ApplyEdgeCollapse, per thread. the buffers of a collapse are kept for the next one,
+    // so that collapses and splits do not allocate once the buffers have grown to the largest vertex ring
+    vector< vector<int> > incidentFaces;
+
+    // the faces changed by collapses and splits since the last TakeChangedFaces, if tracked
+    bool                  isTrackingChanges, isMeshReplaced;
+    vector< vector<int> > changedFaces;
+
+    // normals to recompute, if deferred: flags per face and per vertex, and what is flagged. the first lists
+    // have room for every face and vertex, which the flags bound them to
+    bool                  isDeferringNormals;
+    vector<char>          isFaceNormalDirty, isVertexNormalDirty;
+    vector< vector<int> > dirtyFaceNormals, dirtyVertexNormals;
+
+    // batches of ParallelEdgeCollapse
+    vector<int> regionStamp;      // per vertex, the last batch whose region contains it
+    int         currentBatch;
+    vector<int> regionVertices;
+    vector<int> batchEdges, deferredEdges, batchRemovedFaces;
+    vector<VertexSplitTarget> batchSplits;
+    vector< vector<int> >     batchRings;
+    vector< vector<double> >  batchRingCosts;
+    vector< vector<int> >     batchSuspended;
+
     void AssignInitialQ();
-    void CumulateQ(VertexIter &vi, double *normal, double d);
-    void ComputeOptimalCoordAndCost(EdgeIter &ei);
+    void CumulateQ(int v, double *normal, double d);
+    void   ComputeOptimalCoordAndCost(int n, const int *edgeList, double *cost);
+    void   UpdateEdgeCost(int e, double cost);
+    void   CollectSuspendedEdges(int v1, vector<int> &suspended);
+    void   ReadmitSuspendedEdge(int e);
+    bool   IsLockedEdge(int e);
     
-    HalfEdge* FindBoundaryEdgeIncidentToVertexInCW(HalfEdge *baseHalfEdge);
-    void FindNeighborHalfEdge(VertexIter &v1, vector<FaceIter> &facesOriginallyIncidentToV0OrV1);
+    int  FindBoundaryEdgeIncidentToVertexInCW(int baseHalfEdge);
+    void FindNeighborHalfEdge(int v1, vector<int> &facesOriginallyIncidentToV0OrV1);
 
-    bool IsFinWillNotBeCreated(EdgeIter &ei);
-    void RemoveEdge(EdgeIter &ei, double *optimalCoord, bool isFirstCollapse);
+    bool IsFinWillNotBeCreated(int e);
+    void RemoveEdge(int e, double *optimalCoord, bool isFirstCollapse);
+    // the part of RemoveEdge that touches only v0, v1 and the faces around them. records the collapse in "split"
+    // and the edges around v1 in "ring" (empty if no face is left), and returns the number of faces removed
+    int  ApplyEdgeCollapse(int e, double *optimalCoord, bool isFirstCollapse, VertexSplitTarget &split, vector<int> &ring);
+
+    int  SelectIndependentCollapses(int batchSize, int n_removable_faces, double maxCost);
+    void CollectCollapseRegion(int e, vector<int> &region);
+    void ApplyIndependentCollapses();
+
+    void UpdateFaceNormal(int f);    // now, or once before the normals are used next if deferred
+    void UpdateVertexNormal(int v);
+    void ResizePerThreadLists();
+    void ReserveBatchSlots(int n);
+    int  PerThreadList();
+    int  ChangeList();
+    void ClearDirtyNormals();
+
+    void RedoCollapse(int record);   // apply, or undo, a record of the history without moving the cursor
+    void UndoCollapse(int record);
+    void SeekRecord(int target);
+
+    void   CollectFacesAroundVertex(int hep, vector<int> &faces);
+    void   BuildVertexHierarchy();
+    void   ClearVertexHierarchy();
+    size_t HierarchyMemoryUsage();
+    void   AddToFront(vector<int> &front, int record);
+    void   RemoveFromFront(vector<int> &front, int record);
+    void   SelectiveCollapse(int record);
+    void   SelectiveSplit(int record);
+
+    void   TakeCheckpointIfDue();
+    void   RestoreCheckpoint(MeshCheckpoint &checkpoint);
+    size_t CheckpointMemoryUsage();
 
 public:
-    Simplification(){ ect_id_base = 0; }
+    Simplification(){ mesh = NULL; n_active_faces = 0; currentBatch = 0; checkpointInterval = 0; isSelective = false;
+                      n_hierarchyRecords = n_hierarchyDropped = 0; isTrackingChanges = isMeshReplaced = false;
+                      isDeferringNormals = isInParallelBatch = false; }
 
-    void InitSimplification(Mesh *mesh_in);
-    bool EdgeCollapse();
+    // vertices with "isLocked_in" set are neither moved nor removed, e.g. where the mesh meets the rest of a larger one
+    void InitSimplification(Mesh *mesh_in, const vector<char> *isLocked_in = NULL);
+    // collapse the edge of the lowest cost, unless its cost exceeds "maxCost"
+    bool EdgeCollapse(double maxCost = DBL_MAX);
+    // collapse edges until "n_target_faces" faces are left or every edge costs more than "maxCost".
+    // each batch takes thousands of low-cost edges whose neighborhoods do not overlap and collapses them
+    // in parallel. with "isDeterministic" the batches have a fixed size, so that the result does not depend
+    // on the number of threads. the collapses are recorded for VertexSplit as usual
+    void ParallelEdgeCollapse(int n_target_faces, double maxCost = DBL_MAX, bool isDeterministic = true);
     void VertexSplit();
     void ControlLevelOfDetail(int step);
+    // the same level, reached by a geomorph: BeginGeomorph to it, and EndGeomorph after the blend
+    bool ControlLevelOfDetail(int step, Geomorph &morph);
+
+    // go to the level of the history with the fewest collapses that leave at most "n_target_faces" faces,
+    // by undoing or redoing collapses from the current level or from the nearest checkpoint, whichever is
+    // nearer. below the levels recorded so far, new collapses are made as by EdgeCollapse
+    void SeekFaceCount(int n_target_faces);
+    // copy the mesh every "interval" collapses (0: never), so that SeekFaceCount takes at most about
+    // interval/2 steps from a level reached before. each copy takes as much memory as the mesh.
+    // call before InitSimplification
+    void SetCheckpointInterval(int interval){ checkpointInterval = interval; }
+
+    int NumberOfActiveFaces(){ return n_active_faces; }
+
+    // a transition from the current level to the one SeekFaceCount(n_target_faces) goes to, to be blended by
+    // BlendGeomorph (geomorph.h). the mesh is left at the finer of the two levels, on which the positions
+    // and normals of "morph" are to be drawn instead of the mesh's, and EndGeomorph then goes to the target.
+    // the collapses and splits in between are made once here, and the geomorph holds only the vertices
+    // they move or whose normals they change. nothing else may change the level before the end
+    bool BeginGeomorph(int n_target_faces, Geomorph &morph);
+    void EndGeomorph(const Geomorph &morph){ SeekFaceCount(morph.n_target_faces); }
+
+    // mark the faces and vertices whose normals a collapse or split changes, instead of recomputing them on the
+    // spot, and recompute each marked one once, in parallel, by UpdateNormals. SeekFaceCount, ControlLevelOfDetail,
+    // ParallelEdgeCollapse, RefineForView, EndSelectiveRefinement and TakeChangedFaces call it at their end, and
+    // EdgeCollapse and VertexSplit leave it to the caller. the normals are the same as without deferring
+    void DeferNormals(bool isDeferring);
+    void UpdateNormals();
+
+    // keep the faces that every collapse and split changes, for a RenderBuffer (render.h): the faces around
+    // v0 and v1, whose activity, corners, or vertex positions and normals may have changed
+    void TrackChanges(bool isTracking){ isTrackingChanges = isTracking; }
+    // the faces changed since the last call, possibly repeated. false if the whole mesh may have changed
+    // (a checkpoint was restored), and "faces" is then empty
+    bool TakeChangedFaces(vector<int> &faces);
+
+    // view-dependent refinement: between StartSelectiveRefinement and EndSelectiveRefinement any set of the
+    // recorded collapses that respects their dependencies can be applied, and RefineForView splits where the
+    // error of a collapse would show by more than the tolerance and collapses elsewhere. a frame visits every
+    // record at the boundary between applied and not applied, plus the ones it changes, and allocates nothing:
+    // since the error on the screen of every record changes as the camera moves, the cost of a frame grows with
+    // this front, i.e. with the active vertices, and not only with the splits and collapses it makes.
+    // the hierarchy is built by the first start after new collapses, by replaying the history once.
+    // EdgeCollapse, VertexSplit, SeekFaceCount and the writers refuse to run until the end, which goes back to
+    // the level of the history with as many collapses as are applied
+    void StartSelectiveRefinement();
+    int  RefineForView(const ViewParameters &view);   // returns the number of splits and collapses
+    void EndSelectiveRefinement();
+    bool IsSelective(){ return isSelective; }
+
+    // bytes of the per-vertex and per-edge arrays and of the collapse history
+    size_t MemoryUsage();
+
+    // keep at most "maxRecords" collapses for VertexSplit and WriteProgressiveMesh (-1: all, 0: none), and
+    // optionally quantize the coordinates they restore (see history.h). call before InitSimplification
+    void SetHistoryLimit(int maxRecords, bool isQuantized){ history.SetLimit(maxRecords, isQuantized); }
+    int  NumberOfRecordedCollapses(){ return history.Size(); }
+    int  NumberOfAppliedCollapses() { return history.Cursor(); }
+    int  NumberOfDroppedCollapses() { return history.NumberOfDropped(); }
+
+    // one line "edge v0 v1" per collapse, in the order of the collapses. v0 is the vertex removed.
+    // used to check that two builds (e.g. float and double coordinates) make the same collapses
+    bool WriteCollapseLog(const char *filename);
+
+    // write the current mesh as the base mesh and the collapse history as vertex splits (see progressive.h)
+    bool WriteProgressiveMesh(const char *filename);
 };
@@ -0,0 +1,198 @@
+#include "mesh.h"
+#include "parallel.h"
+#include "stats.h"
+#include <cstdio>
+
+static const char *counterNames[N_STAT_COUNTERS] = {
+    "heap_pops", "stale_heap_pops", "fin_rejections", "suspended_scans", "readmissions", "cost_evaluations",
+    "collapses", "splits", "face_normals", "vertex_normals", "checkpoint_restores", "peak_heap_size"
+};
+
+static const char *phaseNames[N_STAT_PHASES] = {
+    "read", "weld", "cluster", "connectivity", "init", "parallel_batch", "seek", "checkpoint", "update_normals",
+    "hierarchy", "refine_for_view", "write"
+};
+
+const char *StatCounterName(int counter){ return (counter >= 0 && counter < N_STAT_COUNTERS) ? counterNames[counter] : ""; }
+const char *StatPhaseName(int phase)    { return (phase >= 0 && phase < N_STAT_PHASES) ? phaseNames[phase] : ""; }
+
+
+#ifdef MESH_ENABLE_STATS
+
+// at most this many events are kept for the timeline. the totals of the phases go on. they are stored in a
+// fixed array, so that a timer never allocates, e.g. in the collapse loop of ParallelEdgeCollapse, and the pages
+// of the array that no event reaches are never touched
+#define STAT_MAX_EVENTS (1 << 18)
+
+struct StatEvent {
+    int    phase, thread;
+    double startTime, duration;   // seconds, from "statBaseTime"
+};
+
+StatSlot statSlots[STAT_MAX_THREADS];
+
+static long long         phaseCalls[N_STAT_PHASES];
+static double            phaseTime[N_STAT_PHASES];
+static StatEvent         statEvents[STAT_MAX_EVENTS];
+static int               n_events        = 0;
+static long long         n_droppedEvents = 0;
+static double            statBaseTime    = GetWallClockTime();
+
+void AddStatEvent(int phase, double startTime)
+{
+    double endTime = GetWallClockTime();
+
+    StatEvent event;
+    event.phase     = phase;
+    event.thread    = omp_get_thread_num();
+    event.startTime = startTime - statBaseTime;
+    event.duration  = endTime - startTime;
+
+    // phases are far apart, so a lock costs nothing noticeable
+    #pragma omp critical(stats)
+    {
+        phaseCalls[phase]++;
+        phaseTime[phase] += event.duration;
+
+        if(n_events < STAT_MAX_EVENTS) statEvents[n_events++] = event;
+        else                           n_droppedEvents++;
+    }
+}
+
+MeshStats GetStats()
+{
+    MeshStats stats;
+
+    stats.isEnabled = true;
+
+    for(int c = 0; c < N_STAT_COUNTERS; c++){
+        stats.counter[c] = 0;
+
+        for(int t = 0; t < STAT_MAX_THREADS; t++){
+            long long value = statSlots[t].counter[c];
+
+            if(c == STAT_PEAK_HEAP_SIZE){ if(value > stats.counter[c]) stats.counter[c] = value; }
+            else                        stats.counter[c] += value;
+        }
+    }
+
+    #pragma omp critical(stats)
+    {
+        for(int p = 0; p < N_STAT_PHASES; p++){
+            stats.phaseCalls[p] = phaseCalls[p];
+            stats.phaseTime[p]  = phaseTime[p];
+        }
+    }
+
+    return stats;
+}
+
+void ResetStats()
+{
+    #pragma omp critical(stats)
+    {
+        for(int t = 0; t < STAT_MAX_THREADS; t++) for(int c = 0; c < N_STAT_COUNTERS; c++) statSlots[t].counter[c] = 0;
+
+        for(int p = 0; p < N_STAT_PHASES; p++){
+            phaseCalls[p] = 0;
+            phaseTime[p]  = 0.0;
+        }
+
+        n_events        = 0;
+        n_droppedEvents = 0;
+        statBaseTime    = GetWallClockTime();
+    }
+}
+
+#else
+
+MeshStats GetStats()
+{
+    MeshStats stats;
+
+    stats.isEnabled = false;
+    for(int c = 0; c < N_STAT_COUNTERS; c++) stats.counter[c] = 0;
+    for(int p = 0; p < N_STAT_PHASES; p++){
+        stats.phaseCalls[p] = 0;
+        stats.phaseTime[p]  = 0.0;
+    }
+
+    return stats;
+}
+
+void ResetStats()
+{
+}
+
+#endif // MESH_ENABLE_STATS
+
+
+bool WriteStatsJSON(const char *filename)
+{
+    FILE *fp = fopen(filename, "w");
+
+    if(fp == NULL){
+        cerr << filename << " cannot be written.\n";
+        return false;
+    }
+
+    MeshStats stats = GetStats();
+
+    fprintf(fp, "{\n  \"enabled\": %s,\n  \"counters\": {\n", stats.isEnabled ? "true" : "false");
+    for(int c = 0; c < N_STAT_COUNTERS; c++){
+        fprintf(fp, "    \"%s\": %lld%s\n", counterNames[c], stats.counter[c], (c + 1 < N_STAT_COUNTERS) ? "," : "");
+    }
+
+    fprintf(fp, "  },\n  \"phases\": {\n");
+    for(int p = 0; p < N_STAT_PHASES; p++){
+        fprintf(fp, "    \"%s\": { \"calls\": %lld, \"seconds\": %.6f }%s\n", phaseNames[p], stats.phaseCalls[p], stats.phaseTime[p],
+                (p + 1 < N_STAT_PHASES) ? "," : "");
+    }
+    fprintf(fp, "  }\n}\n");
+
+    fclose(fp);
+
+    return true;
+}
+
+bool WriteStatsTrace(const char *filename)
+{
+    FILE *fp = fopen(filename, "w");
+
+    if(fp == NULL){
+        cerr << filename << " cannot be written.\n";
+        return false;
+    }
+
+    MeshStats stats = GetStats();
+    double    endTime = 0.0;   // microseconds
+
+    fprintf(fp, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+
+#ifdef MESH_ENABLE_STATS
+    #pragma omp critical(stats)
+    {
+        for(int i = 0; i < n_events; i++){
+            const StatEvent &event = statEvents[i];
+
+            fprintf(fp, "{\"name\": \"%s\", \"cat\": \"simplification\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": %d},\n",
+                    phaseNames[event.phase], event.startTime * 1.0e6, event.duration * 1.0e6, event.thread);
+
+            if((event.startTime + event.duration) * 1.0e6 > endTime) endTime = (event.startTime + event.duration) * 1.0e6;
+        }
+
+        if(n_droppedEvents > 0) cerr << "WriteStatsTrace: " << n_droppedEvents << " events were not kept\n";
+    }
+#endif
+
+    // the counters once, at the end of the timeline
+    fprintf(fp, "{\"name\": \"counters\", \"ph\": \"C\", \"ts\": %.3f, \"pid\": 1, \"tid\": 0, \"args\": {", endTime);
+    for(int c = 0; c < N_STAT_COUNTERS; c++){
+        fprintf(fp, "\"%s\": %lld%s", counterNames[c], stats.counter[c], (c + 1 < N_STAT_COUNTERS) ? ", " : "");
+    }
+    fprintf(fp, "}}\n]}\n");
+
+    fclose(fp);
+
+    return true;
+}
@@ -0,0 +1,105 @@
+// Counters of the hot paths and timers of the phases of the simplification, to see why a run is slow.
+//
+// They are compiled in only with MESH_ENABLE_STATS. Otherwise STAT_COUNT, STAT_ADD, STAT_MAX and STAT_TIMER
+// expand to nothing, and GetStats returns zeros with isEnabled false.
+// Each thread counts in its own slot, so a count is one increment without a lock, and GetStats sums the slots.
+// A timer measures the scope it is declared in, adds it to the total of its phase, and keeps it as an event of
+// the timeline of WriteStatsTrace. Phases are coarse (a batch, a seek, a normal update), never one collapse,
+// so the timeline stays short. The counts are of the whole program since it started or since ResetStats.
+//
+// The slot is chosen by omp_get_thread_num(), which counts the threads of the innermost parallel region. When
+// several meshes are simplified at once (MeshBatch), their counts are for all of them together, and counts of
+// parallel regions nested in different workers share slot 0 and may be lost.
+//
+// Files that use the macros include parallel.h before this header.
+
+enum StatCounter {
+    STAT_HEAP_POPS,             // edges popped by EdgeCollapse and by the batches of ParallelEdgeCollapse
+    STAT_STALE_HEAP_POPS,       // of those, edges removed by earlier collapses
+    STAT_FIN_REJECTIONS,        // edges suspended because IsFinWillNotBeCreated refused them
+    STAT_SUSPENDED_SCANS,       // edges looked at by CollectSuspendedEdges
+    STAT_READMISSIONS,          // suspended edges put back into the heap
+    STAT_COST_EVALUATIONS,      // edges given to ComputeOptimalCoordAndCost
+    STAT_COLLAPSES,             // applied, redone ones included
+    STAT_SPLITS,
+    STAT_FACE_NORMALS,          // calls of Mesh::AssignFaceNormal
+    STAT_VERTEX_NORMALS,        // calls of Mesh::AssignVertexNormal
+    STAT_CHECKPOINT_RESTORES,
+    STAT_PEAK_HEAP_SIZE,        // the most edges in a heap at once. a maximum, not a sum
+    N_STAT_COUNTERS
+};
+
+enum StatPhase {
+    PHASE_READ,                 // reading a file, in Mesh::ConstructMeshDataStructure
+    PHASE_WELD,                 // Mesh::WeldVertices
+    PHASE_CLUSTER,              // Mesh::ClusterVertices
+    PHASE_CONNECTIVITY,         // Mesh::AddEdgeInfo
+    PHASE_INIT,                 // InitSimplification
+    PHASE_PARALLEL_BATCH,       // one batch of ParallelEdgeCollapse
+    PHASE_SEEK,                 // SeekFaceCount
+    PHASE_CHECKPOINT,           // a copy of the mesh, taken or restored
+    PHASE_UPDATE_NORMALS,       // UpdateNormals, when normals are deferred
+    PHASE_HIERARCHY,            // BuildVertexHierarchy
+    PHASE_REFINE_FOR_VIEW,
+    PHASE_WRITE,                // Mesh::WriteMeshFile, WriteProgressiveMesh
+    N_STAT_PHASES
+};
+
+struct MeshStats {
+    bool      isEnabled;                  // built with MESH_ENABLE_STATS
+    long long counter[N_STAT_COUNTERS];
+    long long phaseCalls[N_STAT_PHASES];
+    double    phaseTime[N_STAT_PHASES];   // seconds, nested phases included in the outer ones
+};
+
+extern MeshStats   GetStats();
+extern void        ResetStats();
+extern const char *StatCounterName(int counter);
+extern const char *StatPhaseName(int phase);
+
+// { "enabled": ..., "counters": { name: count, ... }, "phases": { name: { "calls": n, "seconds": t }, ... } }
+extern bool WriteStatsJSON(const char *filename);
+// the phases as complete events of the trace event format, for chrome://tracing or https://ui.perfetto.dev.
+// the counters are added at the end
+extern bool WriteStatsTrace(const char *filename);
+
+
+#ifdef MESH_ENABLE_STATS
+
+// threads beyond this many share slots, and may lose counts
+#define STAT_MAX_THREADS 64
+
+// a cache line of padding, so that the slots of two threads are never written through the same line
+struct StatSlot {
+    long long counter[N_STAT_COUNTERS];
+    char      padding[64];
+};
+
+extern StatSlot statSlots[STAT_MAX_THREADS];
+
+inline StatSlot &ThreadStatSlot(){ return statSlots[omp_get_thread_num() % STAT_MAX_THREADS]; }
+
+extern void AddStatEvent(int phase, double startTime);
+
+class StatTimer {
+    int    phase;
+    double startTime;
+
+public:
+    StatTimer(int phase_in){ phase = phase_in; startTime = GetWallClockTime(); }
+    ~StatTimer(){ AddStatEvent(phase, startTime); }
+};
+
+#define STAT_COUNT(c)         (ThreadStatSlot().counter[c]++)
+#define STAT_ADD(c, n)        (ThreadStatSlot().counter[c] += (n))
+#define STAT_MAX(c, value)    do{ long long &m_ = ThreadStatSlot().counter[c]; if((long long)(value) > m_) m_ = (value); }while(0)
+#define STAT_TIMER(phase)     StatTimer statTimer(phase)
+
+#else
+
+#define STAT_COUNT(c)
+#define STAT_ADD(c, n)
+#define STAT_MAX(c, value)
+#define STAT_TIMER(phase)
+
+#endif
@@ -0,0 +1,422 @@
+#include "mesh.h"
+#include "simplification.h"
+#include "stream.h"
+
+// memory of one triangle in the window: the Mesh (halfedges, faces, about half a vertex and one and a half edges),
+// the quadrics, costs and heap of Simplification, the collapse history and the window arrays
+#define STREAM_BYTES_PER_FACE 640
+
+// a window smaller than this hardly simplifies anything
+#define STREAM_MIN_WINDOW_FACES 4096
+
+
+StreamSimplification::~StreamSimplification()
+{
+    if(outputFile != NULL) fclose(outputFile);
+    if(faceFile   != NULL) fclose(faceFile);
+}
+
+
+bool StreamSimplification::Simplify(const char *inputFilename, const char *outputFilename_in,
+                                    int n_target_faces, double ratio, double maxError_in, double memoryBudget)
+{
+    double startTime = GetWallClockTime(), phaseTime = startTime;
+
+    if( input.Open(inputFilename) == false ){
+        cerr << "file cannot be read.\n";
+        return false;
+    }
+
+    p   = input.data;
+    end = input.data + input.size;
+
+    if( ParseOFFHeader(p, end, n_vertices, n_faceRecords) == false ) return false;
+
+    /////////////////////////////////////////////////////////////////////////////
+    // copy the vertices to the scratch file
+    /////////////////////////////////////////////////////////////////////////////
+    string scratchFilename = string(outputFilename_in) + ".scratch";
+
+    if( scratch.Create(scratchFilename.c_str(), (size_t)n_vertices * sizeof(StreamVertex)) == false ){
+        cerr << "cannot create " << scratchFilename << endl;
+        return false;
+    }
+
+    vertex = (StreamVertex*)scratch.data;
+
+    for(int v = 0; v < n_vertices; v++){
+        while(p < end && IsBlankOrComment(p, end)) p = SkipLine(p, end);
+
+        // only the first three values are used, the rest (e.g. colors) is ignored
+        const char *q = p;
+
+        if( ParseDouble(q, end, vertex[v].coord[0]) == false ||
+            ParseDouble(q, end, vertex[v].coord[1]) == false ||
+            ParseDouble(q, end, vertex[v].coord[2]) == false ){
+            cerr << "vertex " << v << " cannot be read.\n";
+            return false;
+        }
+
+        vertex[v].lastTriangle = NIL;
+        vertex[v].outputIndex  = NIL;
+        vertex[v].windowIndex  = NIL;
+
+        p = SkipLine(q, end);
+    }
+
+    facesBegin = p;
+
+    fprintf(stderr, "%-24s %8.3f sec\n", "copying vertices", GetWallClockTime() - phaseTime);
+    phaseTime = GetWallClockTime();
+
+    /////////////////////////////////////////////////////////////////////////////
+    // first pass over the faces: the last triangle of each vertex
+    /////////////////////////////////////////////////////////////////////////////
+    int corner[3];
+
+    StartReadingTriangles();
+    n_triangles = 0;
+
+    while( ReadTriangle(corner) ){
+        for(int i = 0; i < 3; i++) vertex[corner[i]].lastTriangle = n_triangles;
+        n_triangles++;
+    }
+
+    if(hasError) return false;
+
+    fprintf(stderr, "%-24s %8.3f sec\n", "finding last uses", GetWallClockTime() - phaseTime);
+    phaseTime = GetWallClockTime();
+
+    cerr << "# of vertices  " << n_vertices  << endl;
+    cerr << "# of triangles " << n_triangles << endl;
+
+    // the face target is the larger of "-f" and "-r" as a ratio, applied to every window.
+    // without either, only the error bounds the collapses
+    keepRatio = 0.0;
+    if(n_target_faces >= 0 && n_triangles > 0) keepRatio = (double)n_target_faces / n_triangles;
+    if(ratio > keepRatio)                      keepRatio = ratio;
+
+    maxError = maxError_in;
+
+    n_budgetFaces = (int)(memoryBudget / STREAM_BYTES_PER_FACE < 2.0e9 ? memoryBudget / STREAM_BYTES_PER_FACE : 2.0e9);
+    if(n_budgetFaces < STREAM_MIN_WINDOW_FACES) n_budgetFaces = STREAM_MIN_WINDOW_FACES;
+
+    /////////////////////////////////////////////////////////////////////////////
+    // second pass: simplify window by window
+    /////////////////////////////////////////////////////////////////////////////
+    if( OpenOutput(outputFilename_in) == false ) return false;
+
+    StartReadingTriangles();
+    n_read = 0;
+
+    windowCorner.clear();
+
+    int n_windows = 0;
+
+    while(true){
+        int n_new = 0;
+
+        while((int)windowCorner.size() < 3*n_budgetFaces && ReadTriangle(corner)){
+            for(int i = 0; i < 3; i++) windowCorner.push_back(corner[i]);
+            n_read++;
+            n_new++;
+        }
+
+        if(hasError) return false;
+
+        bool isLast = (n_read == n_triangles);
+
+        SimplifyWindow(n_new, isLast);
+        n_windows++;
+
+        if(isLast) break;
+    }
+
+    if( CloseOutput() == false ) return false;
+
+    fprintf(stderr, "%-24s %8.3f sec\n", "simplifying windows", GetWallClockTime() - phaseTime);
+
+    cerr << "# of windows " << n_windows << " of up to " << n_budgetFaces << " faces\n";
+    cerr << "# of faces " << n_triangles << " -> " << n_outputFaces << endl;
+
+    fprintf(stderr, "%-24s %8.3f sec\n", "total", GetWallClockTime() - startTime);
+
+    return true;
+}
+
+
+void StreamSimplification::StartReadingTriangles()
+{
+    p = facesBegin;
+
+    n_faceRecordsLeft = n_faceRecords;
+    n_fanLeft = 0;
+    hasError  = false;
+}
+
+bool StreamSimplification::ReadTriangle(int *corner)
+{
+    // the next face record with at least 3 vertices
+    while(n_fanLeft == 0){
+        if(n_faceRecordsLeft == 0) return false;
+
+        while(p < end && IsBlankOrComment(p, end)) p = SkipLine(p, end);
+
+        const char *q = p;
+        int n;
+
+        if( ParseInt(q, end, n) == false ){
+            cerr << "face " << n_faceRecords - n_faceRecordsLeft << " cannot be read.\n";
+            hasError = true;
+            return false;
+        }
+
+        n_faceRecordsLeft--;
+
+        if(n < 3){
+            p = SkipLine(q, end);
+            continue;
+        }
+
+        if( ParseInt(q, end, fanFirst) == false || ParseInt(q, end, fanPrev) == false ){
+            cerr << "face " << n_faceRecords - n_faceRecordsLeft - 1 << " cannot be read.\n";
+            hasError = true;
+            return false;
+        }
+
+        p = q;
+        n_fanLeft = n - 2;
+    }
+
+    int v;
+
+    if( ParseInt(p, end, v) == false ){
+        cerr << "face " << n_faceRecords - n_faceRecordsLeft - 1 << " cannot be read.\n";
+        hasError = true;
+        return false;
+    }
+
+    corner[0] = fanFirst;
+    corner[1] = fanPrev;
+    corner[2] = v;
+
+    fanPrev = v;
+    n_fanLeft--;
+
+    if(n_fanLeft == 0) p = SkipLine(p, end);
+
+    for(int i = 0; i < 3; i++){
+        if(corner[i] < 0 || corner[i] >= n_vertices){
+            cerr << "vertex index out of range.\n";
+            hasError = true;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+void StreamSimplification::SimplifyWindow(int n_new, bool isLast)
+{
+    int n_windowFaces = (int)windowCorner.size() / 3;
+    if(n_windowFaces == 0) return;
+
+    int n_carried = n_windowFaces - n_new;
+
+    /////////////////////////////////////////////////////////////////////////////
+    // number the vertices of the window
+    /////////////////////////////////////////////////////////////////////////////
+    windowVertex.clear();
+    localCorner.resize(windowCorner.size());
+
+    for(unsigned int c = 0; c < windowCorner.size(); c++){
+        int g = windowCorner[c];
+
+        if(vertex[g].windowIndex == NIL){
+            vertex[g].windowIndex = (int)windowVertex.size();
+            windowVertex.push_back(g);
+        }
+
+        localCorner[c] = vertex[g].windowIndex;
+    }
+
+    int n_windowVertices = (int)windowVertex.size();
+
+    windowCoord.resize(3*n_windowVertices);
+    isLocked.resize(n_windowVertices);
+
+    for(int i = 0; i < n_windowVertices; i++){
+        StreamVertex &sv = vertex[windowVertex[i]];
+
+        for(int k = 0; k < 3; k++) windowCoord[3*i+k] = sv.coord[k];
+
+        // used by a triangle not read yet, or already in the output
+        isLocked[i] = (sv.lastTriangle >= n_read || sv.outputIndex != NIL);
+    }
+
+    /////////////////////////////////////////////////////////////////////////////
+    // simplify the window
+    /////////////////////////////////////////////////////////////////////////////
+    {
+        Mesh mesh;
+        Simplification simplification;
+
+        mesh.ConstructMeshDataStructure(n_windowVertices, &windowCoord[0], n_windowFaces, &localCorner[0]);
+        simplification.SetHistoryLimit(0, false);  // windows are only decimated
+        simplification.DeferNormals(true);
+        simplification.InitSimplification(&mesh, &isLocked);
+
+        // triangles left from earlier windows were simplified there already
+        int n_faces_to_keep = n_carried + (int)(keepRatio * n_new);
+
+        double maxCost = (maxError >= 0.0) ? maxError * mesh.normalizationScale * mesh.normalizationScale : DBL_MAX;
+
+        while(simplification.NumberOfActiveFaces() > n_faces_to_keep){
+            if(simplification.EdgeCollapse(maxCost) == false) break;
+        }
+
+        // moved vertices go back to the scratch file, they may be in triangles carried to the next window
+        for(int i = 0; i < n_windowVertices; i++){
+            if(isLocked[i] || mesh.vertices.isActive[i] == false) continue;
+
+            Real *coord = mesh.VertexCoord(i);
+            for(int k = 0; k < 3; k++) vertex[windowVertex[i]].coord[k] = coord[k] / mesh.normalizationScale + mesh.normalizationCenter[k];
+        }
+
+        /////////////////////////////////////////////////////////////////////////////
+        // write the triangles whose vertices are all done, and carry the others
+        /////////////////////////////////////////////////////////////////////////////
+        carriedCorner.clear();
+
+        for(int f = 0; f < mesh.n_faces; f++){
+            if(mesh.faces.isActive[f] == false) continue;
+
+            int corner[3];
+            bool isDone = true;
+
+            for(int i = 0; i < 3; i++){
+                corner[i] = windowVertex[ mesh.halfedges.vertex[3*f+i] ];
+                if(vertex[corner[i]].lastTriangle >= n_read) isDone = false;
+            }
+
+            if(isDone || isLast) WriteFace(corner);
+            else                 for(int i = 0; i < 3; i++) carriedCorner.push_back(corner[i]);
+        }
+    }
+
+    // too wide a front would leave no room for new triangles
+    if((int)carriedCorner.size() > 3 * (n_budgetFaces / 2)){
+        for(unsigned int c = 0; c < carriedCorner.size(); c += 3) WriteFace(&carriedCorner[c]);
+        carriedCorner.clear();
+    }
+
+    for(int i = 0; i < n_windowVertices; i++) vertex[windowVertex[i]].windowIndex = NIL;
+
+    windowCorner.swap(carriedCorner);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// output. the counts in the header have a fixed width, so that they can be filled in at the end
+/////////////////////////////////////////////////////////////////////////////
+
+static void WriteStreamHeader(FILE *fp, bool isPLY, int n_outputVertices, int n_outputFaces)
+{
+    if(isPLY){
+        unsigned int one = 1;
+        bool isLittleEndianMachine = (*(unsigned char*)&one == 1);
+
+        fprintf(fp, "ply\nformat %s 1.0\n", isLittleEndianMachine ? "binary_little_endian" : "binary_big_endian");
+        fprintf(fp, "element vertex %010d\nproperty float x\nproperty float y\nproperty float z\n", n_outputVertices);
+        fprintf(fp, "element face %010d\nproperty list uchar int vertex_indices\nend_header\n", n_outputFaces);
+    }else{
+        fprintf(fp, "OFF\n%010d %010d 0\n", n_outputVertices, n_outputFaces);
+    }
+}
+
+bool StreamSimplification::OpenOutput(const char *filename)
+{
+    const char *extension = strrchr(filename, '.');
+    isPLY = (extension != NULL && HasExtension(extension, ".ply"));
+
+    outputFilename = filename;
+    faceFilename = string(filename) + ".faces";
+
+    outputFile = fopen(filename,     isPLY ? "wb" : "w");
+    faceFile   = fopen(faceFilename.c_str(), isPLY ? "w+b" : "w+");
+
+    if(outputFile == NULL || faceFile == NULL){
+        cerr << "cannot open " << (outputFile == NULL ? string(filename) : faceFilename) << endl;
+        return false;
+    }
+
+    n_outputVertices = n_outputFaces = 0;
+
+    WriteStreamHeader(outputFile, isPLY, 0, 0);
+
+    return true;
+}
+
+void StreamSimplification::WriteFace(const int *corner)
+{
+    int id[3];
+
+    for(int i = 0; i < 3; i++){
+        StreamVertex &sv = vertex[corner[i]];
+
+        if(sv.outputIndex == NIL){
+            sv.outputIndex = n_outputVertices++;
+
+            if(isPLY){
+                float xyz[3];
+                for(int k = 0; k < 3; k++) xyz[k] = (float)sv.coord[k];
+                fwrite(xyz, sizeof(float), 3, outputFile);
+            }else{
+                fprintf(outputFile, "%.9g %.9g %.9g\n", sv.coord[0], sv.coord[1], sv.coord[2]);
+            }
+        }
+
+        id[i] = sv.outputIndex;
+    }
+
+    if(isPLY){
+        // 13 bytes per face: the count "3" and three indices
+        char record[13];
+        record[0] = 3;
+        memcpy(record + 1, id, 12);
+        fwrite(record, 1, 13, faceFile);
+    }else{
+        fprintf(faceFile, "3 %d %d %d\n", id[0], id[1], id[2]);
+    }
+
+    n_outputFaces++;
+}
+
+bool StreamSimplification::CloseOutput()
+{
+    // append the faces to the vertices
+    vector<char> buffer(1 << 20);
+
+    rewind(faceFile);
+
+    size_t n;
+    while((n = fread(&buffer[0], 1, buffer.size(), faceFile)) > 0) fwrite(&buffer[0], 1, n, outputFile);
+
+    bool isWritten = (ferror(faceFile) == 0);
+
+    fclose(faceFile);
+    faceFile = NULL;
+    remove(faceFilename.c_str());
+
+    fseek(outputFile, 0, SEEK_SET);
+    WriteStreamHeader(outputFile, isPLY, n_outputVertices, n_outputFaces);
+
+    if(ferror(outputFile) != 0) isWritten = false;
+    if(fclose(outputFile) != 0) isWritten = false;
+    outputFile = NULL;
+
+    if(isWritten == false) cerr << "cannot write " << outputFilename << endl;
+
+    return isWritten;
+}
@@ -0,0 +1,75 @@
+#include "fileio.h"
+#include <cstdio>
+#include <string>
+
+// Out-of-core simplification of OFF files that do not fit in memory.
+//
+// The vertices are copied to a memory-mapped scratch file. OFF does not tell when a vertex is used for the
+// last time, so a first pass over the faces records the last triangle that uses each vertex.
+// The second pass reads the triangles into a window of at most "memoryBudget" bytes, builds a Mesh of the
+// window and simplifies it. Vertices that later triangles still use, or that are written already, are locked:
+// they are neither moved nor removed. Triangles whose vertices are all done are written to the output and leave
+// the window, the others stay for the next one. If more than half of the window stays, it is written anyway so
+// that the window always advances. The output has no cracks, but is less simplified where windows meet.
+//
+// Memory is the window, plus the pages of the input and the scratch file that the system keeps mapped.
+// These are backed by files and can be evicted.
+
+struct StreamVertex {
+    double coord[3];     // in the units of the input
+    int    lastTriangle; // the last triangle that uses the vertex
+    int    outputIndex;  // NIL until the vertex is written
+    int    windowIndex;  // index in the current window, or NIL
+    int    padding;
+};
+
+class StreamSimplification {
+    MappedFile   input;
+    ScratchFile  scratch;
+    StreamVertex *vertex;
+    int n_vertices, n_faceRecords, n_triangles;
+
+    // reading triangles. polygons are triangulated as fans
+    const char *p, *end, *facesBegin;
+    int  n_faceRecordsLeft, fanFirst, fanPrev, n_fanLeft;
+    bool hasError;
+
+    // the window, in input vertex indices. triangles left from earlier windows come first
+    vector<int>    windowCorner, carriedCorner, localCorner;
+    vector<int>    windowVertex;
+    vector<double> windowCoord;
+    vector<char>   isLocked;
+    int n_read;          // triangles read so far
+    int n_budgetFaces;   // triangles per window
+
+    double keepRatio, maxError;
+
+    // output. faces go to a second file that is appended to the vertices at the end
+    FILE *outputFile, *faceFile;
+    bool  isPLY;
+    int   n_outputVertices, n_outputFaces;
+    const char *outputFilename;
+    string faceFilename;
+
+    void StartReadingTriangles();
+    bool ReadTriangle(int *corner);
+
+    void SimplifyWindow(int n_new, bool isLast);
+
+    bool OpenOutput(const char *filename);
+    void WriteFace(const int *corner);
+    bool CloseOutput();
+
+public:
+    StreamSimplification(){ vertex = NULL; outputFile = faceFile = NULL; }
+    ~StreamSimplification();
+
+    // the face target is the larger of "n_target_faces" and "ratio" times the input faces (negative if not given).
+    // "maxError" bounds the quadric error as in MeshSimplifyCLI (negative if not given).
+    // "memoryBudget" is in bytes. the output is *.ply (binary) or otherwise OFF
+    bool Simplify(const char *inputFilename, const char *outputFilename_in,
+                  int n_target_faces, double ratio, double maxError_in, double memoryBudget);
+
+    int NumberOfInputFaces() { return n_triangles; }
+    int NumberOfOutputFaces(){ return n_outputFaces; }
+};
@@ -0,0 +1,585 @@
+#include "mesh.h"
+#include "simplification.h"
+#include "generate.h"
+#include "quadric.h"
+#include "render.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Checks of the library that need no input files: the few files they read are written to the current directory
+// first and removed. Does not use OpenGL.
+//
+// usage: MeshTests
+//
+// Each check prints PASS or FAIL with what went wrong. The exit code is 1 if any failed.
+
+
+/////////////////////////////////////////////////////////////////////////////
+// helpers
+/////////////////////////////////////////////////////////////////////////////
+
+// the same numbers on every platform, unlike rand()
+static unsigned int testSeed = 12345u;
+
+static double Random()  // [-1,1)
+{
+    testSeed = testSeed * 1664525u + 1013904223u;
+    return (testSeed >> 8) / 8388608.0 - 1.0;
+}
+
+// the quadric of the plane a x + b y + c z + d = 0, added to q
+static void AddPlaneQuadric(double *q, double a, double b, double c, double d)
+{
+    double plane[4] = { a, b, c, d };
+
+    int k = 0;
+    for(int i = 0; i < 4; i++) for(int j = i; j < 4; j++) q[k++] += plane[i]*plane[j];
+}
+
+// the quadric of "n_planes" planes through "point" with random normals. with "spread" 0 all the normals are
+// (nearly) the same, as around a vertex in a flat area, and the quadric is singular
+static void MakeRingQuadric(double *q, const Real *point, int n_planes, double spread)
+{
+    double base[3] = { Random(), Random(), Random() };
+
+    for(int i = 0; i < QUADRIC_SIZE; i++) q[i] = 0.0;
+
+    for(int k = 0; k < n_planes; k++){
+        double n[3];
+        for(int i = 0; i < 3; i++) n[i] = base[i] + spread*Random();
+
+        double length = sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+        if(length == 0.0) continue;
+        for(int i = 0; i < 3; i++) n[i] /= length;
+
+        AddPlaneQuadric(q, n[0], n[1], n[2], -(n[0]*point[0] + n[1]*point[1] + n[2]*point[2]));
+    }
+}
+
+// true where ComputeQuadricCollapses takes the best of the ends and the midpoint (see quadric.cpp)
+static bool IsSingularCollapse(const QuadricCollapse &collapse)
+{
+    double s[QUADRIC_SIZE];
+    for(int i = 0; i < QUADRIC_SIZE; i++) s[i] = collapse.q0[i] + collapse.q1[i];
+
+    double det = s[0]*(s[4]*s[7] - s[5]*s[5]) + s[1]*(s[2]*s[5] - s[1]*s[7]) + s[2]*(s[1]*s[5] - s[2]*s[4]);
+    double trace = s[0] + s[4] + s[7];
+
+    return !(fabs(det) > QUADRIC_SINGULAR_EPSILON * trace*trace*trace);
+}
+
+static const char *kernelNames[] = { "scalar", "SSE2", "AVX" };
+
+// writes "text" to "filename" and reads it as a mesh, quietly
+static bool ReadMeshText(const char *text, char *filename, Mesh &mesh)
+{
+    FILE *fp = fopen(filename, "w");
+    if(fp == NULL){
+        printf("  %s cannot be written\n", filename);
+        return false;
+    }
+    fputs(text, fp);
+    fclose(fp);
+
+    mesh.isVerbose = false;
+    bool isRead = mesh.ConstructMeshDataStructure(filename);
+    remove(filename);
+
+    if(isRead == false) printf("  %s cannot be read\n", filename);
+    return isRead;
+}
+
+// a mesh of generate.h, quietly
+static bool BuildGeneratedMesh(const char *generator, int n_target_faces, Mesh &mesh)
+{
+    GeneratedMesh generated;
+    if(GenerateMesh(generator, n_target_faces, generated) == false) return false;
+
+    mesh.isVerbose = false;
+    return mesh.ConstructMeshDataStructure(generated.NumberOfVertices(), &generated.coord[0], generated.NumberOfFaces(), &generated.corner[0]);
+}
+
+// down to "n_target_faces", with EdgeCollapse or with the batches of ParallelEdgeCollapse, and the normals updated
+static void CollapseTo(Simplification &simplification, int n_target_faces, bool isParallel)
+{
+    if(isParallel){
+        simplification.ParallelEdgeCollapse(n_target_faces);
+    }else{
+        while(simplification.NumberOfActiveFaces() > n_target_faces) if(simplification.EdgeCollapse() == false) break;
+    }
+    simplification.UpdateNormals();
+}
+
+
+// the corners of the active faces, or of the triangles of "indices", one number per triangle, sorted
+static void SortedTriangles(const int *corner, int n_triangles, const vector<char> *isActive, vector<long long> &triangles)
+{
+    triangles.clear();
+
+    for(int t = 0; t < n_triangles; t++){
+        if(isActive != NULL && (*isActive)[t] == false) continue;
+
+        const int *c = &corner[3*t];
+        triangles.push_back(((long long)c[0] << 42) | ((long long)c[1] << 21) | (long long)c[2]);
+    }
+
+    sort(triangles.begin(), triangles.end());
+}
+
+// the frame of the viewer: the changes taken, or everything again after a checkpoint was restored, and then the
+// buffers compared with the mesh. "step" names the frame in what is printed
+static bool DrawFrame(Simplification &simplification, Mesh &mesh, RenderBuffer &buffer, const char *step, int &n_builds)
+{
+    vector<int> changedFaces;
+
+    if(simplification.TakeChangedFaces(changedFaces)){
+        buffer.Update(mesh, changedFaces);
+    }else{
+        buffer.Build(mesh);
+        n_builds++;
+    }
+
+    if(buffer.NumberOfTriangles() != simplification.NumberOfActiveFaces()){
+        printf("  %s: %d triangles for %d faces\n", step, buffer.NumberOfTriangles(), simplification.NumberOfActiveFaces());
+        return false;
+    }
+
+    // the same corners in the same order for each face, wherever its triangle is
+    vector<long long> meshTriangles, bufferTriangles;
+    SortedTriangles(&mesh.halfedges.vertex[0], mesh.n_faces, &mesh.faces.isActive, meshTriangles);
+    SortedTriangles((const int*)&buffer.indices[0], buffer.NumberOfTriangles(), NULL, bufferTriangles);
+
+    if(meshTriangles != bufferTriangles){
+        printf("  %s: the triangles are not the active faces\n", step);
+        return false;
+    }
+
+    // the positions and normals of every vertex drawn, as the mesh has them now
+    for(unsigned int i = 0; i < buffer.indices.size(); i++){
+        int v = (int)buffer.indices[i];
+        const float *data = &buffer.vertices[6*v];
+
+        for(int k = 0; k < 3; k++){
+            if(data[k] != (float)mesh.VertexCoord(v)[k] || data[3+k] != (float)mesh.VertexNormal(v)[k]){
+                printf("  %s: vertex %d is not the mesh's\n", step, v);
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// checks
+/////////////////////////////////////////////////////////////////////////////
+
+// Every kernel the CPU supports gives the same bits as the scalar one, for the closed form and for the fallback
+// of singular quadrics. The batches have every length up to a few times the SIMD width, so that the tails are
+// covered too
+static bool TestQuadricKernels()
+{
+    const int n_collapses = 2000;
+
+    vector<Real>   coord(6*n_collapses);
+    vector<double> q(2*QUADRIC_SIZE*n_collapses);
+    vector<QuadricCollapse> collapse(n_collapses);
+
+    int n_singular = 0;
+
+    for(int i = 0; i < n_collapses; i++){
+        Real   *coord0 = &coord[6*i], *coord1 = &coord[6*i+3];
+        double *q0 = &q[2*QUADRIC_SIZE*i], *q1 = q0 + QUADRIC_SIZE;
+
+        for(int k = 0; k < 3; k++){
+            coord0[k] = (Real)Random();
+            coord1[k] = (Real)(coord0[k] + 0.1*Random());
+        }
+
+        // rings around curved areas, flat areas, creases (two planes) and vertices with no faces left (zero)
+        switch(i % 5){
+        case 0:
+        case 1:
+            MakeRingQuadric(q0, coord0, 3 + i % 7, 1.0);
+            MakeRingQuadric(q1, coord1, 3 + i % 5, 1.0);
+            break;
+        case 2:
+            MakeRingQuadric(q0, coord0, 6, 0.0);
+            MakeRingQuadric(q1, coord0, 6, 0.0);
+            break;
+        case 3:
+            MakeRingQuadric(q0, coord0, 4, 1e-6);
+            MakeRingQuadric(q1, coord0, 4, 1e-6);
+            break;
+        default:
+            for(int k = 0; k < QUADRIC_SIZE; k++) q0[k] = q1[k] = 0.0;
+            break;
+        }
+
+        collapse[i].q0 = q0;
+        collapse[i].q1 = q1;
+        collapse[i].coord0 = coord0;
+        collapse[i].coord1 = coord1;
+
+        if(IsSingularCollapse(collapse[i])) n_singular++;
+    }
+
+    if(n_singular == 0 || n_singular == n_collapses){
+        printf("  %d of %d collapses are singular: both cases must be covered\n", n_singular, n_collapses);
+        return false;
+    }
+
+    int kernel = GetQuadricKernel();
+    bool isPassed = true;
+
+    vector<double> expectedCoord(3*n_collapses), expectedCost(n_collapses), expectedSum(QUADRIC_SIZE*n_collapses);
+
+    SetQuadricKernel(QUADRIC_KERNEL_SCALAR);
+    ComputeQuadricCollapses(n_collapses, &collapse[0], &expectedCoord[0], &expectedCost[0]);
+    for(int i = 0; i < n_collapses; i++){
+        memcpy(&expectedSum[QUADRIC_SIZE*i], collapse[i].q0, QUADRIC_SIZE*sizeof(double));
+        AddQuadric(&expectedSum[QUADRIC_SIZE*i], collapse[i].q1);
+    }
+
+    for(int k = QUADRIC_KERNEL_SSE2; k <= QUADRIC_KERNEL_AVX; k++){
+        SetQuadricKernel(k);
+
+        if(GetQuadricKernel() != k){
+            printf("  %s: not supported by this CPU, skipped\n", kernelNames[k]);
+            continue;
+        }
+
+        vector<double> optimalCoord(3*n_collapses), cost(n_collapses), sum(QUADRIC_SIZE*n_collapses);
+
+        // batches of 1, 2, 3, ... collapses
+        for(int begin = 0, n = 1; begin < n_collapses; begin += n, n = n % 19 + 1){
+            if(begin + n > n_collapses) n = n_collapses - begin;
+            ComputeQuadricCollapses(n, &collapse[begin], &optimalCoord[3*begin], &cost[begin]);
+        }
+
+        for(int i = 0; i < n_collapses; i++){
+            memcpy(&sum[QUADRIC_SIZE*i], collapse[i].q0, QUADRIC_SIZE*sizeof(double));
+            AddQuadric(&sum[QUADRIC_SIZE*i], collapse[i].q1);
+        }
+
+        int n_different = 0;
+        for(int i = 0; i < n_collapses; i++){
+            if(memcmp(&optimalCoord[3*i], &expectedCoord[3*i], 3*sizeof(double)) != 0 ||
+               memcmp(&cost[i], &expectedCost[i], sizeof(double)) != 0){
+                if(n_different++ == 0){
+                    printf("  %s: collapse %d (%s) gives (%.17g %.17g %.17g) cost %.17g, scalar (%.17g %.17g %.17g) cost %.17g\n",
+                           kernelNames[k], i, IsSingularCollapse(collapse[i]) ? "singular" : "regular",
+                           optimalCoord[3*i], optimalCoord[3*i+1], optimalCoord[3*i+2], cost[i],
+                           expectedCoord[3*i], expectedCoord[3*i+1], expectedCoord[3*i+2], expectedCost[i]);
+                }
+            }
+        }
+
+        if(memcmp(&sum[0], &expectedSum[0], sum.size()*sizeof(double)) != 0){
+            printf("  %s: AddQuadric differs from the scalar kernel\n", kernelNames[k]);
+            isPassed = false;
+        }
+
+        if(n_different > 0){
+            printf("  %s: %d of %d collapses differ from the scalar kernel\n", kernelNames[k], n_different, n_collapses);
+            isPassed = false;
+        }
+    }
+
+    SetQuadricKernel(kernel);
+
+    return isPassed;
+}
+
+// A vertex that no face uses is left inactive when the mesh is read: it gets no normal nor quadric, the collapses
+// never reach it, and the writers drop it
+static bool TestUnusedVertex()
+{
+    char filename[] = "tests_unused.off";
+
+    Mesh mesh;
+    if(ReadMeshText("OFF\n5 2 0\n0 0 0\n1 0 0\n1 1 0\n0 1 0\n5 5 5\n3 0 1 2\n3 0 2 3\n", filename, mesh) == false) return false;
+
+    if(mesh.vertices.isActive[4]){
+        printf("  the unused vertex is active\n");
+        return false;
+    }
+
+    for(int v = 0; v < 4; v++){
+        const Real *n = mesh.VertexNormal(v);
+
+        if(mesh.vertices.isActive[v] == false || n[0] != 0.0 || n[1] != 0.0 || n[2] != 1.0){
+            printf("  vertex %d: active %d, normal (%g %g %g)\n", v, (int)mesh.vertices.isActive[v], n[0], n[1], n[2]);
+            return false;
+        }
+    }
+
+    Simplification simplification;
+    simplification.InitSimplification(&mesh);
+
+    while(simplification.EdgeCollapse()) ;
+    if(mesh.vertices.isActive[4]){
+        printf("  the unused vertex became active\n");
+        return false;
+    }
+
+    while(simplification.NumberOfAppliedCollapses() > 0) simplification.VertexSplit();
+
+    if(simplification.NumberOfActiveFaces() != 2 || mesh.WriteMeshFile(filename) == false){
+        printf("  %d faces after the splits\n", simplification.NumberOfActiveFaces());
+        return false;
+    }
+
+    Mesh written;
+    written.isVerbose = false;
+
+    bool isRead = written.ConstructMeshDataStructure(filename);
+    remove(filename);
+
+    if(isRead == false || written.n_vertices != 4 || written.n_faces != 2){
+        printf("  written: %d vertices, %d faces instead of 4 and 2\n", written.n_vertices, written.n_faces);
+        return false;
+    }
+
+    return true;
+}
+
+// A mesh without faces has no edges: the simplification starts with an empty heap, collapses and splits
+// nothing, in serial or in batches, and the writer gives an empty mesh
+static bool TestNoFaces()
+{
+    char filename[] = "tests_empty.off";
+
+    for(int k = 0; k < 2; k++){
+        Mesh mesh;
+        if(ReadMeshText("OFF\n3 0 0\n0 0 0\n1 0 0\n0 1 0\n", filename, mesh) == false) return false;
+
+        Simplification simplification;
+        simplification.InitSimplification(&mesh);
+
+        bool isCollapsed;
+        if(k == 0){
+            isCollapsed = simplification.EdgeCollapse();
+        }else{
+            simplification.ParallelEdgeCollapse(0);
+            isCollapsed = (simplification.NumberOfAppliedCollapses() > 0);
+        }
+
+        simplification.VertexSplit();
+
+        if(isCollapsed || simplification.NumberOfActiveFaces() != 0){
+            printf("  %s: an edge was collapsed or split\n", (k == 0) ? "EdgeCollapse" : "ParallelEdgeCollapse");
+            return false;
+        }
+
+        if(mesh.WriteMeshFile(filename) == false){
+            printf("  %s cannot be written\n", filename);
+            return false;
+        }
+        remove(filename);
+    }
+
+    return true;
+}
+
+// the meshes of TestNoAllocations, and the collapses and splits that must be made on them at least
+#define NO_ALLOCATION_FACES      2400000
+#define NO_ALLOCATION_COLLAPSES  1000000
+
+// Once warmed up, by a few collapses or by the first batch of ParallelEdgeCollapse, a million collapses and more
+// allocate nothing, and neither do as many splits back to the input: the buffers of the collapses, of the slots
+// of the batches and of the deferred normals are reserved by InitSimplification or by the first batch. The
+// counted collapses keep no history, as the CLI does without -pm, since the records are new data; the splits
+// only read it
+static bool TestNoAllocations()
+{
+    if(GetAllocationCount() < 0){
+        printf("  built without MESH_COUNT_ALLOCATIONS, skipped\n");
+        return true;
+    }
+
+    const char *generators[] = { "sphere", "grid" };
+    bool isPassed = true;
+
+    for(int g = 0; g < 2; g++){
+        for(int k = 0; k < 2; k++){
+            bool isParallel = (k == 1);
+            const char *method = isParallel ? "ParallelEdgeCollapse" : "EdgeCollapse";
+
+            Mesh mesh;
+            if(BuildGeneratedMesh(generators[g], NO_ALLOCATION_FACES, mesh) == false){
+                printf("  %s cannot be generated\n", generators[g]);
+                return false;
+            }
+
+            Simplification simplification;
+            simplification.SetHistoryLimit(0, false);
+            simplification.DeferNormals(true);
+            simplification.InitSimplification(&mesh);
+
+            if(isParallel){
+                simplification.ParallelEdgeCollapse(mesh.n_faces - mesh.n_faces / 32);
+            }else{
+                for(int i = 0; i < 16; i++) simplification.EdgeCollapse();
+            }
+            simplification.UpdateNormals();
+
+            int n_faces = simplification.NumberOfActiveFaces();
+
+            long long n_allocations = GetAllocationCount();
+            CollapseTo(simplification, mesh.n_faces / 10, isParallel);
+            n_allocations = GetAllocationCount() - n_allocations;
+
+            // a collapse removes two faces, or one on the boundary
+            int n_collapses = (n_faces - simplification.NumberOfActiveFaces()) / 2;
+
+            if(n_allocations != 0 || n_collapses < NO_ALLOCATION_COLLAPSES){
+                printf("  %s, %s: %lld allocations in about %d collapses\n", generators[g], method, n_allocations, n_collapses);
+                isPassed = false;
+            }
+        }
+
+        // the splits, of collapses recorded in a first pass
+        Mesh mesh;
+        if(BuildGeneratedMesh(generators[g], NO_ALLOCATION_FACES, mesh) == false){
+            printf("  %s cannot be generated\n", generators[g]);
+            return false;
+        }
+
+        Simplification simplification;
+        simplification.DeferNormals(true);
+        simplification.InitSimplification(&mesh);
+        CollapseTo(simplification, mesh.n_faces / 10, false);
+
+        int n_splits = simplification.NumberOfAppliedCollapses();
+
+        long long n_allocations = GetAllocationCount();
+        while(simplification.NumberOfAppliedCollapses() > 0) simplification.VertexSplit();
+        simplification.UpdateNormals();
+        n_allocations = GetAllocationCount() - n_allocations;
+
+        if(n_allocations != 0 || n_splits < NO_ALLOCATION_COLLAPSES){
+            printf("  %s: %lld allocations in %d splits\n", generators[g], n_allocations, n_splits);
+            isPassed = false;
+        }
+    }
+
+    return isPassed;
+}
+
+
+// The buffers that the viewer draws, kept up to date by RenderBuffer::Update from the changed faces, hold the active
+// faces of the mesh and the positions and normals of their vertices after every kind of frame: collapses, splits,
+// seeks that restore a checkpoint, and view-dependent refinement. The simplification is set up as in main.cpp
+static bool TestRenderBuffer()
+{
+    Mesh mesh;
+    if(BuildGeneratedMesh("sphere", 5000, mesh) == false){
+        printf("  sphere cannot be generated\n");
+        return false;
+    }
+
+    Simplification simplification;
+    simplification.SetCheckpointInterval(mesh.n_vertices / 8 + 1);
+    simplification.TrackChanges(true);
+    simplification.DeferNormals(true);
+    simplification.InitSimplification(&mesh);
+
+    RenderBuffer buffer;
+    buffer.Build(mesh);
+
+    int n_builds = 0;
+    bool isPassed = true;
+
+    for(int i = 0; i < 200; i++) simplification.EdgeCollapse();
+    isPassed &= DrawFrame(simplification, mesh, buffer, "collapses", n_builds);
+
+    for(int i = 0; i < 100; i++) simplification.VertexSplit();
+    isPassed &= DrawFrame(simplification, mesh, buffer, "splits", n_builds);
+
+    // down past several checkpoints, and back up and down between them
+    int seekFaces[] = { mesh.n_faces / 10, mesh.n_faces * 3 / 4, mesh.n_faces / 2, mesh.n_faces / 5, mesh.n_faces };
+
+    for(int i = 0; i < 5; i++){
+        simplification.SeekFaceCount(seekFaces[i]);
+        isPassed &= DrawFrame(simplification, mesh, buffer, "seek", n_builds);
+    }
+
+    if(n_builds == 0){
+        printf("  no seek restored a checkpoint\n");
+        isPassed = false;
+    }
+
+    // a camera that moves closer while it turns around the sphere, which is at the origin with radius 1
+    simplification.SeekFaceCount(mesh.n_faces / 10);
+    simplification.StartSelectiveRefinement();
+
+    int n_changes = 0;
+
+    for(int frame = 0; frame < 8; frame++){
+        double angle = 0.4 * frame, distance = 4.0 - 0.3 * frame;
+
+        ViewParameters view;
+        view.eye[0]       = distance * sin(angle);
+        view.eye[1]       = 0.3;
+        view.eye[2]       = distance * cos(angle);
+        view.direction[0] = -sin(angle);
+        view.direction[1] = 0.0;
+        view.direction[2] = -cos(angle);
+        view.fieldOfView  = 0.8;
+        view.aspect       = 1.0;
+        view.screenHeight = 600;
+        view.tolerance    = 1.0;
+
+        n_changes += simplification.RefineForView(view);
+        isPassed &= DrawFrame(simplification, mesh, buffer, "view-dependent", n_builds);
+    }
+
+    simplification.EndSelectiveRefinement();
+    isPassed &= DrawFrame(simplification, mesh, buffer, "end of view-dependent", n_builds);
+
+    if(n_changes == 0){
+        printf("  the view-dependent frames changed nothing\n");
+        isPassed = false;
+    }
+
+    return isPassed;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// main
+/////////////////////////////////////////////////////////////////////////////
+
+struct Test {
+    const char *name;
+    bool      (*Run)();
+};
+
+static const Test tests[] = {
+    { "quadric kernels", TestQuadricKernels },
+    { "unused vertex",   TestUnusedVertex   },
+    { "no faces",        TestNoFaces        },
+    { "no allocations",  TestNoAllocations  },
+    { "render buffer",   TestRenderBuffer   },
+};
+
+int main()
+{
+    int n_failed = 0;
+
+    for(unsigned int i = 0; i < sizeof(tests)/sizeof(tests[0]); i++){
+        bool isPassed = tests[i].Run();
+
+        printf("%s %s\n", isPassed ? "PASS" : "FAIL", tests[i].name);
+        if(isPassed == false) n_failed++;
+    }
+
+    if(n_failed > 0) printf("%d failed\n", n_failed);
+
+    return (n_failed > 0) ? 1 : 0;
+}
@@ -1,14 +1,23 @@
 #include "mesh.h"
 #include <cmath>
+#include <cstdlib>
+#include <new>
 
-inline void CrossProduct(double *a, double *b, double *c)
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+void CrossProduct(double *a, double *b, double *c)
 {
     c[0] = a[1] * b[2] - a[2] * b[1];
     c[1] = a[2] * b[0] - a[0] * b[2];
     c[2] = a[0] * b[1] - a[1] * b[0];
 }
 
-inline void Normalize(double *a)
+void Normalize(double *a)
 {
     double length = sqrt(a[0]*a[0] + a[1]*a[1] + a[2]*a[2]);
 
@@ -21,85 +30,90 @@ inline void Normalize(double *a)
     a[2] *= inv_length;
 }
 
-inline double DotProduct(double *a, double *b)
+double DotProduct(double *a, double *b)
 {
     return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
 }
 
-inline double DotProduct4D(double *a, double *b)
+double DotProduct4D(double *a, double *b)
 {
     return a[0]*b[0] + a[1]*b[1] + a[2]*b[2] + a[3]*b[3];
 }
 
-inline void GetArea(double *normal, double &area)
+void GetArea(double *normal, double &area)
 {
     // assuming that "normal" is not normalized at this point 
     area = 0.5 * sqrt(normal[0]*normal[0] + normal[1]*normal[1] + normal[2]*normal[2]);
 }
 
 
-inline double GetDistance(double *a, double *b)
+double GetDistance(double *a, double *b)
 {
     return sqrt( pow(a[0]-b[0], 2.0) + pow(a[1]-b[1], 2.0) + pow(a[2]-b[2], 2.0) ); 
 }
 
-inline double GetLength(double *a)
+double GetLength(double *a)
 {
     return sqrt(a[0]*a[0] + a[1]*a[1] + a[2]*a[2]); 
 }
 
 
-inline void Swap(double &a, double &b)
+// seconds since an arbitrary origin, for timing
+double GetWallClockTime()
 {
-    double t = a;  a = b;  b = t;
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec + tv.tv_usec * 1.0e-6;
+#endif
 }
 
-inline bool SolveLinearSystem(double (*matrix)[4], double *rhs, double *solution)
-{  
-    // perform gaussian elimination
-
-    for(int i = 0; i <= 3; i++){
-        double maxAbsoluteValue = -1.0;
-        int    pivot_index;
-
-        // choose maximum "matrix[j][i]" as a pivot
-        for(int j = i; j <= 3; j++){
-            if(fabs(matrix[j][i]) > maxAbsoluteValue){
-                maxAbsoluteValue = fabs(matrix[j][i]);
-                pivot_index      = j;
-            }
-        }
-
-        // matrix is singular
-        if(maxAbsoluteValue < 1.0e-6) return false;
-
-        for(int j = i; j <= 3; j++) Swap(matrix[i][j], matrix[pivot_index][j]);
-        Swap(rhs[i], rhs[pivot_index]);
-
-        double scale = 1.0 / matrix[i][i];
+// gives up the processor for about this long, e.g. while waiting for memory to be released by other threads
+void SleepMilliseconds(int milliseconds)
+{
+#ifdef _WIN32
+    Sleep(milliseconds);
+#else
+    usleep(milliseconds * 1000);
+#endif
+}
 
-        for(int j = i+1; j <= 3; j++){
-            double pivot = -matrix[j][i]*scale;
 
-            for(int k = 0;   k <= i; k++) matrix[j][k] = 0.0;
-            for(int k = i+1; k <= 3; k++){
-                if(fabs(matrix[i][k]) > 1.0e-6)
-                    matrix[j][k] += matrix[i][k] * pivot;
-                else
-                    break;
-            }
+#ifdef MESH_COUNT_ALLOCATIONS
+// every operator new of the program is counted, e.g. to check that the collapse loop does not allocate
+static long long n_allocations = 0;
 
-            rhs[j] += rhs[i] * pivot;
-        }
-    }
+void* operator new(size_t size)
+{
+    #pragma omp atomic
+    n_allocations++;
 
-    for(int i = 3; i >= 0; i--){  
-        solution[i] = 0.0;
-        for(int j = i+1; j <= 3; j++) solution[i] += solution[j]*matrix[i][j];
+    void *p = malloc(size > 0 ? size : 1);
+    if(p == NULL) throw std::bad_alloc();
 
-        solution[i] = (rhs[i]-solution[i])/matrix[i][i];
-    }
+    return p;
+}
 
+void* operator new[](size_t size)    { return operator new(size); }
+void  operator delete(void *p) throw()   { free(p); }
+void  operator delete[](void *p) throw() { free(p); }
+void  operator delete(void *p, size_t) throw()   { free(p); }  // sized, as C++14 compilers call them
+void  operator delete[](void *p, size_t) throw() { free(p); }
 
-    return true;
+long long GetAllocationCount()
+{
+    return n_allocations;
+}
+#else
+long long GetAllocationCount()
+{
+    return -1;
 }
+#endif
@@ -0,0 +1,134 @@
+#include "mesh.h"
+#include "parallel.h"
+#include "fileio.h"
+#include "stats.h"
+#include <cstdio>
+
+
+// renumber the vertices used by active faces in index order. "vertexId" is NIL for the others
+static int CompactVertices(Mesh *mesh, vector<int> &vertexId)
+{
+    vertexId.assign(mesh->n_vertices, NIL);
+
+    for(int f = 0; f < mesh->n_faces; f++){
+        if(mesh->faces.isActive[f]){
+            for(int i = 0; i < 3; i++) vertexId[mesh->halfedges.vertex[3*f+i]] = 0;
+        }
+    }
+
+    int n_usedVertices = 0;
+    for(int v = 0; v < mesh->n_vertices; v++){
+        if(vertexId[v] == 0) vertexId[v] = n_usedVertices++;
+    }
+
+    return n_usedVertices;
+}
+
+static int CountActiveFaces(Mesh *mesh)
+{
+    int n_activeFaces = 0;
+    for(int f = 0; f < mesh->n_faces; f++) if(mesh->faces.isActive[f]) n_activeFaces++;
+
+    return n_activeFaces;
+}
+
+
+// write only active vertices and faces, in the original coordinates of the input file
+bool Mesh::WriteMeshFile(char *filename)
+{
+    STAT_TIMER(PHASE_WRITE);
+
+    const char *extension = strrchr(filename, '.');
+
+    if( extension != NULL && HasExtension(extension, ".ply") ) return WritePLYFile(filename);
+    else                                                       return WriteOFFFile(filename);
+}
+
+bool Mesh::WriteOFFFile(char *filename)
+{
+    FILE *fp = fopen(filename, "w");
+
+    if(fp == NULL){
+        cerr << "cannot open " << filename << endl;
+        return false;
+    }
+
+    vector<int> vertexId;
+    int n_usedVertices = CompactVertices(this, vertexId);
+    int n_activeFaces  = CountActiveFaces(this);
+
+    fprintf(fp, "OFF\n%d %d 0\n", n_usedVertices, n_activeFaces);
+
+    for(int v = 0; v < n_vertices; v++){
+        if(vertexId[v] == NIL) continue;
+
+        Real *coord = VertexCoord(v);
+        fprintf(fp, "%.9g %.9g %.9g\n", coord[0] / normalizationScale + normalizationCenter[0],
+                                        coord[1] / normalizationScale + normalizationCenter[1],
+                                        coord[2] / normalizationScale + normalizationCenter[2]);
+    }
+
+    for(int f = 0; f < n_faces; f++){
+        if(faces.isActive[f] == false) continue;
+
+        fprintf(fp, "3 %d %d %d\n", vertexId[halfedges.vertex[3*f]], vertexId[halfedges.vertex[3*f+1]], vertexId[halfedges.vertex[3*f+2]]);
+    }
+
+    bool isWritten = (ferror(fp) == 0);
+    if(fclose(fp) != 0) isWritten = false;
+
+    if(isWritten == false) cerr << "cannot write " << filename << endl;
+
+    return isWritten;
+}
+
+// binary PLY with float coordinates and int indices, in the byte order of this machine
+bool Mesh::WritePLYFile(char *filename)
+{
+    FILE *fp = fopen(filename, "wb");
+
+    if(fp == NULL){
+        cerr << "cannot open " << filename << endl;
+        return false;
+    }
+
+    vector<int> vertexId;
+    int n_usedVertices = CompactVertices(this, vertexId);
+    int n_activeFaces  = CountActiveFaces(this);
+
+    unsigned int one = 1;
+    bool isLittleEndianMachine = (*(unsigned char*)&one == 1);
+
+    fprintf(fp, "ply\nformat %s 1.0\n", isLittleEndianMachine ? "binary_little_endian" : "binary_big_endian");
+    fprintf(fp, "element vertex %d\nproperty float x\nproperty float y\nproperty float z\n", n_usedVertices);
+    fprintf(fp, "element face %d\nproperty list uchar int vertex_indices\nend_header\n", n_activeFaces);
+
+    for(int v = 0; v < n_vertices; v++){
+        if(vertexId[v] == NIL) continue;
+
+        Real *coord = VertexCoord(v);
+        float xyz[3];
+        for(int i = 0; i < 3; i++) xyz[i] = (float)(coord[i] / normalizationScale + normalizationCenter[i]);
+
+        fwrite(xyz, sizeof(float), 3, fp);
+    }
+
+    // 13 bytes per face: the count "3" and three indices
+    char record[13];
+    record[0] = 3;
+
+    for(int f = 0; f < n_faces; f++){
+        if(faces.isActive[f] == false) continue;
+
+        for(int i = 0; i < 3; i++) memcpy(record + 1 + 4*i, &vertexId[halfedges.vertex[3*f+i]], 4);
+
+        fwrite(record, 1, 13, fp);
+    }
+
+    bool isWritten = (ferror(fp) == 0);
+    if(fclose(fp) != 0) isWritten = false;
+
+    if(isWritten == false) cerr << "cannot write " << filename << endl;
+
+    return isWritten;
+}